@@ -3,7 +3,13 @@
 if [[ -z "${BUILD_EMSCRIPTEN}" ]]; then
     rm -rf build
     mkdir build
-    gcc -o build/lil-tetris src/lil-tetris.c `sdl2-config --cflags --libs` -lm -lSDL2_mixer -lSDL2_ttf
+    gcc -o build/lil-tetris src/lil-tetris.c `sdl2-config --cflags --libs` -lm -lSDL2_mixer -lSDL2_ttf -lpthread
+
+    # Headless tools, no SDL required
+    gcc -O2 -o build/lil-tetris-batch src/lil-tetris-batch.c -lpthread -lrt
+    gcc -O2 -o build/lil-tetris-evalbench src/lil-tetris-evalbench.c -lpthread
+    gcc -O2 -shared -fPIC -o build/liblil-tetris-vecenv.so src/lil-tetris-vecenv.c -lpthread
+    gcc -O2 -o build/lil-tetris-solver src/lil-tetris-solver.c -lpthread
 else
     rm -rf embuild
     mkdir embuild
@@ -0,0 +1,601 @@
+// Headless batch runner: plays many independent games across a pool of worker
+// threads, each driven by a policy, and writes one result line per game.
+#define LIL_TETRIS_HEADLESS
+#define _GNU_SOURCE // pipe2() for external bots
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lil-tetris-sim.c"
+#include "lil-tetris-policy.c"
+#include "lil-tetris-replay.c"
+#include "lil-tetris-shmring.c"
+#include "lil-tetris-finesse.c"
+
+#define BATCH_DEFAULT_GAMES 1000
+#define BATCH_DEFAULT_MAX_FRAMES (60 * 60 * 60) // An hour of real time play
+#define BATCH_DEFAULT_BOT_WAIT_MILLIS 1000
+#define BATCH_CLAIM_CHUNK 8
+#define BATCH_OUTPUT_BUFFER_SIZE (64 * 1024)
+#define BATCH_MAX_RESULT_LINE 128
+#define BATCH_MAX_PATH 512
+
+typedef struct
+{
+    Uint64 Seed;
+    Uint64 Frames;
+    Uint64 DurationUs;
+    Uint32 Pieces;
+    Uint16 Lines;
+    Uint8  Level;
+} BatchGameResult_t;
+
+typedef struct
+{
+    Policy_t*       pPolicy;
+    Uint64          NumGames;
+    Uint64          BaseSeed;
+    Uint64          MaxFrames;
+    const char*     pRecordDir;
+    const char*     pShmRingPrefix;
+    Uint32          ShmRingCapacity;
+    FILE*           pOutput;
+    pthread_mutex_t OutputLock;
+    atomic_ullong   NextGame;
+    atomic_bool     IsAborted; // A worker hit an error the whole run should stop for
+} BatchContext_t;
+
+typedef struct
+{
+    BatchContext_t* pContext;
+    long            Index;
+    char            OutputBuffer[BATCH_OUTPUT_BUFFER_SIZE];
+    size_t          OutputSize;
+    Uint64          GamesPlayed;
+    ReplayWriter_t  Replay;
+    ShmRing_t       Ring;
+    bool            IsStreaming;
+} BatchWorker_t;
+
+static Uint64 batchNowUs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64)now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+static void batchFlushWorkerOutput(BatchWorker_t* pWorker)
+{
+    if (pWorker->OutputSize == 0)
+    {
+        return;
+    }
+
+    BatchContext_t* pContext = pWorker->pContext;
+    pthread_mutex_lock(&(pContext->OutputLock));
+    fwrite(pWorker->OutputBuffer, 1, pWorker->OutputSize, pContext->pOutput);
+    pthread_mutex_unlock(&(pContext->OutputLock));
+
+    pWorker->OutputSize = 0;
+}
+
+static Uint32 batchCountCommits(const Sim_t* pSim)
+{
+    Uint32 commits = 0;
+    for (Uint8 i = 0; i < pSim->numEvents; ++i)
+    {
+        if (pSim->events[i].Type == SIM_EVENT_COMMIT)
+        {
+            ++commits;
+        }
+    }
+
+    return commits;
+}
+
+static void batchFillResult(
+    const Sim_t* pSim,
+    Uint64 startUs,
+    Uint32 pieces,
+    BatchGameResult_t* pResultOut)
+{
+    pResultOut->Seed = pSim->seed;
+    pResultOut->Frames = pSim->state.currentFrame;
+    pResultOut->DurationUs = batchNowUs() - startUs;
+    pResultOut->Pieces = pieces;
+    pResultOut->Lines = pSim->state.totalClearedLines;
+    pResultOut->Level = pSim->state.currentLevel;
+}
+
+// Returns false, after closing the ring and aborting the run, if the ring's
+// consumer stopped draining it
+static bool batchStreamStep(BatchWorker_t* pWorker, const Sim_t* pSim, float reward, Uint8 flags)
+{
+    ShmRingRecord_t* pRecord = ShmRingReserve(&(pWorker->Ring));
+    if (!pRecord)
+    {
+        fprintf(stderr,
+            "Nothing read shared memory ring %s for %ums, closing it\n",
+            pWorker->Ring.Name,
+            pWorker->Ring.TimeoutMillis);
+        ShmRingClose(&(pWorker->Ring));
+        pWorker->IsStreaming = false;
+        atomic_store(&(pWorker->pContext->IsAborted), true);
+        return false;
+    }
+
+    pRecord->Seed = pSim->seed;
+    pRecord->Hash = pSim->hash;
+    pRecord->Frame = pSim->state.currentFrame;
+    pRecord->Reward = reward;
+    memcpy(pRecord->RowBits, pSim->state.rowBits, sizeof(pRecord->RowBits));
+    pRecord->Features = pSim->features;
+    pRecord->CurrentPatternType = pSim->state.currentPatternType;
+    pRecord->HoldPatternType = pSim->state.holdPatternType;
+    for (int i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        pRecord->NextQueue[i] =
+            pSim->state.nextQueue[(pSim->state.nextQueueIndex + i) % NEXT_QUEUE_SIZE];
+    }
+    pRecord->Flags = flags;
+    ShmRingPublish(&(pWorker->Ring));
+    return true;
+}
+
+static void batchPlayGame(
+    BatchWorker_t* pWorker,
+    Uint64 seed,
+    Sim_t* pSim,
+    void* pPolicyState,
+    BatchGameResult_t* pResultOut)
+{
+    BatchContext_t* pContext = pWorker->pContext;
+    Policy_t* pPolicy = pContext->pPolicy;
+    const Uint64 StartUs = batchNowUs();
+
+    SimInitialize(pSim, seed);
+    memset(pPolicyState, 0, pPolicy->StateSize);
+    pPolicy->Begin(pPolicyState, seed);
+
+    bool isRecording = false;
+    if (pContext->pRecordDir)
+    {
+        char path[BATCH_MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%llu.ltr",
+            pContext->pRecordDir,
+            (unsigned long long)seed);
+        isRecording = ReplayWriterOpen(&(pWorker->Replay), path, seed);
+    }
+
+    Uint32 pieces = 0;
+    Uint16 streamedLines = 0;
+    while (!pSim->state.isGameOver &&
+           pSim->state.currentFrame < pContext->MaxFrames &&
+           !atomic_load_explicit(&(pContext->IsAborted), memory_order_relaxed))
+    {
+        const Uint16 Inputs = pPolicy->NextInputs(pPolicyState, pSim);
+        if (isRecording)
+        {
+            ReplayWriterAppend(&(pWorker->Replay), pSim, Inputs);
+        }
+
+        SimStep(pSim, Inputs);
+        const Uint32 Commits = batchCountCommits(pSim);
+        pieces += Commits;
+
+        if (pWorker->IsStreaming && Commits > 0)
+        {
+            if (!batchStreamStep(pWorker, pSim, pSim->state.totalClearedLines - streamedLines, 0))
+            {
+                break;
+            }
+            streamedLines = pSim->state.totalClearedLines;
+        }
+    }
+
+    if (pWorker->IsStreaming && !atomic_load(&(pContext->IsAborted)))
+    {
+        batchStreamStep(
+            pWorker,
+            pSim,
+            pSim->state.totalClearedLines - streamedLines,
+            SHMRING_RECORD_DONE);
+    }
+
+    if (isRecording)
+    {
+        ReplayWriterClose(&(pWorker->Replay));
+    }
+
+    if (pPolicy->End)
+    {
+        pPolicy->End(pPolicyState);
+    }
+
+    batchFillResult(pSim, StartUs, pieces, pResultOut);
+}
+
+static void batchWriteResult(const BatchGameResult_t* pResult, char* pOut, size_t size, size_t* pWrittenOut)
+{
+    *pWrittenOut = snprintf(
+        pOut,
+        size,
+        "%llu,%hu,%hhu,%u,%llu,%llu\n",
+        (unsigned long long)pResult->Seed,
+        pResult->Lines,
+        pResult->Level,
+        pResult->Pieces,
+        (unsigned long long)pResult->Frames,
+        (unsigned long long)pResult->DurationUs);
+}
+
+// Re-simulates a recorded replay and prints its result line, so a claimed
+// score can be checked against the inputs that supposedly produced it. Only
+// the seed and the inputs are trusted; keyframes are never restored, just
+// checked against the re-simulated state.
+static bool batchVerifyReplay(const char* pPath, FILE* pOutput)
+{
+    ReplayReader_t reader;
+    if (!ReplayReaderOpen(&reader, pPath))
+    {
+        return false;
+    }
+
+    static Sim_t sim;
+    static FinesseTracker_t finesse;
+    const Uint64 StartUs = batchNowUs();
+    SimInitialize(&sim, reader.Seed);
+    FinesseTrackerReset(&finesse);
+
+    Uint32 pieces = 0;
+    size_t nextKeyframe = 0;
+    bool keyframesMatch = true;
+    for (;;)
+    {
+        while (nextKeyframe < reader.NumKeyframes &&
+               reader.pKeyframes[nextKeyframe].Frame == reader.Frame)
+        {
+            if (!ReplayKeyframeMatches(&reader, nextKeyframe, &sim))
+            {
+                fprintf(stderr, "Replay keyframe at frame %llu doesn't match its inputs\n",
+                    (unsigned long long)reader.Frame);
+                keyframesMatch = false;
+            }
+            ++nextKeyframe;
+        }
+
+        Uint16 inputs;
+        if (!keyframesMatch || !ReplayReaderNext(&reader, &inputs))
+        {
+            break;
+        }
+
+        FinesseTrackerBeforeStep(&finesse, &sim, inputs);
+        SimStep(&sim, inputs);
+        FinesseTrackerAfterStep(&finesse, &sim);
+        pieces += batchCountCommits(&sim);
+    }
+
+    const bool ReachedEnd =
+        keyframesMatch &&
+        nextKeyframe == reader.NumKeyframes &&
+        reader.Offset == reader.Size;
+    ReplayReaderClose(&reader);
+    if (!keyframesMatch)
+    {
+        return false;
+    }
+
+    BatchGameResult_t result;
+    batchFillResult(&sim, StartUs, pieces, &result);
+
+    char line[BATCH_MAX_RESULT_LINE];
+    size_t lineSize;
+    batchWriteResult(&result, line, sizeof(line), &lineSize);
+    fwrite(line, 1, lineSize, pOutput);
+    fprintf(stderr, "finesse: %u placements, %u faults\n", finesse.NumPlacements, finesse.NumFaults);
+    return ReachedEnd;
+}
+
+static void* batchWorkerMain(void* pArg)
+{
+    BatchWorker_t* pWorker = (BatchWorker_t*)pArg;
+    BatchContext_t* pContext = pWorker->pContext;
+
+    Sim_t sim;
+    void* pPolicyState = malloc(pContext->pPolicy->StateSize);
+    if (!pPolicyState)
+    {
+        fprintf(stderr, "Failed to allocate policy state\n");
+        return NULL;
+    }
+
+    // Claim games a chunk at a time so faster workers naturally take more
+    while (!atomic_load(&(pContext->IsAborted)))
+    {
+        const Uint64 First = atomic_fetch_add(&(pContext->NextGame), BATCH_CLAIM_CHUNK);
+        if (First >= pContext->NumGames)
+        {
+            break;
+        }
+
+        const Uint64 Last =
+            First + BATCH_CLAIM_CHUNK < pContext->NumGames ?
+                First + BATCH_CLAIM_CHUNK :
+                pContext->NumGames;
+        for (Uint64 game = First; game < Last; ++game)
+        {
+            BatchGameResult_t result;
+            batchPlayGame(pWorker, pContext->BaseSeed + game, &sim, pPolicyState, &result);
+            if (atomic_load(&(pContext->IsAborted)))
+            {
+                // The game may have been cut short, don't report it
+                break;
+            }
+
+            pWorker->GamesPlayed++;
+
+            if (pWorker->OutputSize + BATCH_MAX_RESULT_LINE > sizeof(pWorker->OutputBuffer))
+            {
+                batchFlushWorkerOutput(pWorker);
+            }
+
+            size_t lineSize;
+            batchWriteResult(
+                &result,
+                pWorker->OutputBuffer + pWorker->OutputSize,
+                sizeof(pWorker->OutputBuffer) - pWorker->OutputSize,
+                &lineSize);
+            pWorker->OutputSize += lineSize;
+        }
+    }
+
+    batchFlushWorkerOutput(pWorker);
+    if (pWorker->IsStreaming)
+    {
+        ShmRingClose(&(pWorker->Ring));
+    }
+
+    free(pPolicyState);
+    return NULL;
+}
+
+static void batchPrintUsage(const char* pProgram)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --games N        Number of games to play (default %d)\n"
+        "  --threads N      Worker threads (default: online cores)\n"
+        "  --seed N         Seed of the first game, game i uses seed + i (default 1)\n"
+        "  --policy NAME    Policy driving every game (default random)\n"
+        "  --max-frames N   Stop games that run longer than this (default %d)\n"
+        "  --output PATH    Results file (default stdout)\n"
+        "  --record-dir DIR Write a replay of every game to DIR/<seed>.ltr\n"
+        "  --verify PATH    Re-simulate a replay and print its result instead\n"
+        "  --beam-threads N Search threads per game for the beam policy (default 1)\n"
+        "  --beam-width N   Boards kept per depth by the beam policy (default %d)\n"
+        "  --beam-budget US Beam policy thinking time per pattern, results then depend\n"
+        "                   on machine speed (default 0: fixed depth and width)\n"
+        "  --shm-ring NAME  Stream every placement to shared memory ring /NAME-<worker>,\n"
+        "                   the run fails if a full ring goes unread for %ds\n"
+        "  --shm-records N  Records per ring, at most %u (default %d)\n"
+        "  --bot CMD        Play every game with an external bot, talking TBP over\n"
+        "                   CMD's stdin and stdout, one process per game\n"
+        "  --bot-wait MS    Longest wait for each of the bot's suggestions (default %d)\n",
+        pProgram,
+        BATCH_DEFAULT_GAMES,
+        BATCH_DEFAULT_MAX_FRAMES,
+        BOT_DEFAULT_BEAM_WIDTH,
+        SHMRING_DEFAULT_TIMEOUT_MILLIS / 1000,
+        SHMRING_MAX_CAPACITY,
+        SHMRING_DEFAULT_CAPACITY,
+        BATCH_DEFAULT_BOT_WAIT_MILLIS);
+}
+
+int main(int argc, char** argv)
+{
+    Uint64 numGames = BATCH_DEFAULT_GAMES;
+    Uint64 baseSeed = 1;
+    Uint64 maxFrames = BATCH_DEFAULT_MAX_FRAMES;
+    long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* pPolicyName = "random";
+    const char* pOutputPath = NULL;
+    const char* pRecordDir = NULL;
+    const char* pVerifyPath = NULL;
+    const char* pShmRingPrefix = NULL;
+    Uint64 shmRingCapacity = SHMRING_DEFAULT_CAPACITY;
+
+    // Games already run in parallel, so each one searches on its own thread
+    g_BotConfig.NumThreads = 1;
+
+    // Frames don't wait for anyone here, so an external bot is waited on
+    // to keep its results from depending on how fast it answers
+    g_ExtBotConfig.WaitMillis = BATCH_DEFAULT_BOT_WAIT_MILLIS;
+
+    SimInitializeTables();
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool HasValue = (i + 1) < argc;
+        if (strcmp(argv[i], "--games") == 0 && HasValue)
+        {
+            numGames = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && HasValue)
+        {
+            numThreads = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && HasValue)
+        {
+            baseSeed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--policy") == 0 && HasValue)
+        {
+            pPolicyName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-frames") == 0 && HasValue)
+        {
+            maxFrames = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--output") == 0 && HasValue)
+        {
+            pOutputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record-dir") == 0 && HasValue)
+        {
+            pRecordDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--verify") == 0 && HasValue)
+        {
+            pVerifyPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--shm-ring") == 0 && HasValue)
+        {
+            pShmRingPrefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--shm-records") == 0 && HasValue)
+        {
+            shmRingCapacity = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--beam-threads") == 0 && HasValue)
+        {
+            g_BotConfig.NumThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--beam-width") == 0 && HasValue)
+        {
+            g_BotConfig.BeamWidth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--beam-budget") == 0 && HasValue)
+        {
+            g_BotConfig.BudgetMicros = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--bot") == 0 && HasValue)
+        {
+            g_ExtBotConfig.pCommand = argv[++i];
+            pPolicyName = "external";
+        }
+        else if (strcmp(argv[i], "--bot-wait") == 0 && HasValue)
+        {
+            g_ExtBotConfig.WaitMillis = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            batchPrintUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (pVerifyPath)
+    {
+        // Built before the verify timer starts, it's not part of the replay
+        FinesseInitialize();
+        fprintf(stdout, "seed,lines,level,pieces,frames,duration_us\n");
+        return batchVerifyReplay(pVerifyPath, stdout) ? 0 : -1;
+    }
+
+    if (numThreads < 1)
+    {
+        numThreads = 1;
+    }
+
+    if (shmRingCapacity == 0 || shmRingCapacity > SHMRING_MAX_CAPACITY)
+    {
+        fprintf(stderr, "--shm-records should be between 1 and %u\n", SHMRING_MAX_CAPACITY);
+        return -1;
+    }
+
+    static BatchContext_t context;
+    context.pPolicy = PolicyFind(pPolicyName);
+    if (!context.pPolicy)
+    {
+        fprintf(stderr, "Unknown policy: %s\n", pPolicyName);
+        return -1;
+    }
+
+    context.pOutput = pOutputPath ? fopen(pOutputPath, "w") : stdout;
+    if (!context.pOutput)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", pOutputPath);
+        return -1;
+    }
+
+    context.NumGames = numGames;
+    context.BaseSeed = baseSeed;
+    context.MaxFrames = maxFrames;
+    context.pRecordDir = pRecordDir;
+    context.pShmRingPrefix = pShmRingPrefix;
+    context.ShmRingCapacity = (Uint32)shmRingCapacity;
+    pthread_mutex_init(&(context.OutputLock), NULL);
+    atomic_init(&(context.NextGame), 0);
+    atomic_init(&(context.IsAborted), false);
+
+    BatchWorker_t* pWorkers = calloc(numThreads, sizeof(BatchWorker_t));
+    pthread_t* pThreads = calloc(numThreads, sizeof(pthread_t));
+    if (!pWorkers || !pThreads)
+    {
+        fprintf(stderr, "Failed to allocate workers\n");
+        return -1;
+    }
+
+    // Every requested ring has to exist before any games are played,
+    // otherwise their records would silently go nowhere
+    for (long i = 0; pShmRingPrefix && i < numThreads; ++i)
+    {
+        char name[BATCH_MAX_PATH];
+        snprintf(name, sizeof(name), "/%s-%ld", pShmRingPrefix, i);
+        if (!ShmRingCreate(&(pWorkers[i].Ring), name, context.ShmRingCapacity))
+        {
+            for (long j = 0; j < i; ++j)
+            {
+                ShmRingClose(&(pWorkers[j].Ring));
+            }
+            return -1;
+        }
+
+        pWorkers[i].IsStreaming = true;
+    }
+
+    fprintf(context.pOutput, "seed,lines,level,pieces,frames,duration_us\n");
+
+    const Uint64 StartUs = batchNowUs();
+    for (long i = 0; i < numThreads; ++i)
+    {
+        pWorkers[i].pContext = &context;
+        pWorkers[i].Index = i;
+        if (pthread_create(&pThreads[i], NULL, batchWorkerMain, &pWorkers[i]) != 0)
+        {
+            fprintf(stderr, "Failed to create worker thread %ld\n", i);
+            return -1;
+        }
+    }
+
+    Uint64 gamesPlayed = 0;
+    for (long i = 0; i < numThreads; ++i)
+    {
+        pthread_join(pThreads[i], NULL);
+        gamesPlayed += pWorkers[i].GamesPlayed;
+    }
+
+    const double ElapsedSeconds = (batchNowUs() - StartUs) / 1000000.0;
+    fprintf(stderr,
+        "Played %llu games on %ld threads in %.2fs (%.1f games/s)\n",
+        (unsigned long long)gamesPlayed,
+        numThreads,
+        ElapsedSeconds,
+        ElapsedSeconds > 0 ? gamesPlayed / ElapsedSeconds : 0.0);
+
+    if (context.pOutput != stdout)
+    {
+        fclose(context.pOutput);
+    }
+
+    pthread_mutex_destroy(&(context.OutputLock));
+    free(pThreads);
+    free(pWorkers);
+    return atomic_load(&(context.IsAborted)) ? -1 : 0;
+}
@@ -0,0 +1,954 @@
+#pragma once
+
+// Beam search bot. Each search looks ahead through the current pattern, the
+// next queue and hold: every beam node is expanded with every placement the
+// move generator finds for each way of using the next piece, and only the
+// best BeamWidth children survive to the next depth.
+//
+// Expansion is spread over a pool of worker threads. Each worker keeps its
+// own best BeamWidth children, and a transposition table shared by all of
+// them drops children whose board (and hold/queue position) was already
+// reached with an equal or better score.
+//
+// Given a time budget the search is anytime: the first pass deepens one piece
+// at a time and each finished depth refreshes the best move, later passes
+// redo the search with twice as wide a beam for as long as time allows. A
+// search can be sliced over several calls, so a caller with a frame to
+// render can think a little every frame.
+
+#include "lil-tetris-sim.c"
+#include "lil-tetris-movegen.c"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define BOT_DEFAULT_BEAM_WIDTH 64
+#define BOT_MAX_PIECES (NEXT_QUEUE_SIZE + 1)
+#define BOT_MAX_THREADS 64
+#define BOT_TABLE_BITS 18
+
+// Budgeted searches widen the beam up to BeamWidth << BOT_MAX_WIDEN_STEPS
+#define BOT_MAX_WIDEN_STEPS 3
+
+// Real-time play at 60 frames a second: think for at most half of each
+// frame, leaving the rest for the sim and rendering
+#define BOT_REALTIME_BUDGET_MICROS 50000
+#define BOT_REALTIME_FRAME_MICROS 8000
+
+// Linear evaluation over board features, line clears are rewarded as they
+// happen and accumulate along a line of play
+#define BOT_WEIGHT_AGGREGATE_HEIGHT -0.510066f
+#define BOT_WEIGHT_HOLES            -0.35663f
+#define BOT_WEIGHT_BUMPINESS        -0.184483f
+#define BOT_WEIGHT_LINES             0.760666f
+
+typedef struct
+{
+    int    NumThreads;   // 0 uses every online core
+    int    BeamWidth;
+    Uint32 BudgetMicros; // Thinking time per pattern, 0 searches to full depth
+    Uint32 FrameMicros;  // Thinking time per policy call, 0 for no limit
+} BotConfig_t;
+
+static BotConfig_t g_BotConfig = { 0, BOT_DEFAULT_BEAM_WIDTH, 0, 0 };
+
+// First placement of a line of play, which is what the bot ends up doing
+typedef struct
+{
+    Sint8 X;
+    Sint8 Y;
+    Uint8 Rotation;
+    bool  UseHold;
+} BotMove_t;
+
+typedef struct
+{
+    Uint16             RowBits[GRID_HEIGHT];
+    SimBoardFeatures_t Features;
+    float              Reward; // Accumulated line clear rewards
+    float              Score;  // Reward plus the evaluation of the board
+    Uint64             Hash;   // Zobrist hash of RowBits, kept incrementally
+    Uint8              Hold;   // PatternType_t
+    Uint8              NextPiece;
+    BotMove_t          FirstMove;
+} BotNode_t;
+
+// Lock-free entry: a torn write leaves KeyXorData ^ Data not matching any
+// key, so a racing reader just sees a miss
+typedef struct
+{
+    Uint64 KeyXorData;
+    Uint64 Data; // Search id << 32 | score bits
+} BotTableEntry_t;
+
+struct Bot_s;
+
+typedef struct
+{
+    struct Bot_s* pBot;
+    pthread_t     Thread;
+    MoveGen_t     MoveGen;
+    BotNode_t*    pChildren; // Min-heap on Score, at most PassWidth nodes
+    int           NumChildren;
+} BotWorker_t;
+
+typedef struct Bot_s
+{
+    int              NumThreads;
+    int              BeamWidth;
+    int              MaxBeamWidth;
+    Uint32           BudgetMicros;
+    Uint32           FrameMicros;
+    BotWorker_t*     pWorkers;
+
+    pthread_mutex_t  Lock;
+    pthread_cond_t   WorkReady;
+    pthread_cond_t   WorkDone;
+    Uint32           Generation;
+    int              WorkersBusy;
+    bool             Quit;
+
+    // The depth being expanded. An expansion cut short by the deadline keeps
+    // its workers' children and carries on from NextNode next time.
+    BotNode_t*       pBeam;
+    int              BeamSize;
+    atomic_int       NextNode;
+    bool             IsExpanding;
+    Uint64           DeadlineMicros; // 0 for none
+    atomic_bool      IsPastDeadline;
+    Uint8            Pieces[BOT_MAX_PIECES];
+    Uint8            NumPieces;
+    bool             IsRoot;
+    const Sim_t*     pRootSim;
+
+    BotTableEntry_t* pTable;
+    Uint32           SearchId;
+
+    BotNode_t*       pNextBeam;
+
+    // Anytime search state. Every pass starts over from the root's children;
+    // Best comes from the deepest depth finished so far, the widest beam
+    // winning ties.
+    BotNode_t*       pRootChildren;
+    int              NumRootChildren;
+    int              PassWidth;
+    int              Depth;
+    int              BestDepth;
+    BotMove_t        Best;
+    bool             IsDone;
+} Bot_t;
+
+static Uint64 botNowMicros()
+{
+#ifdef LIL_TETRIS_HEADLESS
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64)now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+#else
+    const Uint64 Counter = SDL_GetPerformanceCounter();
+    const Uint64 Frequency = SDL_GetPerformanceFrequency();
+    return Counter / Frequency * 1000000ull + Counter % Frequency * 1000000ull / Frequency;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Boards
+////////////////////////////////////////////////////////////////////////////////
+// Same key the sim would have for this board with the node's hold and
+// remaining pieces
+static Uint64 botNodeKey(const Bot_t* pBot, const BotNode_t* pNode)
+{
+    const int Remaining = pBot->NumPieces - pNode->NextPiece;
+    if (Remaining <= 0)
+    {
+        return pNode->Hash ^ SimHashPatterns(PATTERN_NONE, pNode->Hold, NULL, 0);
+    }
+
+    return pNode->Hash ^ SimHashPatterns(
+        pBot->Pieces[pNode->NextPiece],
+        pNode->Hold,
+        &(pBot->Pieces[pNode->NextPiece + 1]),
+        Remaining - 1);
+}
+
+static float botEvaluate(const SimBoardFeatures_t* pFeatures)
+{
+    return
+        BOT_WEIGHT_AGGREGATE_HEIGHT * pFeatures->aggregateHeight +
+        BOT_WEIGHT_HOLES * pFeatures->holes +
+        BOT_WEIGHT_BUMPINESS * pFeatures->bumpiness;
+}
+
+// Locks pPattern into pNode's board and clears any rows it completes.
+// Returns the number of cleared rows.
+static int botPlacePattern(BotNode_t* pNode, const Pattern* pPattern, Sint8 gridX, Sint8 gridY)
+{
+    Uint32 fullRows = 0;
+    for (Sint8 y = 0; y <= pPattern->maxRow; ++y)
+    {
+        if (!pPattern->rowMasks[y])
+        {
+            continue;
+        }
+
+        const Sint8 RowY = gridY + y;
+        const Uint16 RowMask = gridX >= 0 ?
+            (Uint16)(pPattern->rowMasks[y] << gridX) :
+            (Uint16)(pPattern->rowMasks[y] >> -gridX);
+        pNode->RowBits[RowY] |= RowMask;
+        pNode->Hash ^= SimHashRow(RowY, RowMask);
+        if (pNode->RowBits[RowY] == SIM_ROW_FULL)
+        {
+            fullRows |= 1u << RowY;
+        }
+    }
+
+    SimFeaturesAddPattern(&(pNode->Features), pPattern, gridX, gridY);
+    if (!fullRows)
+    {
+        return 0;
+    }
+
+    // Rows below the lowest cleared row don't move, rehash the rest
+    const Sint8 LowestCleared = 31 - __builtin_clz(fullRows);
+    for (Sint8 y = 0; y <= LowestCleared; ++y)
+    {
+        pNode->Hash ^= SimHashRow(y, pNode->RowBits[y]);
+    }
+
+    Sint8 destY = GRID_HEIGHT - 1;
+    for (Sint8 y = GRID_HEIGHT - 1; y >= 0; --y)
+    {
+        if (!(fullRows & (1u << y)))
+        {
+            pNode->RowBits[destY--] = pNode->RowBits[y];
+        }
+    }
+
+    while (destY >= 0)
+    {
+        pNode->RowBits[destY--] = 0;
+    }
+
+    for (Sint8 y = 0; y <= LowestCleared; ++y)
+    {
+        pNode->Hash ^= SimHashRow(y, pNode->RowBits[y]);
+    }
+
+    SimFeaturesRemoveRows(&(pNode->Features), pNode->RowBits, fullRows);
+    return __builtin_popcount(fullRows);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Transposition table
+////////////////////////////////////////////////////////////////////////////////
+static Uint64 botTablePack(Uint32 searchId, float score)
+{
+    Uint32 scoreBits;
+    memcpy(&scoreBits, &score, sizeof(scoreBits));
+    return ((Uint64)searchId << 32) | scoreBits;
+}
+
+// Returns true if the position was already reached in this search with at
+// least this score, otherwise records it
+static bool botTableCheckAndStore(Bot_t* pBot, Uint64 key, float score)
+{
+    BotTableEntry_t* pEntry = &(pBot->pTable[key & ((1u << BOT_TABLE_BITS) - 1)]);
+    const Uint64 KeyXorData = __atomic_load_n(&(pEntry->KeyXorData), __ATOMIC_RELAXED);
+    const Uint64 Data = __atomic_load_n(&(pEntry->Data), __ATOMIC_RELAXED);
+    if ((KeyXorData ^ Data) == key && (Uint32)(Data >> 32) == pBot->SearchId)
+    {
+        float storedScore;
+        const Uint32 ScoreBits = (Uint32)Data;
+        memcpy(&storedScore, &ScoreBits, sizeof(storedScore));
+        if (storedScore >= score)
+        {
+            return true;
+        }
+    }
+
+    const Uint64 NewData = botTablePack(pBot->SearchId, score);
+    __atomic_store_n(&(pEntry->KeyXorData), key ^ NewData, __ATOMIC_RELAXED);
+    __atomic_store_n(&(pEntry->Data), NewData, __ATOMIC_RELAXED);
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Expansion
+////////////////////////////////////////////////////////////////////////////////
+static void botHeapSiftDown(BotNode_t* pHeap, int size, int index)
+{
+    for (;;)
+    {
+        const int Left = 2 * index + 1;
+        const int Right = Left + 1;
+        int smallest = index;
+        if (Left < size && pHeap[Left].Score < pHeap[smallest].Score)
+        {
+            smallest = Left;
+        }
+
+        if (Right < size && pHeap[Right].Score < pHeap[smallest].Score)
+        {
+            smallest = Right;
+        }
+
+        if (smallest == index)
+        {
+            return;
+        }
+
+        const BotNode_t Temp = pHeap[index];
+        pHeap[index] = pHeap[smallest];
+        pHeap[smallest] = Temp;
+        index = smallest;
+    }
+}
+
+static void botWorkerKeepChild(BotWorker_t* pWorker, const BotNode_t* pChild)
+{
+    const int BeamWidth = pWorker->pBot->PassWidth;
+    BotNode_t* pHeap = pWorker->pChildren;
+    if (pWorker->NumChildren < BeamWidth)
+    {
+        // Sift up
+        int index = pWorker->NumChildren++;
+        while (index > 0 && pHeap[(index - 1) / 2].Score > pChild->Score)
+        {
+            pHeap[index] = pHeap[(index - 1) / 2];
+            index = (index - 1) / 2;
+        }
+
+        pHeap[index] = *pChild;
+    }
+    else if (pChild->Score > pHeap[0].Score)
+    {
+        pHeap[0] = *pChild;
+        botHeapSiftDown(pHeap, BeamWidth, 0);
+    }
+}
+
+// Places patternType everywhere it can go on pParent's board
+static void botExpandPattern(
+    BotWorker_t* pWorker,
+    const BotNode_t* pParent,
+    PatternType_t patternType,
+    Uint8 hold,
+    Uint8 nextPiece,
+    bool useHold,
+    const Sim_t* pStartSim)
+{
+    Bot_t* pBot = pWorker->pBot;
+    MoveGen_t* pGen = &(pWorker->MoveGen);
+
+    // At the root the current pattern may already have moved
+    Uint16 numPlacements;
+    if (pStartSim)
+    {
+        numPlacements = MoveGenGenerateForSim(pGen, pStartSim);
+    }
+    else
+    {
+        Sint8 spawnX;
+        Sint8 spawnY;
+        SimGetSpawnPosition(patternType, &spawnX, &spawnY);
+        numPlacements = MoveGenGenerate(pGen, pParent->RowBits, patternType, spawnX, spawnY, 0);
+    }
+
+    for (Uint16 i = 0; i < numPlacements; ++i)
+    {
+        const MoveGenPlacement_t* pPlacement = &(pGen->Placements[i]);
+        if (pPlacement->Flags & MOVEGEN_PLACEMENT_LOCK_OUT)
+        {
+            continue;
+        }
+
+        BotNode_t child;
+        memcpy(child.RowBits, pParent->RowBits, sizeof(child.RowBits));
+        child.Features = pParent->Features;
+        child.Hash = pParent->Hash;
+        child.Hold = hold;
+        child.NextPiece = nextPiece;
+
+        const Pattern* pPattern = g_PatternLUT[patternType][pPlacement->Rotation];
+        const int LinesCleared = botPlacePattern(&child, pPattern, pPlacement->X, pPlacement->Y);
+
+        child.Reward = pParent->Reward + BOT_WEIGHT_LINES * LinesCleared;
+        child.Score = child.Reward + botEvaluate(&(child.Features));
+        if (pBot->IsRoot)
+        {
+            child.FirstMove.X = pPlacement->X;
+            child.FirstMove.Y = pPlacement->Y;
+            child.FirstMove.Rotation = pPlacement->Rotation;
+            child.FirstMove.UseHold = useHold;
+        }
+        else
+        {
+            child.FirstMove = pParent->FirstMove;
+        }
+
+        if (botTableCheckAndStore(pBot, botNodeKey(pBot, &child), child.Score))
+        {
+            continue;
+        }
+
+        botWorkerKeepChild(pWorker, &child);
+    }
+}
+
+static void botExpandNode(BotWorker_t* pWorker, const BotNode_t* pNode)
+{
+    Bot_t* pBot = pWorker->pBot;
+    const Uint8 Index = pNode->NextPiece;
+    if (Index >= pBot->NumPieces)
+    {
+        // Out of known pieces, the node competes as is
+        botWorkerKeepChild(pWorker, pNode);
+        return;
+    }
+
+    const PatternType_t Current = pBot->Pieces[Index];
+    const bool CanHold = !pBot->IsRoot || !pBot->pRootSim->state.hasDoneHold;
+
+    botExpandPattern(
+        pWorker,
+        pNode,
+        Current,
+        pNode->Hold,
+        Index + 1,
+        false,
+        pBot->IsRoot ? pBot->pRootSim : NULL);
+
+    if (!CanHold)
+    {
+        return;
+    }
+
+    if (pNode->Hold != PATTERN_NONE && pNode->Hold != Current)
+    {
+        // Swap with hold
+        botExpandPattern(pWorker, pNode, pNode->Hold, Current, Index + 1, true, NULL);
+    }
+    else if (pNode->Hold == PATTERN_NONE && Index + 1 < pBot->NumPieces)
+    {
+        // Hold the current pattern, play the next one
+        botExpandPattern(pWorker, pNode, pBot->Pieces[Index + 1], Current, Index + 2, true, NULL);
+    }
+}
+
+static bool botIsPastDeadline(Bot_t* pBot)
+{
+    if (pBot->DeadlineMicros == 0)
+    {
+        return false;
+    }
+
+    if (atomic_load_explicit(&(pBot->IsPastDeadline), memory_order_relaxed))
+    {
+        return true;
+    }
+
+    if (botNowMicros() < pBot->DeadlineMicros)
+    {
+        return false;
+    }
+
+    atomic_store_explicit(&(pBot->IsPastDeadline), true, memory_order_relaxed);
+    return true;
+}
+
+static void botWorkerExpand(BotWorker_t* pWorker)
+{
+    Bot_t* pBot = pWorker->pBot;
+    for (;;)
+    {
+        // Checked before claiming a node, so every claimed node gets expanded
+        if (botIsPastDeadline(pBot))
+        {
+            break;
+        }
+
+        const int Index = atomic_fetch_add(&(pBot->NextNode), 1);
+        if (Index >= pBot->BeamSize)
+        {
+            break;
+        }
+
+        botExpandNode(pWorker, &(pBot->pBeam[Index]));
+    }
+}
+
+static void* botWorkerMain(void* pArg)
+{
+    BotWorker_t* pWorker = (BotWorker_t*)pArg;
+    Bot_t* pBot = pWorker->pBot;
+
+    Uint32 seenGeneration = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&(pBot->Lock));
+        while (!pBot->Quit && pBot->Generation == seenGeneration)
+        {
+            pthread_cond_wait(&(pBot->WorkReady), &(pBot->Lock));
+        }
+
+        seenGeneration = pBot->Generation;
+        const bool Quit = pBot->Quit;
+        pthread_mutex_unlock(&(pBot->Lock));
+
+        if (Quit)
+        {
+            return NULL;
+        }
+
+        botWorkerExpand(pWorker);
+
+        pthread_mutex_lock(&(pBot->Lock));
+        if (--pBot->WorkersBusy == 0)
+        {
+            pthread_cond_signal(&(pBot->WorkDone));
+        }
+        pthread_mutex_unlock(&(pBot->Lock));
+    }
+}
+
+// Best first, ties broken on the board so results don't depend on which
+// worker found what
+static int botCompareNodes(const void* pA, const void* pB)
+{
+    const BotNode_t* pNodeA = (const BotNode_t*)pA;
+    const BotNode_t* pNodeB = (const BotNode_t*)pB;
+    if (pNodeA->Score != pNodeB->Score)
+    {
+        return pNodeA->Score > pNodeB->Score ? -1 : 1;
+    }
+
+    if (pNodeA->Hash != pNodeB->Hash)
+    {
+        return pNodeA->Hash < pNodeB->Hash ? -1 : 1;
+    }
+
+    return memcmp(&(pNodeA->FirstMove), &(pNodeB->FirstMove), sizeof(BotMove_t));
+}
+
+// Expands the whole beam by one piece and replaces it with the best children.
+// Returns the new beam size, or -1 if the deadline hit first.
+static int botExpandBeam(Bot_t* pBot)
+{
+    if (!pBot->IsExpanding)
+    {
+        pBot->IsExpanding = true;
+        atomic_store(&(pBot->NextNode), 0);
+        for (int i = 0; i < pBot->NumThreads; ++i)
+        {
+            pBot->pWorkers[i].NumChildren = 0;
+        }
+    }
+
+    atomic_store(&(pBot->IsPastDeadline), false);
+
+    const int NumHelpers = pBot->NumThreads - 1;
+    if (NumHelpers > 0)
+    {
+        pthread_mutex_lock(&(pBot->Lock));
+        pBot->WorkersBusy = NumHelpers;
+        pBot->Generation++;
+        pthread_cond_broadcast(&(pBot->WorkReady));
+        pthread_mutex_unlock(&(pBot->Lock));
+    }
+
+    // The searching thread pitches in as worker 0
+    botWorkerExpand(&(pBot->pWorkers[0]));
+
+    if (NumHelpers > 0)
+    {
+        pthread_mutex_lock(&(pBot->Lock));
+        while (pBot->WorkersBusy > 0)
+        {
+            pthread_cond_wait(&(pBot->WorkDone), &(pBot->Lock));
+        }
+        pthread_mutex_unlock(&(pBot->Lock));
+    }
+
+    if (atomic_load(&(pBot->NextNode)) < pBot->BeamSize)
+    {
+        return -1;
+    }
+
+    pBot->IsExpanding = false;
+
+    int numChildren = 0;
+    for (int i = 0; i < pBot->NumThreads; ++i)
+    {
+        const BotWorker_t* pWorker = &(pBot->pWorkers[i]);
+        memcpy(
+            &(pBot->pNextBeam[numChildren]),
+            pWorker->pChildren,
+            pWorker->NumChildren * sizeof(BotNode_t));
+        numChildren += pWorker->NumChildren;
+    }
+
+    qsort(pBot->pNextBeam, numChildren, sizeof(BotNode_t), botCompareNodes);
+
+    BotNode_t* pSwap = pBot->pBeam;
+    pBot->pBeam = pBot->pNextBeam;
+    pBot->pNextBeam = pSwap;
+    pBot->BeamSize = numChildren < pBot->PassWidth ? numChildren : pBot->PassWidth;
+    return pBot->BeamSize;
+}
+
+// Starts a pass over the root's children with a beam width wide
+static void botBeginPass(Bot_t* pBot, int width)
+{
+    pBot->PassWidth = width;
+    pBot->BeamSize = pBot->NumRootChildren < width ? pBot->NumRootChildren : width;
+    pBot->Depth = 1;
+    memcpy(pBot->pBeam, pBot->pRootChildren, pBot->BeamSize * sizeof(BotNode_t));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////////////////////////
+void BotDestroy(Bot_t* pBot)
+{
+    if (!pBot)
+    {
+        return;
+    }
+
+    if (pBot->pWorkers)
+    {
+        pthread_mutex_lock(&(pBot->Lock));
+        pBot->Quit = true;
+        pthread_cond_broadcast(&(pBot->WorkReady));
+        pthread_mutex_unlock(&(pBot->Lock));
+
+        for (int i = 1; i < pBot->NumThreads; ++i)
+        {
+            pthread_join(pBot->pWorkers[i].Thread, NULL);
+        }
+
+        for (int i = 0; i < pBot->NumThreads; ++i)
+        {
+            free(pBot->pWorkers[i].pChildren);
+        }
+    }
+
+    pthread_mutex_destroy(&(pBot->Lock));
+    pthread_cond_destroy(&(pBot->WorkReady));
+    pthread_cond_destroy(&(pBot->WorkDone));
+    free(pBot->pWorkers);
+    free(pBot->pBeam);
+    free(pBot->pNextBeam);
+    free(pBot->pRootChildren);
+    free(pBot->pTable);
+    free(pBot);
+}
+
+Bot_t* BotCreate(const BotConfig_t* pConfig)
+{
+    Bot_t* pBot = calloc(1, sizeof(Bot_t));
+    if (!pBot)
+    {
+        return NULL;
+    }
+
+    int numThreads = pConfig->NumThreads;
+    if (numThreads <= 0)
+    {
+        numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+#ifdef __EMSCRIPTEN__
+    // No shared memory threads in the browser build
+    numThreads = 1;
+#endif
+
+    pBot->NumThreads = numThreads < 1 ? 1 : (numThreads > BOT_MAX_THREADS ? BOT_MAX_THREADS : numThreads);
+    pBot->BeamWidth = pConfig->BeamWidth > 0 ? pConfig->BeamWidth : BOT_DEFAULT_BEAM_WIDTH;
+    pBot->BudgetMicros = pConfig->BudgetMicros;
+    pBot->FrameMicros = pConfig->FrameMicros;
+
+    // Only a budget can stop widening, without one the search stays fixed
+    pBot->MaxBeamWidth = pBot->BudgetMicros > 0 ?
+        pBot->BeamWidth << BOT_MAX_WIDEN_STEPS :
+        pBot->BeamWidth;
+
+    pthread_mutex_init(&(pBot->Lock), NULL);
+    pthread_cond_init(&(pBot->WorkReady), NULL);
+    pthread_cond_init(&(pBot->WorkDone), NULL);
+
+    const size_t MaxBeamNodes = (size_t)pBot->NumThreads * pBot->MaxBeamWidth;
+    pBot->pWorkers = calloc(pBot->NumThreads, sizeof(BotWorker_t));
+    pBot->pBeam = malloc(MaxBeamNodes * sizeof(BotNode_t));
+    pBot->pNextBeam = malloc(MaxBeamNodes * sizeof(BotNode_t));
+    pBot->pRootChildren = malloc(pBot->MaxBeamWidth * sizeof(BotNode_t));
+    pBot->pTable = calloc((size_t)1 << BOT_TABLE_BITS, sizeof(BotTableEntry_t));
+    if (!pBot->pWorkers || !pBot->pBeam || !pBot->pNextBeam || !pBot->pRootChildren || !pBot->pTable)
+    {
+        fprintf(stderr, "Failed to allocate bot\n");
+        BotDestroy(pBot);
+        return NULL;
+    }
+
+    for (int i = 0; i < pBot->NumThreads; ++i)
+    {
+        BotWorker_t* pWorker = &(pBot->pWorkers[i]);
+        pWorker->pBot = pBot;
+        pWorker->pChildren = malloc(pBot->MaxBeamWidth * sizeof(BotNode_t));
+        if (!pWorker->pChildren)
+        {
+            fprintf(stderr, "Failed to allocate bot worker\n");
+            BotDestroy(pBot);
+            return NULL;
+        }
+    }
+
+    for (int i = 1; i < pBot->NumThreads; ++i)
+    {
+        if (pthread_create(&(pBot->pWorkers[i].Thread), NULL, botWorkerMain, &(pBot->pWorkers[i])) != 0)
+        {
+            // Carry on with however many threads we got
+            fprintf(stderr, "Bot running on %d threads\n", i);
+            pthread_mutex_lock(&(pBot->Lock));
+            pBot->NumThreads = i;
+            pthread_mutex_unlock(&(pBot->Lock));
+            break;
+        }
+    }
+
+    return pBot;
+}
+
+// Starts a search from the sim's current pattern by expanding its
+// placements, which also gives a first best move. Returns false when every
+// placement tops out.
+bool BotSearchBegin(Bot_t* pBot, const Sim_t* pSim)
+{
+    pBot->SearchId++;
+    pBot->pRootSim = pSim;
+    pBot->Pieces[0] = pSim->state.currentPatternType;
+    for (int i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        pBot->Pieces[i + 1] = pSim->state.nextQueue[(pSim->state.nextQueueIndex + i) % NEXT_QUEUE_SIZE];
+    }
+    pBot->NumPieces = BOT_MAX_PIECES;
+
+    BotNode_t* pRoot = &(pBot->pBeam[0]);
+    memcpy(pRoot->RowBits, pSim->state.rowBits, sizeof(pRoot->RowBits));
+    pRoot->Features = pSim->features;
+    pRoot->Reward = 0.0f;
+    pRoot->Score = 0.0f;
+    pRoot->Hold = pSim->state.holdPatternType;
+    pRoot->NextPiece = 0;
+    pRoot->Hash = SimHashBoard(pRoot->RowBits);
+    pBot->BeamSize = 1;
+
+    // Keep as many children as the widest pass will want
+    pBot->IsRoot = true;
+    pBot->IsExpanding = false;
+    pBot->DeadlineMicros = 0;
+    pBot->PassWidth = pBot->MaxBeamWidth;
+    pBot->NumRootChildren = botExpandBeam(pBot);
+    pBot->IsRoot = false;
+    pBot->pRootSim = NULL;
+    memcpy(pBot->pRootChildren, pBot->pBeam, pBot->NumRootChildren * sizeof(BotNode_t));
+
+    pBot->IsDone = pBot->NumRootChildren == 0;
+    if (pBot->IsDone)
+    {
+        return false;
+    }
+
+    pBot->Best = pBot->pRootChildren[0].FirstMove;
+    pBot->BestDepth = 1;
+    botBeginPass(pBot, pBot->BeamWidth);
+    return true;
+}
+
+// Searches until the search is done or deadlineMicros (botNowMicros() time, 0
+// for none) passes. Returns true once there's nothing left to search.
+bool BotSearchContinue(Bot_t* pBot, Uint64 deadlineMicros)
+{
+    pBot->DeadlineMicros = deadlineMicros;
+    while (!pBot->IsDone)
+    {
+        if (pBot->Depth < pBot->NumPieces && pBot->BeamSize > 0)
+        {
+            const int BeamSize = botExpandBeam(pBot);
+            if (BeamSize < 0)
+            {
+                return false;
+            }
+
+            pBot->Depth++;
+
+            // An empty beam means every line tops out from here; keep the
+            // move from the depth before
+            if (BeamSize > 0 && pBot->Depth >= pBot->BestDepth)
+            {
+                pBot->Best = pBot->pBeam[0].FirstMove;
+                pBot->BestDepth = pBot->Depth;
+            }
+        }
+        else if (pBot->PassWidth < pBot->MaxBeamWidth)
+        {
+            pBot->SearchId++;
+            botBeginPass(pBot, pBot->PassWidth * 2);
+        }
+        else
+        {
+            pBot->IsDone = true;
+        }
+    }
+
+    return true;
+}
+
+BotMove_t BotSearchBest(const Bot_t* pBot)
+{
+    return pBot->Best;
+}
+
+// Searches from the sim's current pattern within the bot's budget and returns
+// where it should go. Returns false when every placement tops out.
+bool BotSearch(Bot_t* pBot, const Sim_t* pSim, BotMove_t* pMoveOut)
+{
+    if (!BotSearchBegin(pBot, pSim))
+    {
+        return false;
+    }
+
+    BotSearchContinue(pBot, pBot->BudgetMicros > 0 ? botNowMicros() + pBot->BudgetMicros : 0);
+    *pMoveOut = BotSearchBest(pBot);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Policy: searches once per spawned pattern, then steers it to the chosen
+// placement. With a per-frame limit the search is spread over the frames
+// before gravity would first move the pattern, so thinking never costs a
+// frame or a row.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    Bot_t*         pBot;
+    MoveGen_t      MoveGen;
+    MoveGenSteer_t Steer;
+    Uint64         lastSpawnFrame;
+    Uint64         DeadlineMicros;
+    BotMove_t      Target;
+    bool           HasTarget;
+    bool           IsSearching;
+} BotPolicyState_t;
+
+// Thinking time for the pattern that just spawned, 0 for no limit
+static Uint64 botPolicyPatternBudget(const Bot_t* pBot, const Sim_t* pSim)
+{
+    if (pBot->FrameMicros == 0)
+    {
+        return pBot->BudgetMicros;
+    }
+
+    // The search ends a frame ahead of the next drop so the first move
+    // lands before the pattern falls
+    const Uint32 DropFrames = (Uint32)(FPS / pSim->state.dropSpeed);
+    const Uint32 SinceDrop = pSim->state.currentFrame - pSim->state.lastDropFrame;
+    const Uint32 FramesLeft = DropFrames > SinceDrop + 1 ? DropFrames - SinceDrop - 1 : 1;
+    const Uint64 FramesBudget = (Uint64)FramesLeft * pBot->FrameMicros;
+    if (pBot->BudgetMicros == 0 || FramesBudget < pBot->BudgetMicros)
+    {
+        return FramesBudget;
+    }
+
+    return pBot->BudgetMicros;
+}
+
+static void botPolicyBegin(void* pState, Uint64 seed)
+{
+    (void)seed;
+    BotPolicyState_t* pBotState = (BotPolicyState_t*)pState;
+    pBotState->pBot = BotCreate(&g_BotConfig);
+    pBotState->lastSpawnFrame = (Uint64)-1;
+    pBotState->HasTarget = false;
+    pBotState->IsSearching = false;
+}
+
+static void botPolicyEnd(void* pState)
+{
+    BotPolicyState_t* pBotState = (BotPolicyState_t*)pState;
+    BotDestroy(pBotState->pBot);
+    pBotState->pBot = NULL;
+}
+
+static Uint16 botPolicyNextInputs(void* pState, const Sim_t* pSim)
+{
+    BotPolicyState_t* pBotState = (BotPolicyState_t*)pState;
+    if (pSim->state.isIntro)
+    {
+        return SIM_INPUT_BEGIN;
+    }
+
+    if (pSim->state.isGameOver)
+    {
+        return SIM_INPUT_RETRY;
+    }
+
+    // Patterns spawn before cleared rows collapse, search the board they'll
+    // actually land on. The sim takes no inputs until then anyway.
+    if (!pBotState->pBot || !SimPatternInPlay(pSim) || pSim->state.clearRows != 0)
+    {
+        return SIM_INPUT_NONE;
+    }
+
+    Bot_t* pBot = pBotState->pBot;
+    if (pBotState->lastSpawnFrame != pSim->state.lastSpawnFrame)
+    {
+        pBotState->lastSpawnFrame = pSim->state.lastSpawnFrame;
+        pBotState->HasTarget = BotSearchBegin(pBot, pSim);
+        pBotState->IsSearching = pBotState->HasTarget;
+
+        const Uint64 Budget = botPolicyPatternBudget(pBot, pSim);
+        pBotState->DeadlineMicros = Budget > 0 ? botNowMicros() + Budget : 0;
+    }
+
+    if (pBotState->IsSearching)
+    {
+        Uint64 deadline = pBotState->DeadlineMicros;
+        const Uint64 Now = botNowMicros();
+        if (pBot->FrameMicros > 0 && (deadline == 0 || Now + pBot->FrameMicros < deadline))
+        {
+            deadline = Now + pBot->FrameMicros;
+        }
+
+        // Out of time for this frame but not for the pattern, think on in
+        // the next one
+        const bool IsDone = BotSearchContinue(pBot, deadline);
+        if (!IsDone && (pBotState->DeadlineMicros == 0 || botNowMicros() < pBotState->DeadlineMicros))
+        {
+            return SIM_INPUT_NONE;
+        }
+
+        pBotState->IsSearching = false;
+        pBotState->Target = BotSearchBest(pBot);
+        MoveGenSteerBegin(
+            &(pBotState->Steer),
+            pBotState->Target.X,
+            pBotState->Target.Y,
+            pBotState->Target.Rotation);
+    }
+
+    if (!pBotState->HasTarget)
+    {
+        return SIM_INPUT_UP;
+    }
+
+    if (pBotState->Target.UseHold && !pSim->state.hasDoneHold)
+    {
+        return SIM_INPUT_HOLD;
+    }
+
+    return MoveGenSteerNextInputs(&(pBotState->Steer), &(pBotState->MoveGen), pSim);
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+// Batch board evaluation. Computes surface features for many candidate boards
+// at once by giving each board one 16-bit lane of a GCC vector: lane i of row
+// vector y holds row y of board i, so every bitwise step below works on
+// EVAL_LANES boards together. Vectors are as wide as the target's registers:
+// 16 lanes with AVX2, otherwise 8 for SSE2 or SIMD128 in wasm builds with
+// -msimd128.
+//
+// Compilers without vector extensions, or builds defining
+// LIL_TETRIS_EVAL_SCALAR, evaluate one board at a time with the scalar
+// version, which also serves as the reference.
+
+#include "lil-tetris-sim.c"
+
+#ifdef __AVX2__
+#define EVAL_LANES 16
+#else
+#define EVAL_LANES 8
+#endif
+
+#if defined(__GNUC__) && !defined(LIL_TETRIS_EVAL_SCALAR)
+#define EVAL_VECTORIZED 1
+#endif
+
+typedef struct
+{
+    Uint16 AggregateHeight;
+    Uint16 MaxHeight;
+    Uint16 Holes;
+    Uint16 Bumpiness;
+    Uint16 RowTransitions;    // Filled/empty changes along each row, walls count as filled
+    Uint16 ColumnTransitions; // Same down each column, the floor counts as filled
+    Uint16 Wells;             // Sum of well depths, walls included
+} EvalFeatures_t;
+
+// Row with a filled wall cell on either side: bit 0 and bit GRID_WIDTH + 1
+#define EVAL_WALLED_ROW(Row) (((Row) << 1) | 1 | (1 << (GRID_WIDTH + 1)))
+#define EVAL_TRANSITION_MASK ((1 << (GRID_WIDTH + 1)) - 1)
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar
+////////////////////////////////////////////////////////////////////////////////
+void EvalBoardScalar(const Uint16* pRowBits, EvalFeatures_t* pOut)
+{
+    memset(pOut, 0, sizeof(*pOut));
+
+    Uint8 heights[GRID_WIDTH] = { 0 };
+    Uint16 covered = 0; // Columns with a filled cell at or above this row
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        const Uint16 Row = pRowBits[y];
+        Uint16 newColumns = Row & ~covered;
+        while (newColumns)
+        {
+            heights[__builtin_ctz(newColumns)] = GRID_HEIGHT - y;
+            newColumns &= newColumns - 1;
+        }
+
+        covered |= Row;
+        pOut->Holes += __builtin_popcount(covered & ~Row);
+
+        const Uint16 Walled = EVAL_WALLED_ROW(Row);
+        pOut->RowTransitions += __builtin_popcount((Walled ^ (Walled >> 1)) & EVAL_TRANSITION_MASK);
+
+        const Uint16 Below = y < GRID_HEIGHT - 1 ? pRowBits[y + 1] : SIM_ROW_FULL;
+        pOut->ColumnTransitions += __builtin_popcount(Row ^ Below);
+    }
+
+    for (int x = 0; x < GRID_WIDTH; ++x)
+    {
+        const int Height = heights[x];
+        pOut->AggregateHeight += Height;
+        pOut->MaxHeight = Height > pOut->MaxHeight ? Height : pOut->MaxHeight;
+
+        if (x > 0)
+        {
+            const int Delta = Height - heights[x - 1];
+            pOut->Bumpiness += Delta < 0 ? -Delta : Delta;
+        }
+
+        const int LeftHeight = x > 0 ? heights[x - 1] : GRID_HEIGHT;
+        const int RightHeight = x < (GRID_WIDTH - 1) ? heights[x + 1] : GRID_HEIGHT;
+        const int WallHeight = LeftHeight < RightHeight ? LeftHeight : RightHeight;
+        if (WallHeight > Height)
+        {
+            pOut->Wells += WallHeight - Height;
+        }
+    }
+}
+
+#ifdef EVAL_VECTORIZED
+////////////////////////////////////////////////////////////////////////////////
+// Vectorized
+////////////////////////////////////////////////////////////////////////////////
+typedef Uint16 EvalVec_t __attribute__((vector_size(EVAL_LANES * sizeof(Uint16))));
+typedef Sint16 EvalSignedVec_t __attribute__((vector_size(EVAL_LANES * sizeof(Sint16))));
+
+// Per-lane popcount of 16-bit lanes
+static inline EvalVec_t evalPopcount(EvalVec_t v)
+{
+    v = v - ((v >> 1) & 0x5555);
+    v = (v & 0x3333) + ((v >> 2) & 0x3333);
+    v = (v + (v >> 4)) & 0x0F0F;
+    return (v + (v >> 8)) & 0x001F;
+}
+
+static inline EvalSignedVec_t evalAbs(EvalSignedVec_t v)
+{
+    const EvalSignedVec_t Negative = v >> 15;
+    return (v ^ Negative) - Negative;
+}
+
+static inline EvalSignedVec_t evalMin(EvalSignedVec_t a, EvalSignedVec_t b)
+{
+    const EvalSignedVec_t ALess = a < b;
+    return (a & ALess) | (b & ~ALess);
+}
+
+// Evaluates up to EVAL_LANES boards, lanes past count evaluate an empty board
+static void evalBoardsVector(const Uint16* const* ppRowBits, int count, EvalFeatures_t* pOut)
+{
+    EvalVec_t rows[GRID_HEIGHT];
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        for (int i = 0; i < EVAL_LANES; ++i)
+        {
+            rows[y][i] = i < count ? ppRowBits[i][y] : 0;
+        }
+    }
+
+    const EvalVec_t Zero = { 0 };
+    EvalVec_t covered = Zero;
+    EvalVec_t holes = Zero;
+    EvalVec_t rowTransitions = Zero;
+    EvalVec_t columnTransitions = Zero;
+    EvalSignedVec_t maxHeight = (EvalSignedVec_t)Zero;
+    EvalSignedVec_t heights[GRID_WIDTH];
+    for (int x = 0; x < GRID_WIDTH; ++x)
+    {
+        heights[x] = (EvalSignedVec_t)Zero;
+    }
+
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        const EvalVec_t Row = rows[y];
+        covered |= Row;
+        holes += evalPopcount(covered & ~Row);
+
+        const EvalVec_t Walled = EVAL_WALLED_ROW(Row);
+        rowTransitions += evalPopcount((Walled ^ (Walled >> 1)) & EVAL_TRANSITION_MASK);
+
+        const EvalVec_t Below = y < GRID_HEIGHT - 1 ? rows[y + 1] : Zero + SIM_ROW_FULL;
+        columnTransitions += evalPopcount(Row ^ Below);
+
+        // Comparisons give -1 per true lane
+        maxHeight -= (EvalSignedVec_t)(covered != Zero);
+        for (int x = 0; x < GRID_WIDTH; ++x)
+        {
+            heights[x] += (EvalSignedVec_t)((covered >> x) & 1);
+        }
+    }
+
+    EvalSignedVec_t aggregateHeight = heights[0];
+    EvalSignedVec_t bumpiness = (EvalSignedVec_t)Zero;
+    EvalSignedVec_t wells = (EvalSignedVec_t)Zero;
+    const EvalSignedVec_t WallHeight = (EvalSignedVec_t)Zero + GRID_HEIGHT;
+    for (int x = 0; x < GRID_WIDTH; ++x)
+    {
+        if (x > 0)
+        {
+            aggregateHeight += heights[x];
+            bumpiness += evalAbs(heights[x] - heights[x - 1]);
+        }
+
+        const EvalSignedVec_t Left = x > 0 ? heights[x - 1] : WallHeight;
+        const EvalSignedVec_t Right = x < (GRID_WIDTH - 1) ? heights[x + 1] : WallHeight;
+        const EvalSignedVec_t Depth = evalMin(Left, Right) - heights[x];
+        wells += Depth & (Depth > (EvalSignedVec_t)Zero);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        pOut[i].AggregateHeight = aggregateHeight[i];
+        pOut[i].MaxHeight = maxHeight[i];
+        pOut[i].Holes = holes[i];
+        pOut[i].Bumpiness = bumpiness[i];
+        pOut[i].RowTransitions = rowTransitions[i];
+        pOut[i].ColumnTransitions = columnTransitions[i];
+        pOut[i].Wells = wells[i];
+    }
+}
+#endif // EVAL_VECTORIZED
+
+////////////////////////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////////////////////////
+
+// Fills pOut[i] with the features of the board whose rows are ppRowBits[i]
+void EvalBoards(const Uint16* const* ppRowBits, int count, EvalFeatures_t* pOut)
+{
+#ifdef EVAL_VECTORIZED
+    for (int first = 0; first < count; first += EVAL_LANES)
+    {
+        const int Remaining = count - first;
+        evalBoardsVector(
+            ppRowBits + first,
+            Remaining < EVAL_LANES ? Remaining : EVAL_LANES,
+            pOut + first);
+    }
+#else
+    for (int i = 0; i < count; ++i)
+    {
+        EvalBoardScalar(ppRowBits[i], &pOut[i]);
+    }
+#endif
+}
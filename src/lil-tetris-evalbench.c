@@ -0,0 +1,120 @@
+// Board evaluation benchmark: checks the batch evaluator against the scalar
+// one on a set of random boards, then times both.
+#define LIL_TETRIS_HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lil-tetris-sim.c"
+#include "lil-tetris-eval.c"
+
+#define EVALBENCH_DEFAULT_BOARDS 4096
+#define EVALBENCH_DEFAULT_PASSES 1000
+
+static Uint64 evalBenchNowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// Columns of random height with the odd hole, roughly what a search sees
+static void evalBenchFillBoard(Random_t* pRandom, Uint16* pRowBits)
+{
+    memset(pRowBits, 0, GRID_HEIGHT * sizeof(Uint16));
+    const int Base = RandomRange(pRandom, GRID_HEIGHT / 2);
+    for (int x = 0; x < GRID_WIDTH; ++x)
+    {
+        const int Height = Base + RandomRange(pRandom, 6);
+        for (int y = GRID_HEIGHT - Height; y < GRID_HEIGHT; ++y)
+        {
+            if (RandomRange(pRandom, 8) != 0)
+            {
+                pRowBits[y] |= 1 << x;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int NumBoards = argc > 1 ? atoi(argv[1]) : EVALBENCH_DEFAULT_BOARDS;
+    const int NumPasses = argc > 2 ? atoi(argv[2]) : EVALBENCH_DEFAULT_PASSES;
+    if (NumBoards < 1 || NumPasses < 1)
+    {
+        fprintf(stderr, "Usage: %s [boards] [passes]\n", argv[0]);
+        return -1;
+    }
+
+    Uint16 (*pBoards)[GRID_HEIGHT] = malloc(NumBoards * sizeof(*pBoards));
+    const Uint16** ppRowBits = malloc(NumBoards * sizeof(*ppRowBits));
+    EvalFeatures_t* pScalar = malloc(NumBoards * sizeof(EvalFeatures_t));
+    EvalFeatures_t* pBatch = malloc(NumBoards * sizeof(EvalFeatures_t));
+    if (!pBoards || !ppRowBits || !pScalar || !pBatch)
+    {
+        fprintf(stderr, "Failed to allocate %d boards\n", NumBoards);
+        return -1;
+    }
+
+    Random_t random;
+    RandomSeed(&random, 1);
+    for (int i = 0; i < NumBoards; ++i)
+    {
+        evalBenchFillBoard(&random, pBoards[i]);
+        ppRowBits[i] = pBoards[i];
+    }
+
+    for (int i = 0; i < NumBoards; ++i)
+    {
+        EvalBoardScalar(ppRowBits[i], &pScalar[i]);
+    }
+
+    EvalBoards(ppRowBits, NumBoards, pBatch);
+    if (memcmp(pScalar, pBatch, NumBoards * sizeof(EvalFeatures_t)) != 0)
+    {
+        fprintf(stderr, "Batch evaluation doesn't match scalar evaluation\n");
+        return -1;
+    }
+
+    Uint64 checksum = 0;
+    const Uint64 ScalarBeginNs = evalBenchNowNs();
+    for (int pass = 0; pass < NumPasses; ++pass)
+    {
+        for (int i = 0; i < NumBoards; ++i)
+        {
+            EvalBoardScalar(ppRowBits[i], &pScalar[i]);
+        }
+        checksum += pScalar[pass % NumBoards].Holes;
+    }
+    const Uint64 ScalarNs = evalBenchNowNs() - ScalarBeginNs;
+
+    const Uint64 BatchBeginNs = evalBenchNowNs();
+    for (int pass = 0; pass < NumPasses; ++pass)
+    {
+        EvalBoards(ppRowBits, NumBoards, pBatch);
+        checksum += pBatch[pass % NumBoards].Holes;
+    }
+    const Uint64 BatchNs = evalBenchNowNs() - BatchBeginNs;
+
+    const double NumEvaluations = (double)NumBoards * NumPasses;
+    printf("%d boards x %d passes (checksum %llu)\n",
+        NumBoards, NumPasses, (unsigned long long)checksum);
+    printf("scalar: %.2f ns/board\n", ScalarNs / NumEvaluations);
+    printf("batch:  %.2f ns/board (%d lanes%s)\n",
+        BatchNs / NumEvaluations,
+        EVAL_LANES,
+#ifdef EVAL_VECTORIZED
+        ""
+#else
+        ", scalar fallback"
+#endif
+        );
+
+    free(pBatch);
+    free(pScalar);
+    free(ppRowBits);
+    free(pBoards);
+    return 0;
+}
@@ -0,0 +1,772 @@
+#pragma once
+
+// External bots: runs a bot as a child process and talks to it over its
+// stdin and stdout with one JSON message per line, following the Tetris Bot
+// Protocol (TBP). The game never waits on the bot unless asked to; messages
+// are queued and flushed as the pipe takes them, replies are read as they
+// arrive, and only the newest suggestion is ever acted on.
+//
+// The subset of TBP spoken here:
+//   bot  -> game  {"type":"info","name":...}       Once, at startup
+//   game -> bot   {"type":"rules"}
+//   bot  -> game  {"type":"ready"} or {"type":"error"}
+//   game -> bot   {"type":"start","hold":..,"queue":[..],"board":[..],..}
+//   game -> bot   {"type":"suggest"}
+//   bot  -> game  {"type":"suggestion","moves":[{"location":{..}},..]}
+//   game -> bot   {"type":"stop"}
+//   game -> bot   {"type":"quit"}
+//
+// Every spawned pattern starts the bot over with the whole position, so its
+// idea of the game can't drift from the sim's. queue[0] is the pattern in
+// play and board rows go bottom up, 40 of them, as TBP has it. Locations are
+// TBP's too: the SRS rotation center with y counting up from the bottom row.
+
+#ifndef __EMSCRIPTEN__
+
+#include "lil-tetris-movegen.c"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EXTBOT_BOARD_ROWS 40
+#define EXTBOT_MAX_MESSAGE 4096
+#define EXTBOT_BUFFER_SIZE (4 * EXTBOT_MAX_MESSAGE)
+
+typedef struct
+{
+    const char* pCommand; // Run with /bin/sh -c
+    Uint32      WaitMillis; // How long to wait on each suggestion, 0 to never wait
+} ExtBotConfig_t;
+
+static ExtBotConfig_t g_ExtBotConfig = { NULL, 0 };
+
+typedef enum
+{
+    EXTBOT_STATUS_STARTING,
+    EXTBOT_STATUS_READY,
+    EXTBOT_STATUS_DEAD,
+} ExtBotStatus;
+
+typedef struct
+{
+    PatternType_t PatternType; // Differs from the pattern in play to hold first
+    Sint8         X;
+    Sint8         Y;
+    Uint8         Rotation;
+} ExtBotMove_t;
+
+typedef struct
+{
+    pid_t        Pid;
+    int          ToBotFd;
+    int          FromBotFd;
+    ExtBotStatus Status;
+    bool         IsStarted;      // A start was sent without its stop
+    Uint32       NumRequests;    // Suggests sent
+    Uint32       NumSuggestions; // Suggestions received, answering requests in order
+    bool         HasSuggestion;  // Suggestion answers the latest request
+    ExtBotMove_t Suggestion;
+    size_t       OutSize;
+    size_t       InSize;
+    char         OutBuffer[EXTBOT_BUFFER_SIZE];
+    char         InBuffer[EXTBOT_BUFFER_SIZE];
+} ExtBot_t;
+
+static const char ExtBotPatternLetters[PATTERN_MAX_VALUE] = { '.', 'L', 'J', 'Z', 'S', 'T', 'I', 'O' };
+static const char* ExtBotOrientationNames[4] = { "north", "east", "south", "west" };
+
+// Where TBP puts each pattern's location inside our pattern box, per
+// orientation, with y counting down. O has a single rotation here but four
+// centers in TBP.
+static const Sint8 ExtBotCenters[PATTERN_MAX_VALUE][4][2] = {
+    { { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } }, // PATTERN_NONE
+    { { 1, 1 }, { 1, 1 }, { 1, 1 }, { 1, 1 } }, // PATTERN_L_L
+    { { 1, 1 }, { 1, 1 }, { 1, 1 }, { 1, 1 } }, // PATTERN_L_R
+    { { 1, 1 }, { 1, 1 }, { 1, 1 }, { 1, 1 } }, // PATTERN_Z_L
+    { { 1, 1 }, { 1, 1 }, { 1, 1 }, { 1, 1 } }, // PATTERN_Z_R
+    { { 1, 1 }, { 1, 1 }, { 1, 1 }, { 1, 1 } }, // PATTERN_T_SHAPE
+    { { 1, 0 }, { 2, 1 }, { 2, 2 }, { 1, 2 } }, // PATTERN_LINE_SHAPE
+    { { 0, 1 }, { 0, 0 }, { 1, 0 }, { 1, 1 } }, // PATTERN_SQUARE_SHAPE
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Pipes
+////////////////////////////////////////////////////////////////////////////////
+static void extBotDie(ExtBot_t* pBot, const char* pReason)
+{
+    if (pBot->Status != EXTBOT_STATUS_DEAD)
+    {
+        fprintf(stderr, "External bot %s\n", pReason);
+        pBot->Status = EXTBOT_STATUS_DEAD;
+    }
+}
+
+static void extBotFlush(ExtBot_t* pBot)
+{
+    size_t written = 0;
+    while (written < pBot->OutSize)
+    {
+        const ssize_t Result = write(pBot->ToBotFd, pBot->OutBuffer + written, pBot->OutSize - written);
+        if (Result < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                extBotDie(pBot, "stopped reading");
+                pBot->OutSize = 0;
+                return;
+            }
+
+            if (errno != EINTR)
+            {
+                break;
+            }
+        }
+        else
+        {
+            written += Result;
+        }
+    }
+
+    memmove(pBot->OutBuffer, pBot->OutBuffer + written, pBot->OutSize - written);
+    pBot->OutSize -= written;
+}
+
+// Queues one message, a newline is added. Returns false when the bot is so
+// far behind that it doesn't fit.
+static bool extBotSend(ExtBot_t* pBot, const char* pFormat, ...)
+{
+    char message[EXTBOT_MAX_MESSAGE];
+    va_list args;
+    va_start(args, pFormat);
+    const int Size = vsnprintf(message, sizeof(message) - 1, pFormat, args);
+    va_end(args);
+
+    if (Size < 0 || Size >= (int)sizeof(message) - 1)
+    {
+        fprintf(stderr, "External bot message too long\n");
+        return false;
+    }
+
+    message[Size] = '\n';
+    if (pBot->OutSize + Size + 1 > sizeof(pBot->OutBuffer))
+    {
+        return false;
+    }
+
+    memcpy(pBot->OutBuffer + pBot->OutSize, message, Size + 1);
+    pBot->OutSize += Size + 1;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Just enough JSON to pick fields out of a bot's messages
+////////////////////////////////////////////////////////////////////////////////
+
+// The value of "key" between pBegin and pEnd, or NULL
+static const char* extBotFindValue(const char* pBegin, const char* pEnd, const char* pKey)
+{
+    const size_t KeySize = strlen(pKey);
+    for (const char* pChar = pBegin; pChar + KeySize + 2 <= pEnd; ++pChar)
+    {
+        if (pChar[0] != '"' || strncmp(pChar + 1, pKey, KeySize) != 0 || pChar[KeySize + 1] != '"')
+        {
+            continue;
+        }
+
+        const char* pValue = pChar + KeySize + 2;
+        while (pValue < pEnd && (*pValue == ' ' || *pValue == '\t'))
+        {
+            ++pValue;
+        }
+
+        if (pValue >= pEnd || *pValue != ':')
+        {
+            continue;
+        }
+
+        ++pValue;
+        while (pValue < pEnd && (*pValue == ' ' || *pValue == '\t'))
+        {
+            ++pValue;
+        }
+
+        return pValue < pEnd ? pValue : NULL;
+    }
+
+    return NULL;
+}
+
+static bool extBotFindString(
+    const char* pBegin,
+    const char* pEnd,
+    const char* pKey,
+    char* pOut,
+    size_t outSize)
+{
+    const char* pValue = extBotFindValue(pBegin, pEnd, pKey);
+    if (!pValue || *pValue != '"')
+    {
+        return false;
+    }
+
+    size_t size = 0;
+    for (++pValue; pValue < pEnd && *pValue != '"'; ++pValue)
+    {
+        if (size + 1 < outSize)
+        {
+            pOut[size++] = *pValue;
+        }
+    }
+
+    pOut[size] = '\0';
+    return pValue < pEnd;
+}
+
+static bool extBotFindInt(const char* pBegin, const char* pEnd, const char* pKey, int* pOut)
+{
+    const char* pValue = extBotFindValue(pBegin, pEnd, pKey);
+    if (!pValue)
+    {
+        return false;
+    }
+
+    char* pNumberEnd;
+    const long Value = strtol(pValue, &pNumberEnd, 10);
+    if (pNumberEnd == pValue || pNumberEnd > pEnd)
+    {
+        return false;
+    }
+
+    *pOut = (int)Value;
+    return true;
+}
+
+// The first move of a suggestion, in sim terms
+static bool extBotParseMove(const char* pLine, ExtBotMove_t* pMoveOut)
+{
+    const char* pEnd = pLine + strlen(pLine);
+    const char* pMoves = extBotFindValue(pLine, pEnd, "moves");
+    const char* pLocation = pMoves ? extBotFindValue(pMoves, pEnd, "location") : NULL;
+    if (!pLocation || *pLocation != '{')
+    {
+        return false;
+    }
+
+    const char* pLocationEnd = strchr(pLocation, '}');
+    char type[8];
+    char orientation[8];
+    int x;
+    int y;
+    if (!pLocationEnd ||
+        !extBotFindString(pLocation, pLocationEnd, "type", type, sizeof(type)) ||
+        !extBotFindString(pLocation, pLocationEnd, "orientation", orientation, sizeof(orientation)) ||
+        !extBotFindInt(pLocation, pLocationEnd, "x", &x) ||
+        !extBotFindInt(pLocation, pLocationEnd, "y", &y))
+    {
+        return false;
+    }
+
+    PatternType_t patternType = PATTERN_NONE;
+    for (int i = PATTERN_NONE + 1; i < PATTERN_MAX_VALUE; ++i)
+    {
+        if (type[0] == ExtBotPatternLetters[i] && type[1] == '\0')
+        {
+            patternType = (PatternType_t)i;
+        }
+    }
+
+    int orientationIndex = -1;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (strcmp(orientation, ExtBotOrientationNames[i]) == 0)
+        {
+            orientationIndex = i;
+        }
+    }
+
+    if (patternType == PATTERN_NONE || orientationIndex < 0)
+    {
+        return false;
+    }
+
+    const Sint8* pCenter = ExtBotCenters[patternType][orientationIndex];
+    pMoveOut->PatternType = patternType;
+    pMoveOut->Rotation = orientationIndex % PatternNumRotations[patternType];
+    pMoveOut->X = (Sint8)(x - pCenter[0]);
+    pMoveOut->Y = (Sint8)((GRID_HEIGHT - 1 - y) - pCenter[1]);
+    return true;
+}
+
+static void extBotHandleLine(ExtBot_t* pBot, const char* pLine)
+{
+    const char* pEnd = pLine + strlen(pLine);
+    char type[32];
+    if (!extBotFindString(pLine, pEnd, "type", type, sizeof(type)))
+    {
+        return;
+    }
+
+    if (strcmp(type, "info") == 0)
+    {
+        char name[64];
+        if (extBotFindString(pLine, pEnd, "name", name, sizeof(name)))
+        {
+            fprintf(stderr, "External bot: %s\n", name);
+        }
+    }
+    else if (strcmp(type, "ready") == 0)
+    {
+        if (pBot->Status == EXTBOT_STATUS_STARTING)
+        {
+            pBot->Status = EXTBOT_STATUS_READY;
+        }
+    }
+    else if (strcmp(type, "error") == 0)
+    {
+        extBotDie(pBot, "refused the rules");
+    }
+    else if (strcmp(type, "suggestion") == 0)
+    {
+        // Anything older than the latest request is about a pattern that's
+        // already gone
+        pBot->NumSuggestions++;
+        if (pBot->NumSuggestions == pBot->NumRequests)
+        {
+            pBot->HasSuggestion = extBotParseMove(pLine, &(pBot->Suggestion));
+            if (!pBot->HasSuggestion)
+            {
+                // No moves is how a bot gives up, so it gets no target
+                pBot->Suggestion.PatternType = PATTERN_NONE;
+                pBot->HasSuggestion = true;
+            }
+        }
+    }
+}
+
+static void extBotRead(ExtBot_t* pBot)
+{
+    for (;;)
+    {
+        const ssize_t Result = read(
+            pBot->FromBotFd,
+            pBot->InBuffer + pBot->InSize,
+            sizeof(pBot->InBuffer) - pBot->InSize - 1);
+        if (Result == 0)
+        {
+            extBotDie(pBot, "exited");
+            return;
+        }
+
+        if (Result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                extBotDie(pBot, "can't be read from");
+            }
+
+            return;
+        }
+
+        pBot->InSize += Result;
+        pBot->InBuffer[pBot->InSize] = '\0';
+
+        char* pLine = pBot->InBuffer;
+        char* pNewline;
+        while ((pNewline = strchr(pLine, '\n')) != NULL)
+        {
+            *pNewline = '\0';
+            extBotHandleLine(pBot, pLine);
+            pLine = pNewline + 1;
+        }
+
+        pBot->InSize -= pLine - pBot->InBuffer;
+        memmove(pBot->InBuffer, pLine, pBot->InSize);
+
+        if (pBot->InSize == sizeof(pBot->InBuffer) - 1)
+        {
+            fprintf(stderr, "External bot line too long, dropped\n");
+            pBot->InSize = 0;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////////////////////////
+ExtBot_t* ExtBotCreate(const char* pCommand)
+{
+    ExtBot_t* pBot = calloc(1, sizeof(ExtBot_t));
+    if (!pBot)
+    {
+        fprintf(stderr, "Failed to allocate external bot\n");
+        return NULL;
+    }
+
+    // Close on exec from the start: games on other threads fork their own
+    // bots, and a bot holding our ends would keep us from seeing EOF when
+    // ours exits. dup2() clears the flag on the child's stdin and stdout.
+    int toBot[2];
+    int fromBot[2];
+    if (pipe2(toBot, O_CLOEXEC) != 0)
+    {
+        fprintf(stderr, "Failed to create external bot pipes\n");
+        free(pBot);
+        return NULL;
+    }
+
+    if (pipe2(fromBot, O_CLOEXEC) != 0)
+    {
+        fprintf(stderr, "Failed to create external bot pipes\n");
+        close(toBot[0]);
+        close(toBot[1]);
+        free(pBot);
+        return NULL;
+    }
+
+    // A bot that dies mid write shows up as a write error instead
+    signal(SIGPIPE, SIG_IGN);
+
+    pBot->Pid = fork();
+    if (pBot->Pid == 0)
+    {
+        dup2(toBot[0], STDIN_FILENO);
+        dup2(fromBot[1], STDOUT_FILENO);
+        close(toBot[0]);
+        close(toBot[1]);
+        close(fromBot[0]);
+        close(fromBot[1]);
+        execl("/bin/sh", "sh", "-c", pCommand, (char*)NULL);
+        _exit(127);
+    }
+
+    close(toBot[0]);
+    close(fromBot[1]);
+    if (pBot->Pid < 0)
+    {
+        fprintf(stderr, "Failed to start external bot: %s\n", pCommand);
+        close(toBot[1]);
+        close(fromBot[0]);
+        free(pBot);
+        return NULL;
+    }
+
+    pBot->ToBotFd = toBot[1];
+    pBot->FromBotFd = fromBot[0];
+    fcntl(pBot->ToBotFd, F_SETFL, fcntl(pBot->ToBotFd, F_GETFL) | O_NONBLOCK);
+    fcntl(pBot->FromBotFd, F_SETFL, fcntl(pBot->FromBotFd, F_GETFL) | O_NONBLOCK);
+
+    pBot->Status = EXTBOT_STATUS_STARTING;
+    extBotSend(pBot, "{\"type\":\"rules\"}");
+    extBotFlush(pBot);
+    return pBot;
+}
+
+void ExtBotDestroy(ExtBot_t* pBot)
+{
+    if (!pBot)
+    {
+        return;
+    }
+
+    if (pBot->Status != EXTBOT_STATUS_DEAD)
+    {
+        extBotSend(pBot, "{\"type\":\"quit\"}");
+        extBotFlush(pBot);
+    }
+
+    close(pBot->ToBotFd);
+    close(pBot->FromBotFd);
+    kill(pBot->Pid, SIGTERM);
+    waitpid(pBot->Pid, NULL, 0);
+    free(pBot);
+}
+
+// Sends what's queued and handles whatever the bot has said, without blocking
+void ExtBotPoll(ExtBot_t* pBot)
+{
+    if (pBot->Status == EXTBOT_STATUS_DEAD)
+    {
+        return;
+    }
+
+    extBotFlush(pBot);
+    extBotRead(pBot);
+}
+
+// Polls until the latest request has its suggestion, the bot is ready, or
+// waitMillis pass
+void ExtBotWait(ExtBot_t* pBot, Uint32 waitMillis)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (;;)
+    {
+        ExtBotPoll(pBot);
+
+        const bool IsWaiting =
+            pBot->Status == EXTBOT_STATUS_STARTING ||
+            (pBot->Status == EXTBOT_STATUS_READY && pBot->NumRequests > 0 && !pBot->HasSuggestion);
+        if (!IsWaiting)
+        {
+            return;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const Sint64 ElapsedMillis =
+            (Sint64)(now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (ElapsedMillis >= (Sint64)waitMillis)
+        {
+            return;
+        }
+
+        struct pollfd pollFds[2] = {
+            { pBot->FromBotFd, POLLIN, 0 },
+            { pBot->ToBotFd, pBot->OutSize > 0 ? POLLOUT : 0, 0 },
+        };
+        poll(pollFds, 2, (int)(waitMillis - ElapsedMillis));
+    }
+}
+
+// Starts the bot over on the sim's position and asks where the pattern in
+// play should go. Any suggestion still owed for an older request is dropped
+// when it arrives.
+bool ExtBotRequest(ExtBot_t* pBot, const Sim_t* pSim)
+{
+    if (pBot->Status != EXTBOT_STATUS_READY)
+    {
+        return false;
+    }
+
+    pBot->HasSuggestion = false;
+
+    // Rows still being cleared are left out, the pattern lands on the board
+    // as it'll be once they're gone
+    char board[EXTBOT_MAX_MESSAGE];
+    size_t boardSize = 0;
+    int y = GRID_HEIGHT - 1;
+    for (int row = 0; row < EXTBOT_BOARD_ROWS; ++row, --y)
+    {
+        while (y >= 0 && (pSim->state.clearRows & (1u << y)))
+        {
+            --y;
+        }
+
+        const int Y = y;
+        board[boardSize++] = row == 0 ? '[' : ',';
+        for (int x = 0; x < GRID_WIDTH; ++x)
+        {
+            const bool IsFilled = Y >= 0 && (pSim->state.rowBits[Y] & (1 << x));
+            const PatternType_t CellType = IsFilled ? (PatternType_t)pSim->cellTypes[Y][x] : PATTERN_NONE;
+            boardSize += snprintf(
+                board + boardSize,
+                sizeof(board) - boardSize,
+                !IsFilled ? "%snull" : (CellType == PATTERN_NONE ? "%s\"G\"" : "%s\"%c\""),
+                x == 0 ? "[" : ",",
+                ExtBotPatternLetters[CellType]);
+        }
+
+        board[boardSize++] = ']';
+    }
+
+    board[boardSize++] = ']';
+    board[boardSize] = '\0';
+
+    char queue[4 * (NEXT_QUEUE_SIZE + 1) + 1];
+    size_t queueSize = sprintf(queue, "\"%c\"", ExtBotPatternLetters[pSim->state.currentPatternType]);
+    for (int i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        const Uint8 Type = pSim->state.nextQueue[(pSim->state.nextQueueIndex + i) % NEXT_QUEUE_SIZE];
+        queueSize += sprintf(queue + queueSize, ",\"%c\"", ExtBotPatternLetters[Type]);
+    }
+
+    char hold[8] = "null";
+    if (pSim->state.holdPatternType != PATTERN_NONE)
+    {
+        sprintf(hold, "\"%c\"", ExtBotPatternLetters[pSim->state.holdPatternType]);
+    }
+
+    // Queue all three or none: a stop without its start would leave the bot
+    // idle while IsStarted still says it's thinking.
+    const bool WasStarted = pBot->IsStarted;
+    const size_t OutSize = pBot->OutSize;
+    if ((WasStarted && !extBotSend(pBot, "{\"type\":\"stop\"}")) ||
+        !extBotSend(pBot,
+            "{\"type\":\"start\",\"hold\":%s,\"queue\":[%s],\"combo\":0,\"back_to_back\":false,\"board\":%s}",
+            hold,
+            queue,
+            board) ||
+        !extBotSend(pBot, "{\"type\":\"suggest\"}"))
+    {
+        pBot->OutSize = OutSize;
+        fprintf(stderr, "External bot is too far behind, skipped a pattern\n");
+        return false;
+    }
+
+    pBot->IsStarted = true;
+    pBot->NumRequests++;
+    extBotFlush(pBot);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Policy: asks the bot about every spawned pattern and steers the pattern to
+// the newest suggestion once there is one. Until then gravity has its way,
+// just as it would with a slow human.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    ExtBot_t*      pBot;
+    MoveGen_t      MoveGen;
+    MoveGenSteer_t Steer;
+    Uint64         lastSpawnFrame;
+    ExtBotMove_t   Target;
+    bool           HasTarget;
+    bool           IsResolved; // Target matched to the placement movegen reports
+    bool           IsWaiting;
+} ExtBotPolicyState_t;
+
+// Movegen reports a placement once per set of cells, under whichever
+// rotation reached it first, so S, Z and I targets are looked up by the
+// cells they cover before steering
+static void extBotPolicyResolveTarget(ExtBotPolicyState_t* pExtState, const Sim_t* pSim)
+{
+    ExtBotMove_t* pTarget = &(pExtState->Target);
+    const Pattern* pPattern = g_PatternLUT[pTarget->PatternType][pTarget->Rotation];
+    const Uint64 Footprint = moveGenFootprint(pPattern, pTarget->X, pTarget->Y);
+
+    MoveGen_t* pGen = &(pExtState->MoveGen);
+    const Uint16 NumPlacements = MoveGenGenerateForSim(pGen, pSim);
+    for (Uint16 i = 0; i < NumPlacements; ++i)
+    {
+        if (pGen->Footprints[i] == Footprint)
+        {
+            pTarget->X = pGen->Placements[i].X;
+            pTarget->Y = pGen->Placements[i].Y;
+            pTarget->Rotation = pGen->Placements[i].Rotation;
+            break;
+        }
+    }
+
+    pExtState->IsResolved = true;
+    MoveGenSteerBegin(&(pExtState->Steer), pTarget->X, pTarget->Y, pTarget->Rotation);
+}
+
+static void extBotPolicyBegin(void* pState, Uint64 seed)
+{
+    (void)seed;
+    ExtBotPolicyState_t* pExtState = (ExtBotPolicyState_t*)pState;
+    pExtState->pBot = g_ExtBotConfig.pCommand ? ExtBotCreate(g_ExtBotConfig.pCommand) : NULL;
+    pExtState->lastSpawnFrame = (Uint64)-1;
+    pExtState->HasTarget = false;
+    pExtState->IsWaiting = false;
+
+    if (!g_ExtBotConfig.pCommand)
+    {
+        fprintf(stderr, "The external policy needs a bot command\n");
+    }
+}
+
+static void extBotPolicyEnd(void* pState)
+{
+    ExtBotPolicyState_t* pExtState = (ExtBotPolicyState_t*)pState;
+    ExtBotDestroy(pExtState->pBot);
+    pExtState->pBot = NULL;
+}
+
+static Uint16 extBotPolicyNextInputs(void* pState, const Sim_t* pSim)
+{
+    ExtBotPolicyState_t* pExtState = (ExtBotPolicyState_t*)pState;
+    ExtBot_t* pBot = pExtState->pBot;
+    if (!pBot || pBot->Status == EXTBOT_STATUS_DEAD)
+    {
+        // Play on without it rather than stall
+        return pSim->state.isIntro ? SIM_INPUT_BEGIN : (pSim->state.isGameOver ? SIM_INPUT_RETRY : SIM_INPUT_UP);
+    }
+
+    if (g_ExtBotConfig.WaitMillis > 0 && (pBot->Status == EXTBOT_STATUS_STARTING || pExtState->IsWaiting))
+    {
+        ExtBotWait(pBot, g_ExtBotConfig.WaitMillis);
+    }
+    else
+    {
+        ExtBotPoll(pBot);
+    }
+
+    if (pSim->state.isIntro)
+    {
+        return pBot->Status == EXTBOT_STATUS_STARTING ? SIM_INPUT_NONE : SIM_INPUT_BEGIN;
+    }
+
+    if (pSim->state.isGameOver)
+    {
+        return SIM_INPUT_RETRY;
+    }
+
+    if (!SimPatternInPlay(pSim))
+    {
+        return SIM_INPUT_NONE;
+    }
+
+    if (pExtState->lastSpawnFrame != pSim->state.lastSpawnFrame)
+    {
+        pExtState->lastSpawnFrame = pSim->state.lastSpawnFrame;
+        pExtState->HasTarget = false;
+        pExtState->IsWaiting = ExtBotRequest(pBot, pSim);
+        if (pExtState->IsWaiting && g_ExtBotConfig.WaitMillis > 0)
+        {
+            ExtBotWait(pBot, g_ExtBotConfig.WaitMillis);
+        }
+    }
+
+    if (pExtState->IsWaiting)
+    {
+        if (!pBot->HasSuggestion)
+        {
+            return SIM_INPUT_NONE;
+        }
+
+        pExtState->IsWaiting = false;
+        pExtState->Target = pBot->Suggestion;
+        pExtState->HasTarget = pExtState->Target.PatternType != PATTERN_NONE;
+        pExtState->IsResolved = false;
+    }
+
+    if (!pExtState->HasTarget)
+    {
+        return SIM_INPUT_UP;
+    }
+
+    // The sim takes no inputs until cleared rows collapse
+    if (pSim->state.clearRows != 0)
+    {
+        return SIM_INPUT_NONE;
+    }
+
+    if (pExtState->Target.PatternType != pSim->state.currentPatternType && !pSim->state.hasDoneHold)
+    {
+        return SIM_INPUT_HOLD;
+    }
+
+    if (!pExtState->IsResolved)
+    {
+        extBotPolicyResolveTarget(pExtState, pSim);
+    }
+
+    return MoveGenSteerNextInputs(&(pExtState->Steer), &(pExtState->MoveGen), pSim);
+}
+
+#endif // __EMSCRIPTEN__
@@ -0,0 +1,444 @@
+#pragma once
+
+// Finesse: the fewest key presses that lock a pattern in a given spot.
+// Presses are InputEvents. Tapping LEFT or RIGHT shifts one column; holding
+// one autorepeats (INPUT_REPEAT_DELAY_FRAMES, then every
+// INPUT_REPEAT_INTERVAL_FRAMES) and counts as a single press that carries
+// the pattern as far as it will go. DOWN works the same way for soft drops,
+// and every sequence ends with the UP hard drop. Gravity is ignored, as in
+// the move generator.
+//
+// Placements a pattern drops straight into while the spawn rows are clear
+// come out of a table built once on an empty board, indexed by pattern,
+// rotation and column. Everything else (tucks, spins, stacks reaching the
+// spawn rows) falls back to a breadth first search over the same presses on
+// the real board.
+//
+// Placements are compared by the cells they cover, so S, Z and I patterns
+// get whichever of their two matching rotations is cheaper.
+
+#include "lil-tetris-sim.c"
+#include "lil-tetris-movegen.c"
+#include "lil-tetris-input.c"
+
+#define FINESSE_MAX_INPUTS 16
+#define FINESSE_TABLE_COLUMNS (GRID_WIDTH + MOVEGEN_X_OFFSET)
+
+// Rows a table sequence can touch: a pattern box at its spawn row, kicked
+// down by up to two rows
+#define FINESSE_OPEN_ROWS 4
+
+// Set on an input that's held rather than tapped
+#define FINESSE_INPUT_HELD 0x80
+
+typedef struct
+{
+    Uint8 NumInputs; // Including the hard drop, 0 if the placement can't be reached
+    Uint8 Inputs[FINESSE_MAX_INPUTS]; // InputEvent, | FINESSE_INPUT_HELD
+} FinesseSequence_t;
+
+typedef struct
+{
+    Sint8  X;
+    Sint8  Y;
+    Uint8  Rotation;
+    Uint8  Input; // What reached this node from its parent
+    Uint16 Parent;
+    Uint8  Depth;
+} FinesseNode_t;
+
+typedef struct
+{
+    Uint16        Visited[4][MOVEGEN_ROWS];
+    Uint16        NumNodes;
+    FinesseNode_t Nodes[MOVEGEN_MAX_NODES];
+} FinesseSearch_t;
+
+static FinesseSequence_t g_FinesseTable[PATTERN_MAX_VALUE][4][FINESSE_TABLE_COLUMNS];
+
+static void finesseVisit(
+    FinesseSearch_t* pSearch,
+    Sint8 x,
+    Sint8 y,
+    Uint8 rotation,
+    Uint8 input,
+    Uint16 parent)
+{
+    const int Row = y + MOVEGEN_Y_OFFSET;
+    if (Row < 0 || Row >= MOVEGEN_ROWS)
+    {
+        return;
+    }
+
+    const Uint16 Bit = 1 << (x + MOVEGEN_X_OFFSET);
+    if (pSearch->Visited[rotation][Row] & Bit)
+    {
+        return;
+    }
+
+    pSearch->Visited[rotation][Row] |= Bit;
+
+    FinesseNode_t* pNode = &(pSearch->Nodes[pSearch->NumNodes++]);
+    pNode->X = x;
+    pNode->Y = y;
+    pNode->Rotation = rotation;
+    pNode->Input = input;
+    pNode->Parent = parent;
+    pNode->Depth = pSearch->NumNodes > 1 ? pSearch->Nodes[parent].Depth + 1 : 0;
+}
+
+// Where the pattern at (x, y) lands when dropped
+static Sint8 finesseDropY(const Uint16* pRowBits, const Pattern* pPattern, Sint8 x, Sint8 y)
+{
+    while (!SimBoardCollides(pRowBits, pPattern, x, y + 1))
+    {
+        ++y;
+    }
+
+    return y;
+}
+
+// How far the pattern at (x, y) slides in direction before it's blocked
+static Sint8 finesseSlideX(const Uint16* pRowBits, const Pattern* pPattern, Sint8 x, Sint8 y, Sint8 direction)
+{
+    while (!SimBoardCollides(pRowBits, pPattern, x + direction, y))
+    {
+        x += direction;
+    }
+
+    return x;
+}
+
+static void finesseVisitRotation(
+    FinesseSearch_t* pSearch,
+    const Uint16* pRowBits,
+    PatternType_t patternType,
+    const FinesseNode_t* pNode,
+    Uint16 parent,
+    WallKickRotateDirection direction)
+{
+    const int NumRotations = PatternNumRotations[patternType];
+    const Uint8 Rotation = direction == WALLKICK_DIRECTION_RIGHT ?
+        (pNode->Rotation + 1) % NumRotations :
+        (pNode->Rotation == 0 ? NumRotations - 1 : pNode->Rotation - 1);
+
+    WallKickVector2 kick;
+    if (SimBoardResolveWallKick(
+            pRowBits,
+            patternType,
+            direction,
+            g_PatternLUT[patternType][Rotation],
+            Rotation,
+            pNode->X,
+            pNode->Y,
+            &kick))
+    {
+        finesseVisit(
+            pSearch,
+            pNode->X + kick.X,
+            pNode->Y + kick.Y,
+            Rotation,
+            direction == WALLKICK_DIRECTION_RIGHT ? INPUTEVENT_ROTATERIGHT : INPUTEVENT_ROTATELEFT,
+            parent);
+    }
+}
+
+// Breadth first over presses from the spawn position until a hard drop
+// covers targetFootprint (see moveGenFootprint). Taps are tried before
+// rotations, and both before held inputs, so ties go to the quicker
+// sequence.
+static bool finesseSearch(
+    FinesseSearch_t* pSearch,
+    const Uint16* pRowBits,
+    PatternType_t patternType,
+    Uint64 targetFootprint,
+    FinesseSequence_t* pOut)
+{
+    memset(pSearch->Visited, 0, sizeof(pSearch->Visited));
+    pSearch->NumNodes = 0;
+    pOut->NumInputs = 0;
+
+    Sint8 spawnX;
+    Sint8 spawnY;
+    SimGetSpawnPosition(patternType, &spawnX, &spawnY);
+
+    Pattern** ppRotations = g_PatternLUT[patternType];
+    if (SimBoardCollides(pRowBits, ppRotations[0], spawnX, spawnY))
+    {
+        return false;
+    }
+
+    finesseVisit(pSearch, spawnX, spawnY, 0, INPUTEVENT_MAX, 0);
+    for (Uint16 head = 0; head < pSearch->NumNodes; ++head)
+    {
+        const FinesseNode_t Node = pSearch->Nodes[head];
+        const Pattern* pPattern = ppRotations[Node.Rotation];
+        if (Node.Depth + 1 > FINESSE_MAX_INPUTS)
+        {
+            break;
+        }
+
+        const Sint8 LandingY = finesseDropY(pRowBits, pPattern, Node.X, Node.Y);
+        if (moveGenFootprint(pPattern, Node.X, LandingY) == targetFootprint)
+        {
+            pOut->NumInputs = Node.Depth + 1;
+            pOut->Inputs[Node.Depth] = INPUTEVENT_UP;
+            for (Uint16 index = head; index != 0; index = pSearch->Nodes[index].Parent)
+            {
+                const FinesseNode_t* pStep = &(pSearch->Nodes[index]);
+                pOut->Inputs[pStep->Depth - 1] = pStep->Input;
+            }
+
+            return true;
+        }
+
+        if (!SimBoardCollides(pRowBits, pPattern, Node.X - 1, Node.Y))
+        {
+            finesseVisit(pSearch, Node.X - 1, Node.Y, Node.Rotation, INPUTEVENT_LEFT, head);
+        }
+
+        if (!SimBoardCollides(pRowBits, pPattern, Node.X + 1, Node.Y))
+        {
+            finesseVisit(pSearch, Node.X + 1, Node.Y, Node.Rotation, INPUTEVENT_RIGHT, head);
+        }
+
+        if (LandingY > Node.Y)
+        {
+            finesseVisit(pSearch, Node.X, Node.Y + 1, Node.Rotation, INPUTEVENT_DOWN, head);
+        }
+
+        if (PatternNumRotations[patternType] > 1)
+        {
+            finesseVisitRotation(pSearch, pRowBits, patternType, &Node, head, WALLKICK_DIRECTION_RIGHT);
+            finesseVisitRotation(pSearch, pRowBits, patternType, &Node, head, WALLKICK_DIRECTION_LEFT);
+        }
+
+        // Held shifts only earn their keep past a tap
+        const Sint8 LeftX = finesseSlideX(pRowBits, pPattern, Node.X, Node.Y, -1);
+        if (LeftX < Node.X - 1)
+        {
+            finesseVisit(pSearch, LeftX, Node.Y, Node.Rotation, INPUTEVENT_LEFT | FINESSE_INPUT_HELD, head);
+        }
+
+        const Sint8 RightX = finesseSlideX(pRowBits, pPattern, Node.X, Node.Y, 1);
+        if (RightX > Node.X + 1)
+        {
+            finesseVisit(pSearch, RightX, Node.Y, Node.Rotation, INPUTEVENT_RIGHT | FINESSE_INPUT_HELD, head);
+        }
+
+        if (LandingY > Node.Y + 1)
+        {
+            finesseVisit(pSearch, Node.X, LandingY, Node.Rotation, INPUTEVENT_DOWN | FINESSE_INPUT_HELD, head);
+        }
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////////////////////////
+
+// Builds the empty board table. Call once before any lookups, after
+// SimInitializeTables().
+void FinesseInitialize()
+{
+    static FinesseSearch_t search;
+    const Uint16 EmptyRows[GRID_HEIGHT] = { 0 };
+    for (int type = PATTERN_NONE + 1; type < PATTERN_MAX_VALUE; ++type)
+    {
+        for (int rotation = 0; rotation < PatternNumRotations[type]; ++rotation)
+        {
+            const Pattern* pPattern = g_PatternLUT[type][rotation];
+            for (int column = 0; column < FINESSE_TABLE_COLUMNS; ++column)
+            {
+                FinesseSequence_t* pEntry = &(g_FinesseTable[type][rotation][column]);
+                pEntry->NumInputs = 0;
+
+                const Sint8 X = column - MOVEGEN_X_OFFSET;
+                if (SimBoardCollides(EmptyRows, pPattern, X, 0))
+                {
+                    continue;
+                }
+
+                const Sint8 LandingY = finesseDropY(EmptyRows, pPattern, X, 0);
+                finesseSearch(
+                    &search,
+                    EmptyRows,
+                    (PatternType_t)type,
+                    moveGenFootprint(pPattern, X, LandingY),
+                    pEntry);
+            }
+        }
+    }
+}
+
+// Cheapest way to drop patternType into column x (its box's left edge) with
+// the given rotation on an empty board, or NULL if it doesn't fit there
+const FinesseSequence_t* FinesseLookup(PatternType_t patternType, Uint8 rotation, Sint8 x)
+{
+    const int Column = x + MOVEGEN_X_OFFSET;
+    if (patternType == PATTERN_NONE ||
+        rotation >= PatternNumRotations[patternType] ||
+        Column < 0 || Column >= FINESSE_TABLE_COLUMNS)
+    {
+        return NULL;
+    }
+
+    const FinesseSequence_t* pEntry = &(g_FinesseTable[patternType][rotation][Column]);
+    return pEntry->NumInputs > 0 ? pEntry : NULL;
+}
+
+// Cheapest way to lock patternType at (x, y, rotation) on the board, from
+// the table when the pattern drops straight there and by search otherwise.
+// Returns false if the placement can't be reached.
+bool FinesseFind(
+    FinesseSearch_t* pSearch,
+    const Uint16* pRowBits,
+    PatternType_t patternType,
+    Sint8 x,
+    Sint8 y,
+    Uint8 rotation,
+    FinesseSequence_t* pOut)
+{
+    const Pattern* pPattern = g_PatternLUT[patternType][rotation];
+
+    bool isSpawnAreaOpen = true;
+    for (int row = 0; row < FINESSE_OPEN_ROWS; ++row)
+    {
+        isSpawnAreaOpen = isSpawnAreaOpen && pRowBits[row] == 0;
+    }
+
+    if (isSpawnAreaOpen)
+    {
+        Sint8 spawnX;
+        Sint8 spawnY;
+        SimGetSpawnPosition(patternType, &spawnX, &spawnY);
+
+        const FinesseSequence_t* pEntry = FinesseLookup(patternType, rotation, x);
+        if (pEntry && finesseDropY(pRowBits, pPattern, x, spawnY) == y)
+        {
+            *pOut = *pEntry;
+            return true;
+        }
+    }
+
+    return finesseSearch(pSearch, pRowBits, patternType, moveGenFootprint(pPattern, x, y), pOut);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tracker: counts the presses behind each placement of a game being played,
+// from the sim inputs of every frame, and adds up how many more there were
+// than needed.
+//
+// Sim inputs already have autorepeat applied, so a shift that comes exactly
+// on the repeat schedule after the last one is taken to be the key still
+// held.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    FinesseSearch_t Search;
+    Uint16          RowBits[GRID_HEIGHT]; // Board before this frame's step
+    bool            HasShifted[2];        // Left, right
+    Uint32          LastShiftFrame[2];
+    Uint32          NumShiftRepeats[2];
+    Uint32          NumInputs;            // Presses on the pattern in play
+    Uint32          NumPlacements;
+    Uint32          NumFaults;            // Presses over the minimum, this game
+} FinesseTracker_t;
+
+void FinesseTrackerReset(FinesseTracker_t* pTracker)
+{
+    memset(pTracker->HasShifted, 0, sizeof(pTracker->HasShifted));
+    memset(pTracker->LastShiftFrame, 0, sizeof(pTracker->LastShiftFrame));
+    memset(pTracker->NumShiftRepeats, 0, sizeof(pTracker->NumShiftRepeats));
+    pTracker->NumInputs = 0;
+    pTracker->NumPlacements = 0;
+    pTracker->NumFaults = 0;
+}
+
+static void finesseTrackShift(FinesseTracker_t* pTracker, int direction, Uint32 frame)
+{
+    const Uint32 SinceLast = frame - pTracker->LastShiftFrame[direction];
+    const bool IsRepeat = pTracker->HasShifted[direction] &&
+        (pTracker->NumShiftRepeats[direction] == 0 ?
+            SinceLast == INPUT_REPEAT_DELAY_FRAMES :
+            SinceLast == INPUT_REPEAT_INTERVAL_FRAMES);
+
+    if (IsRepeat)
+    {
+        pTracker->NumShiftRepeats[direction]++;
+    }
+    else
+    {
+        pTracker->NumShiftRepeats[direction] = 0;
+        pTracker->NumInputs++;
+    }
+
+    pTracker->HasShifted[direction] = true;
+    pTracker->LastShiftFrame[direction] = frame;
+}
+
+// Call with the inputs about to be passed to SimStep
+void FinesseTrackerBeforeStep(FinesseTracker_t* pTracker, const Sim_t* pSim, Uint16 inputs)
+{
+    memcpy(pTracker->RowBits, pSim->state.rowBits, sizeof(pTracker->RowBits));
+    if (!SimPatternInPlay(pSim))
+    {
+        return;
+    }
+
+    const Uint32 Frame = pSim->state.currentFrame;
+    if (inputs & SIM_INPUT_LEFT)
+    {
+        finesseTrackShift(pTracker, 0, Frame);
+    }
+
+    if (inputs & SIM_INPUT_RIGHT)
+    {
+        finesseTrackShift(pTracker, 1, Frame);
+    }
+
+    const Uint16 PressInputs = SIM_INPUT_ROTATE_RIGHT | SIM_INPUT_ROTATE_LEFT | SIM_INPUT_DOWN_PRESSED | SIM_INPUT_UP;
+    pTracker->NumInputs += __builtin_popcount(inputs & PressInputs);
+
+    // Holding starts over with another pattern
+    if ((inputs & SIM_INPUT_HOLD) && !pSim->state.hasDoneHold)
+    {
+        pTracker->NumInputs = 0;
+    }
+}
+
+// Call after SimStep, before the sim's events are cleared
+void FinesseTrackerAfterStep(FinesseTracker_t* pTracker, const Sim_t* pSim)
+{
+    for (int i = 0; i < pSim->numEvents; ++i)
+    {
+        const SimEvent_t* pEvent = &(pSim->events[i]);
+        if (pEvent->Type == SIM_EVENT_RETRY)
+        {
+            FinesseTrackerReset(pTracker);
+        }
+        else if (pEvent->Type == SIM_EVENT_COMMIT)
+        {
+            FinesseSequence_t best;
+            if (FinesseFind(
+                    &(pTracker->Search),
+                    pTracker->RowBits,
+                    pEvent->PatternType,
+                    pEvent->X,
+                    pEvent->Y,
+                    pEvent->Rotation,
+                    &best))
+            {
+                pTracker->NumPlacements++;
+                if (pTracker->NumInputs > best.NumInputs)
+                {
+                    pTracker->NumFaults += pTracker->NumInputs - best.NumInputs;
+                }
+            }
+
+            pTracker->NumInputs = 0;
+        }
+    }
+}
@@ -1,4 +1,7 @@
-#include <SDL2/SDL.h>
+#pragma once
+
+#include "lil-tetris-types.c"
+
 #include <stdbool.h>
 #include <assert.h>
 
@@ -20,6 +23,10 @@ typedef enum
     INPUTEVENT_MAX
 } InputEvent;
 
+// Everything below reads SDL's keyboard state; headless tools only get the
+// events and repeat timing above
+#ifndef LIL_TETRIS_HEADLESS
+
 #define MAX_INPUT_SCANCODES 3
 typedef struct
 {
@@ -138,3 +145,5 @@ void InputUpdateContext(InputContext* pContext)
     UPDATE_KEYSTATE(pContext, INPUTEVENT_PAUSE, pKeys);
     UPDATE_KEYSTATE(pContext, INPUTEVENT_BEGINGAME, pKeys);
 }
+
+#endif // LIL_TETRIS_HEADLESS
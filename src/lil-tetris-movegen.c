@@ -0,0 +1,466 @@
+#pragma once
+
+// Placement enumeration. Flood fills every (x, y, rotation) a pattern can
+// reach from a start position using the same moves the sim allows: single
+// column shifts, soft drops and rotations with SRS wall kicks. Every position
+// the pattern can lock in is reported once, along with the shortest input
+// path to it, so tucks, spins and kicks under overhangs are all found.
+//
+// Gravity and lock delay aren't modelled; paths assume the pattern only moves
+// down when asked to. Everything lives in the caller's MoveGen_t, nothing is
+// allocated per call.
+
+#include "lil-tetris-sim.c"
+
+// Pattern boxes hang up to 3 columns past the left wall and start above the
+// grid, so positions are offset into the visited bitset
+#define MOVEGEN_X_OFFSET 3
+#define MOVEGEN_Y_OFFSET 8
+#define MOVEGEN_ROWS (GRID_HEIGHT + MOVEGEN_Y_OFFSET)
+#define MOVEGEN_MAX_NODES (4 * MOVEGEN_ROWS * 16)
+#define MOVEGEN_MAX_PLACEMENTS 256
+#define MOVEGEN_MAX_PATH 64
+
+typedef enum
+{
+    MOVEGEN_ACTION_NONE,
+    MOVEGEN_ACTION_LEFT,
+    MOVEGEN_ACTION_RIGHT,
+    MOVEGEN_ACTION_ROTATE_RIGHT,
+    MOVEGEN_ACTION_ROTATE_LEFT,
+    MOVEGEN_ACTION_DOWN,
+    MOVEGEN_ACTION_DROP,
+    MOVEGEN_ACTION_COUNT
+} MoveGenAction;
+
+// The sim input that performs each action for one frame
+static const Uint16 MoveGenActionInputs[MOVEGEN_ACTION_COUNT] = {
+    SIM_INPUT_NONE,
+    SIM_INPUT_LEFT,
+    SIM_INPUT_RIGHT,
+    SIM_INPUT_ROTATE_RIGHT,
+    SIM_INPUT_ROTATE_LEFT,
+    SIM_INPUT_DOWN,
+    SIM_INPUT_UP,
+};
+
+enum
+{
+    // Locked straight after a rotation, unable to move left, right or up
+    MOVEGEN_PLACEMENT_SPIN     = 1 << 0,
+
+    // Some cells would lock above the grid, which ends the game
+    MOVEGEN_PLACEMENT_LOCK_OUT = 1 << 1,
+};
+
+typedef struct
+{
+    Sint8  X;
+    Sint8  Y;
+    Uint8  Rotation;
+    Uint8  Action; // MoveGenAction that reached this node from its parent
+    Uint16 Parent;
+} MoveGenNode_t;
+
+typedef struct
+{
+    Sint8  X;
+    Sint8  Y;
+    Uint8  Rotation;
+    Uint8  Flags;
+    Uint16 Node; // Hard dropping from this node locks the pattern here
+} MoveGenPlacement_t;
+
+typedef struct
+{
+    PatternType_t      PatternType;
+    Uint16             Visited[4][MOVEGEN_ROWS];
+    Uint16             Placed[4][MOVEGEN_ROWS];
+    Uint16             NumNodes;
+    Uint16             NumPlacements;
+    bool               IsTruncated; // Placements didn't all fit
+    MoveGenNode_t      Nodes[MOVEGEN_MAX_NODES];
+    MoveGenPlacement_t Placements[MOVEGEN_MAX_PLACEMENTS];
+    Uint64             Footprints[MOVEGEN_MAX_PLACEMENTS];
+} MoveGen_t;
+
+static void moveGenVisit(
+    MoveGen_t* pGen,
+    Sint8 x,
+    Sint8 y,
+    Uint8 rotation,
+    MoveGenAction action,
+    Uint16 parent)
+{
+    const int Row = y + MOVEGEN_Y_OFFSET;
+    if (Row < 0 || Row >= MOVEGEN_ROWS)
+    {
+        return;
+    }
+
+    const Uint16 Bit = 1 << (x + MOVEGEN_X_OFFSET);
+    if (pGen->Visited[rotation][Row] & Bit)
+    {
+        return;
+    }
+
+    pGen->Visited[rotation][Row] |= Bit;
+
+    MoveGenNode_t* pNode = &(pGen->Nodes[pGen->NumNodes++]);
+    pNode->X = x;
+    pNode->Y = y;
+    pNode->Rotation = rotation;
+    pNode->Action = action;
+    pNode->Parent = parent;
+}
+
+// Identifies the cells a locked pattern covers, so rotations that cover the
+// same cells (S, Z and I have two each) are only reported once
+static Uint64 moveGenFootprint(const Pattern* pPattern, Sint8 x, Sint8 y)
+{
+    Uint64 footprint = (Uint64)(Uint8)(y + MOVEGEN_Y_OFFSET) << 56;
+    int shift = 0;
+    for (Sint8 row = 0; row <= pPattern->maxRow; ++row)
+    {
+        const Uint16 RowMask = x >= 0 ?
+            (Uint16)(pPattern->rowMasks[row] << x) :
+            (Uint16)(pPattern->rowMasks[row] >> -x);
+        if (RowMask == 0 && shift == 0)
+        {
+            // Leading empty rows, fold them into the position
+            footprint += (Uint64)1 << 56;
+            continue;
+        }
+
+        footprint |= (Uint64)RowMask << shift;
+        shift += GRID_WIDTH;
+    }
+
+    return footprint;
+}
+
+static void moveGenAddPlacement(
+    MoveGen_t* pGen,
+    const Uint16* pRowBits,
+    Uint16 node,
+    Sint8 y)
+{
+    const MoveGenNode_t* pNode = &(pGen->Nodes[node]);
+    const int Row = y + MOVEGEN_Y_OFFSET;
+    const Uint16 Bit = 1 << (pNode->X + MOVEGEN_X_OFFSET);
+    if (pGen->Placed[pNode->Rotation][Row] & Bit)
+    {
+        return;
+    }
+
+    pGen->Placed[pNode->Rotation][Row] |= Bit;
+
+    const Pattern* pPattern = g_PatternLUT[pGen->PatternType][pNode->Rotation];
+    const Uint64 Footprint = moveGenFootprint(pPattern, pNode->X, y);
+    for (Uint16 i = 0; i < pGen->NumPlacements; ++i)
+    {
+        if (pGen->Footprints[i] == Footprint)
+        {
+            return;
+        }
+    }
+
+    if (pGen->NumPlacements >= MOVEGEN_MAX_PLACEMENTS)
+    {
+        pGen->IsTruncated = true;
+        return;
+    }
+
+    Uint8 flags = 0;
+    const bool Rotated =
+        pNode->Action == MOVEGEN_ACTION_ROTATE_RIGHT ||
+        pNode->Action == MOVEGEN_ACTION_ROTATE_LEFT;
+    if (Rotated && y == pNode->Y &&
+        SimBoardCollides(pRowBits, pPattern, pNode->X - 1, y) &&
+        SimBoardCollides(pRowBits, pPattern, pNode->X + 1, y) &&
+        SimBoardCollides(pRowBits, pPattern, pNode->X, y - 1))
+    {
+        flags |= MOVEGEN_PLACEMENT_SPIN;
+    }
+
+    Sint8 topRow = 0;
+    while (pPattern->rowMasks[topRow] == 0)
+    {
+        ++topRow;
+    }
+
+    if (y + topRow < 0)
+    {
+        flags |= MOVEGEN_PLACEMENT_LOCK_OUT;
+    }
+
+    pGen->Footprints[pGen->NumPlacements] = Footprint;
+    MoveGenPlacement_t* pPlacement = &(pGen->Placements[pGen->NumPlacements++]);
+    pPlacement->X = pNode->X;
+    pPlacement->Y = y;
+    pPlacement->Rotation = pNode->Rotation;
+    pPlacement->Flags = flags;
+    pPlacement->Node = node;
+}
+
+// Fills pGen->Placements with every position patternType can lock in when
+// starting from (gridX, gridY, rotation) on the given board, and returns how
+// many there are. Nodes are expanded breadth first, so the first path found
+// to each placement is also a shortest one. IsTruncated is set if there were
+// more than MOVEGEN_MAX_PLACEMENTS and the rest were dropped.
+Uint16
+MoveGenGenerate(
+    MoveGen_t* pGen,
+    const Uint16* pRowBits,
+    PatternType_t patternType,
+    Sint8 gridX,
+    Sint8 gridY,
+    Uint8 rotation)
+{
+    memset(pGen->Visited, 0, sizeof(pGen->Visited));
+    memset(pGen->Placed, 0, sizeof(pGen->Placed));
+    pGen->PatternType = patternType;
+    pGen->NumNodes = 0;
+    pGen->NumPlacements = 0;
+    pGen->IsTruncated = false;
+
+    Pattern** ppRotations = g_PatternLUT[patternType];
+    const int NumRotations = PatternNumRotations[patternType];
+    if (patternType == PATTERN_NONE ||
+        SimBoardCollides(pRowBits, ppRotations[rotation], gridX, gridY))
+    {
+        return 0;
+    }
+
+    moveGenVisit(pGen, gridX, gridY, rotation, MOVEGEN_ACTION_NONE, 0);
+    for (Uint16 head = 0; head < pGen->NumNodes; ++head)
+    {
+        const MoveGenNode_t Node = pGen->Nodes[head];
+        const Pattern* pPattern = ppRotations[Node.Rotation];
+
+        // Hard drop from here. Soft dropping first lands in the same spot
+        // the parent already reported, with a longer path.
+        const bool CanFall = !SimBoardCollides(pRowBits, pPattern, Node.X, Node.Y + 1);
+        if (Node.Action != MOVEGEN_ACTION_DOWN)
+        {
+            Sint8 landingY = Node.Y;
+            if (CanFall)
+            {
+                do
+                {
+                    ++landingY;
+                }
+                while (!SimBoardCollides(pRowBits, pPattern, Node.X, landingY + 1));
+            }
+
+            moveGenAddPlacement(pGen, pRowBits, head, landingY);
+        }
+
+        if (!SimBoardCollides(pRowBits, pPattern, Node.X - 1, Node.Y))
+        {
+            moveGenVisit(pGen, Node.X - 1, Node.Y, Node.Rotation, MOVEGEN_ACTION_LEFT, head);
+        }
+
+        if (!SimBoardCollides(pRowBits, pPattern, Node.X + 1, Node.Y))
+        {
+            moveGenVisit(pGen, Node.X + 1, Node.Y, Node.Rotation, MOVEGEN_ACTION_RIGHT, head);
+        }
+
+        if (CanFall)
+        {
+            moveGenVisit(pGen, Node.X, Node.Y + 1, Node.Rotation, MOVEGEN_ACTION_DOWN, head);
+        }
+
+        if (NumRotations < 2)
+        {
+            continue;
+        }
+
+        WallKickVector2 kick;
+        const Uint8 RightRotation = (Node.Rotation + 1) % NumRotations;
+        if (SimBoardResolveWallKick(
+                pRowBits,
+                patternType,
+                WALLKICK_DIRECTION_RIGHT,
+                ppRotations[RightRotation],
+                RightRotation,
+                Node.X,
+                Node.Y,
+                &kick))
+        {
+            moveGenVisit(
+                pGen,
+                Node.X + kick.X,
+                Node.Y + kick.Y,
+                RightRotation,
+                MOVEGEN_ACTION_ROTATE_RIGHT,
+                head);
+        }
+
+        const Uint8 LeftRotation = Node.Rotation == 0 ? NumRotations - 1 : Node.Rotation - 1;
+        if (SimBoardResolveWallKick(
+                pRowBits,
+                patternType,
+                WALLKICK_DIRECTION_LEFT,
+                ppRotations[LeftRotation],
+                LeftRotation,
+                Node.X,
+                Node.Y,
+                &kick))
+        {
+            moveGenVisit(
+                pGen,
+                Node.X + kick.X,
+                Node.Y + kick.Y,
+                LeftRotation,
+                MOVEGEN_ACTION_ROTATE_LEFT,
+                head);
+        }
+    }
+
+    return pGen->NumPlacements;
+}
+
+// Placements for the sim's current pattern from where it is right now
+Uint16 MoveGenGenerateForSim(MoveGen_t* pGen, const Sim_t* pSim)
+{
+    return MoveGenGenerate(
+        pGen,
+        pSim->state.rowBits,
+        pSim->state.currentPatternType,
+        pSim->state.patternGridX,
+        pSim->state.patternGridY,
+        pSim->state.currentPatternRotation);
+}
+
+// Where a freshly spawned pattern can start its search without losing any
+// placements: the lowest row whose pattern box clears the whole stack. Above
+// the stack a pattern can shift and rotate anywhere, so the rows between
+// spawnY and here only add nodes.
+Sint8 MoveGenOpenStartY(const Uint16* pRowBits, Sint8 spawnY)
+{
+    Sint8 topRow = 0;
+    while (topRow < GRID_HEIGHT && pRowBits[topRow] == 0)
+    {
+        ++topRow;
+    }
+
+    const Sint8 StartY = topRow - 4;
+    return StartY > spawnY ? StartY : spawnY;
+}
+
+// Writes the actions leading to pPlacement, ending in a hard drop, and
+// returns how many there are. Returns 0 if they don't fit in maxActions.
+Uint8
+MoveGenPath(
+    const MoveGen_t* pGen,
+    const MoveGenPlacement_t* pPlacement,
+    Uint8* pActionsOut,
+    Uint8 maxActions)
+{
+    Uint8 length = 1;
+    for (Uint16 node = pPlacement->Node; node != 0; node = pGen->Nodes[node].Parent)
+    {
+        ++length;
+    }
+
+    if (length > maxActions)
+    {
+        return 0;
+    }
+
+    pActionsOut[length - 1] = MOVEGEN_ACTION_DROP;
+    Uint8 index = length - 1;
+    for (Uint16 node = pPlacement->Node; node != 0; node = pGen->Nodes[node].Parent)
+    {
+        pActionsOut[--index] = pGen->Nodes[node].Action;
+    }
+
+    return length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Steering: walks the sim's current pattern to a placement one input per
+// frame. The path is planned once and followed for as long as the pattern is
+// where the path expects it; gravity, holds or anything else moving it
+// triggers a replan.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    PatternType_t PatternType;
+    Sint8         TargetX;
+    Sint8         TargetY;
+    Uint8         TargetRotation;
+    Uint8         PathLength;
+    Uint8         PathIndex;
+    Uint8         Actions[MOVEGEN_MAX_PATH];
+    MoveGenNode_t Expected[MOVEGEN_MAX_PATH]; // Where the pattern is before each action
+} MoveGenSteer_t;
+
+void MoveGenSteerBegin(MoveGenSteer_t* pSteer, Sint8 targetX, Sint8 targetY, Uint8 targetRotation)
+{
+    pSteer->PatternType = PATTERN_NONE;
+    pSteer->TargetX = targetX;
+    pSteer->TargetY = targetY;
+    pSteer->TargetRotation = targetRotation;
+    pSteer->PathLength = 0;
+    pSteer->PathIndex = 0;
+}
+
+static bool moveGenSteerPlan(MoveGenSteer_t* pSteer, MoveGen_t* pGen, const Sim_t* pSim)
+{
+    pSteer->PatternType = pSim->state.currentPatternType;
+    pSteer->PathLength = 0;
+    pSteer->PathIndex = 0;
+
+    const Uint16 NumPlacements = MoveGenGenerateForSim(pGen, pSim);
+    for (Uint16 i = 0; i < NumPlacements; ++i)
+    {
+        const MoveGenPlacement_t* pPlacement = &(pGen->Placements[i]);
+        if (pPlacement->X != pSteer->TargetX ||
+            pPlacement->Y != pSteer->TargetY ||
+            pPlacement->Rotation != pSteer->TargetRotation)
+        {
+            continue;
+        }
+
+        const Uint8 Length = MoveGenPath(pGen, pPlacement, pSteer->Actions, MOVEGEN_MAX_PATH);
+        if (Length == 0)
+        {
+            return false;
+        }
+
+        // The hard drop starts from the placement's node, every other action
+        // from its parent
+        Uint16 node = pPlacement->Node;
+        for (int index = Length - 1; index >= 0; --index)
+        {
+            pSteer->Expected[index] = pGen->Nodes[node];
+            node = pGen->Nodes[node].Parent;
+        }
+
+        pSteer->PathLength = Length;
+        return true;
+    }
+
+    return false;
+}
+
+// The input that moves the sim's current pattern one step closer to the
+// target. Hard drops where the pattern is when the target can't be reached.
+Uint16 MoveGenSteerNextInputs(MoveGenSteer_t* pSteer, MoveGen_t* pGen, const Sim_t* pSim)
+{
+    const MoveGenNode_t* pExpected = &(pSteer->Expected[pSteer->PathIndex]);
+    const bool OnPath =
+        pSteer->PathIndex < pSteer->PathLength &&
+        pSteer->PatternType == pSim->state.currentPatternType &&
+        pExpected->X == pSim->state.patternGridX &&
+        pExpected->Y == pSim->state.patternGridY &&
+        pExpected->Rotation == pSim->state.currentPatternRotation;
+    if (!OnPath && !moveGenSteerPlan(pSteer, pGen, pSim))
+    {
+        return SIM_INPUT_UP;
+    }
+
+    return MoveGenActionInputs[pSteer->Actions[pSteer->PathIndex++]];
+}
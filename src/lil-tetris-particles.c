@@ -5,27 +5,35 @@
 // Should be way more than we need
 #define MAX_PARTICLES 2048
 
+// Line clear bursts are capped so a quad clear at a high level, or the game
+// over wipe, costs a bounded amount to tick and draw every frame
+#define LINE_CLEAR_MAX_PARTICLES 512
+
+// In pixels per frame, per frame
+#define LINE_CLEAR_GRAVITY 0.35f
+#define LINE_CLEAR_DRAG    0.96f
+
 typedef enum
 {
     BEHAVIOR_DROP,
     BEHAVIOR_LINE_CLEAR
 } ParticleBehavior;
 
-typedef struct {
-    Uint8     FramesSinceSpawn;
-    Uint8     Lifetime;
-    int       X;
-    int       Y;
-    int       Size;
-    SDL_Color Color;
-} SquareParticle_t;
-
+// Live particles are packed into [0, Count) of each array, so updates run
+// straight down the arrays and expired particles are swap-removed
 typedef struct {
     ParticleBehavior Behavior;
-    SquareParticle_t Particles[MAX_PARTICLES];
-    bool             Valid[MAX_PARTICLES];
+    float            X[MAX_PARTICLES];
+    float            Y[MAX_PARTICLES];
+    float            VelocityX[MAX_PARTICLES]; // Pixels per frame
+    float            VelocityY[MAX_PARTICLES];
+    int              Size[MAX_PARTICLES];
+    int              FramesSinceSpawn[MAX_PARTICLES];
+    int              Lifetime[MAX_PARTICLES];
+    SDL_Color        Color[MAX_PARTICLES];
     bool             Initialized;
     Uint16           Count;
+    Uint16           Capacity;
 } ParticleSystem_t;
 
 void ParticleSystemInitialize(
@@ -37,92 +45,140 @@ void ParticleSystemInitialize(
         return;
     }
 
+    memset(pParticleSystem, 0, sizeof(*pParticleSystem));
     pParticleSystem->Behavior = behavior;
-    memset(pParticleSystem->Particles, 0, sizeof(pParticleSystem->Particles));
-    memset(pParticleSystem->Valid, 0, sizeof(pParticleSystem->Valid));
-    pParticleSystem->Count = 0;
+    pParticleSystem->Capacity =
+        behavior == BEHAVIOR_LINE_CLEAR ? LINE_CLEAR_MAX_PARTICLES : MAX_PARTICLES;
     pParticleSystem->Initialized = true;
 }
 
-SquareParticle_t* ParticleSystemMakeParticle(ParticleSystem_t* pParticleSystem)
+// Returns the index of a zeroed particle to fill in, or -1 if the system is
+// full
+int ParticleSystemMakeParticle(ParticleSystem_t* pParticleSystem)
 {
     assert(pParticleSystem->Initialized);
 
-    if (pParticleSystem->Count >= MAX_PARTICLES)
+    if (pParticleSystem->Count >= pParticleSystem->Capacity)
     {
-        fprintf(stderr, "Exceeded max particle count\n");
-        return NULL;
+        // Bursts are expected to run into a smaller budget, so only
+        // complain when we're out of room entirely
+        if (pParticleSystem->Capacity == MAX_PARTICLES)
+        {
+            fprintf(stderr, "Exceeded max particle count\n");
+        }
+        return -1;
     }
 
-    // Find the next available particle slot
-    Sint16 nextParticleIndex = -1;
-    for (Uint16 i = 0; i < MAX_PARTICLES; ++i)
+    const int Index = pParticleSystem->Count++;
+    pParticleSystem->X[Index] = 0.f;
+    pParticleSystem->Y[Index] = 0.f;
+    pParticleSystem->VelocityX[Index] = 0.f;
+    pParticleSystem->VelocityY[Index] = 0.f;
+    pParticleSystem->Size[Index] = 0;
+    pParticleSystem->FramesSinceSpawn[Index] = 0;
+    pParticleSystem->Lifetime[Index] = 0;
+    pParticleSystem->Color[Index] = (SDL_Color){ 0, 0, 0, 0 };
+
+    return Index;
+}
+
+static void particleSystemTickDrop(ParticleSystem_t* pParticleSystem)
+{
+    float* pY = pParticleSystem->Y;
+    int* pSize = pParticleSystem->Size;
+    int* pFrames = pParticleSystem->FramesSinceSpawn;
+
+    // Branch free so the compiler can vectorize it. Drift down and shrink
+    // every fourth frame once the particle is a few frames old.
+    const int Count = pParticleSystem->Count;
+    for (int i = 0; i < Count; ++i)
     {
-        if (!pParticleSystem->Valid[i])
-        {
-            nextParticleIndex = i;
-            break;
-        }
+        const int Frames = ++pFrames[i];
+        const int Step = (Frames > 6) & ((Frames & 3) == 0);
+        const int Shrunk = pSize[i] > 2 ? pSize[i] - 1 : 2;
+        pY[i] += (float)(Step * 2);
+        pSize[i] = Step ? Shrunk : pSize[i];
     }
+}
 
-    if (nextParticleIndex < 0)
+static void particleSystemTickLineClear(ParticleSystem_t* pParticleSystem)
+{
+    float* pX = pParticleSystem->X;
+    float* pY = pParticleSystem->Y;
+    float* pVelocityX = pParticleSystem->VelocityX;
+    float* pVelocityY = pParticleSystem->VelocityY;
+    int* pFrames = pParticleSystem->FramesSinceSpawn;
+    const int* pLifetime = pParticleSystem->Lifetime;
+
+    // Fly under gravity with a little horizontal drag. Same shape as the drop
+    // update: one pass over plain arrays, no branches.
+    const int Count = pParticleSystem->Count;
+    for (int i = 0; i < Count; ++i)
     {
-        // We shouldn't get here
-        assert(false);
-        fprintf(stderr, "Could not find available particle in MakeParticle()\n");
-        return NULL;
+        ++pFrames[i];
+        pVelocityY[i] += LINE_CLEAR_GRAVITY;
+        pVelocityX[i] *= LINE_CLEAR_DRAG;
+        pX[i] += pVelocityX[i];
+        pY[i] += pVelocityY[i];
     }
 
-    SquareParticle_t* pParticle = &(pParticleSystem->Particles[nextParticleIndex]);
-    memset(pParticle, 0, sizeof(*pParticle));
+    // Fade out linearly over the particle's lifetime
+    SDL_Color* pColor = pParticleSystem->Color;
+    for (int i = 0; i < Count; ++i)
+    {
+        const int Remaining = pLifetime[i] - pFrames[i];
+        const float Fraction =
+            Remaining > 0 ? (float)Remaining / (float)pLifetime[i] : 0.f;
+        pColor[i].a = (Uint8)(Fraction * SDL_ALPHA_OPAQUE);
+    }
+}
 
-    pParticleSystem->Valid[nextParticleIndex] = true;
-    ++pParticleSystem->Count;
+// Swap-removes every particle that has lived out its lifetime
+static void particleSystemRemoveExpired(ParticleSystem_t* pParticleSystem)
+{
+    int i = 0;
+    while (i < pParticleSystem->Count)
+    {
+        if (pParticleSystem->FramesSinceSpawn[i] < pParticleSystem->Lifetime[i])
+        {
+            ++i;
+            continue;
+        }
 
-    return pParticle;
+        const int Last = --pParticleSystem->Count;
+        pParticleSystem->X[i] = pParticleSystem->X[Last];
+        pParticleSystem->Y[i] = pParticleSystem->Y[Last];
+        pParticleSystem->VelocityX[i] = pParticleSystem->VelocityX[Last];
+        pParticleSystem->VelocityY[i] = pParticleSystem->VelocityY[Last];
+        pParticleSystem->Size[i] = pParticleSystem->Size[Last];
+        pParticleSystem->FramesSinceSpawn[i] = pParticleSystem->FramesSinceSpawn[Last];
+        pParticleSystem->Lifetime[i] = pParticleSystem->Lifetime[Last];
+        pParticleSystem->Color[i] = pParticleSystem->Color[Last];
+    }
 }
 
 void ParticleSystemTick(ParticleSystem_t* pParticleSystem)
 {
     assert(pParticleSystem->Initialized);
 
-    Sint16 particlesRemaining = pParticleSystem->Count;
-    Uint16 index = 0;
-    while(particlesRemaining > 0)
+    if (pParticleSystem->Behavior == BEHAVIOR_DROP)
     {
-        if (pParticleSystem->Valid[index])
-        {
-            // TODO
-            SquareParticle_t* pParticle = &(pParticleSystem->Particles[index]);
-            pParticle->FramesSinceSpawn++;
-
-            // TODO: CHECK BEHAVIOR
-            if (pParticleSystem->Behavior == BEHAVIOR_DROP)
-            {
-                if (pParticle->FramesSinceSpawn == pParticle->Lifetime)
-                {
-                    // This particle has expired
-                    pParticleSystem->Valid[index] = false;
-                    pParticleSystem->Count--;
-                }
-                else if (pParticle->FramesSinceSpawn > 6 && 
-                         (pParticle->FramesSinceSpawn % 4 == 0))
-                {
-                    pParticle->Y += 2;
-                    pParticle->Size = (pParticle->Size > 2 ? pParticle->Size - 1 : 2);
-                }
-            }
-            else if (pParticleSystem->Behavior == BEHAVIOR_LINE_CLEAR)
-            {
-                // TODO
-            }
-
-            particlesRemaining--;
-        }
-        index++;
+        particleSystemTickDrop(pParticleSystem);
+    }
+    else if (pParticleSystem->Behavior == BEHAVIOR_LINE_CLEAR)
+    {
+        particleSystemTickLineClear(pParticleSystem);
     }
+
+    particleSystemRemoveExpired(pParticleSystem);
 }
 
+// Scratch space for ParticleSystemRender, one quad per particle
+static SDL_Vertex g_ParticleVertices[MAX_PARTICLES * 4];
+static int        g_ParticleIndices[MAX_PARTICLES * 6];
+
+// Draws every live particle with a single SDL_RenderGeometry call, colored
+// per vertex
 void ParticleSystemRender(
     ParticleSystem_t* pParticleSystem,
     SDL_Renderer* pRenderer,
@@ -131,37 +187,58 @@ void ParticleSystemRender(
 {
     assert(pParticleSystem->Initialized);
 
-    Sint16 particlesRemaining = pParticleSystem->Count;
-    Uint16 index = 0;
-    while(particlesRemaining > 0)
+    int numQuads = 0;
+    for (int i = 0; i < pParticleSystem->Count; ++i)
     {
-        if (pParticleSystem->Valid[index])
+        const float X0 = pParticleSystem->X[i];
+        const float Y0 = pParticleSystem->Y[i];
+        const float X1 = X0 + (float)pParticleSystem->Size[i];
+        const float Y1 = Y0 + (float)pParticleSystem->Size[i];
+
+        // Don't render out of bounds
+        if (X0 <= leftBounds || X1 >= rightBounds)
         {
-            SquareParticle_t* pParticle = &(pParticleSystem->Particles[index]);
-
-            // Don't render out of bounds
-            if (pParticle->X > leftBounds && 
-                (pParticle->X + pParticle->Size) < rightBounds)
-            {
-                SDL_Rect rect;
-
-                rect.x = pParticle->X;
-                rect.y = pParticle->Y;
-                rect.w = pParticle->Size;
-                rect.h = pParticle->Size;
-
-                SDL_SetRenderDrawColor(
-                    pRenderer,
-                    pParticle->Color.r,
-                    pParticle->Color.g,
-                    pParticle->Color.b,
-                    pParticle->Color.a);
-                SDL_RenderFillRect(pRenderer, &rect);
-            }
-
-            particlesRemaining--;
+            continue;
         }
-        index++;
+
+        const SDL_Color Color = pParticleSystem->Color[i];
+
+        SDL_Vertex* pVertices = &g_ParticleVertices[numQuads * 4];
+        pVertices[0] = (SDL_Vertex){ { X0, Y0 }, Color, { 0.f, 0.f } };
+        pVertices[1] = (SDL_Vertex){ { X1, Y0 }, Color, { 0.f, 0.f } };
+        pVertices[2] = (SDL_Vertex){ { X1, Y1 }, Color, { 0.f, 0.f } };
+        pVertices[3] = (SDL_Vertex){ { X0, Y1 }, Color, { 0.f, 0.f } };
+
+        const int First = numQuads * 4;
+        int* pIndices = &g_ParticleIndices[numQuads * 6];
+        pIndices[0] = First;
+        pIndices[1] = First + 1;
+        pIndices[2] = First + 2;
+        pIndices[3] = First;
+        pIndices[4] = First + 2;
+        pIndices[5] = First + 3;
+
+        ++numQuads;
     }
-}
 
+    if (numQuads == 0)
+    {
+        return;
+    }
+
+    // Untextured geometry follows the draw blend mode, and line clear
+    // particles fade out through their alpha
+    SDL_BlendMode previousBlendMode;
+    SDL_GetRenderDrawBlendMode(pRenderer, &previousBlendMode);
+    SDL_SetRenderDrawBlendMode(pRenderer, SDL_BLENDMODE_BLEND);
+
+    SDL_RenderGeometry(
+        pRenderer,
+        NULL,
+        g_ParticleVertices,
+        numQuads * 4,
+        g_ParticleIndices,
+        numQuads * 6);
+
+    SDL_SetRenderDrawBlendMode(pRenderer, previousBlendMode);
+}
@@ -1,4 +1,8 @@
-#include <SDL2/SDL.h>
+#pragma once
+
+#include "lil-tetris-types.c"
+
+#include <pthread.h>
 
 typedef enum
 {
@@ -17,6 +21,15 @@ typedef struct {
     Uint8 occupancy[4][4];
     Uint8 rows;
     Uint8 cols;
+
+    // Derived from occupancy by PatternInitializeMasks(). Bit x of
+    // rowMasks[y] is set when occupancy[y][x] is.
+    Uint8 rowMasks[4];
+    Sint8 colBottoms[4]; // Lowest occupied row per column, -1 if none
+    Sint8 colTops[4];    // Highest occupied row per column, -1 if none
+    Sint8 minCol;
+    Sint8 maxCol;
+    Sint8 maxRow;
 } Pattern;
 
 #define PATTERN_ROTATION_COUNT(PatternRotations) \
@@ -368,3 +381,66 @@ const WallKickVector2 PatternLineWallKickLeftRotationTests[4][PATTERN_MAX_KICK_T
     { { 0, 0 }, {-2, 0}, { 1, 0 }, {-2, 1 }, { 1,-2 } }, // 270 -> 180
     { { 0, 0 }, {-1, 0}, { 2, 0 }, {-1,-2 }, { 2, 1 } }, //   0 -> 270
 };
+
+static Pattern** g_AllPatternRotations[(int)PATTERN_MAX_VALUE] = {
+    EmptyPatternRotations,
+    LPatternLeftRotations,
+    LPatternRightRotations,
+    ZPatternLeftRotations,
+    ZPatternRightRotations,
+    TPatternRotations,
+    LinePatternRotations,
+    SquarePatternRotations,
+};
+
+static void patternComputeMasks()
+{
+    for (int type = 0; type < (int)PATTERN_MAX_VALUE; ++type)
+    {
+        for (int rotation = 0; rotation < PatternNumRotations[type]; ++rotation)
+        {
+            Pattern* pPattern = g_AllPatternRotations[type][rotation];
+            Sint8 minCol = 4;
+            Sint8 maxCol = -1;
+            Sint8 maxRow = -1;
+            memset(pPattern->colBottoms, -1, sizeof(pPattern->colBottoms));
+            memset(pPattern->colTops, -1, sizeof(pPattern->colTops));
+            for (int y = 0; y < 4; ++y)
+            {
+                Uint8 rowMask = 0;
+                for (int x = 0; x < 4; ++x)
+                {
+                    if (pPattern->occupancy[y][x])
+                    {
+                        rowMask |= (1 << x);
+                        minCol = x < minCol ? x : minCol;
+                        maxCol = x > maxCol ? x : maxCol;
+                        maxRow = y;
+
+                        pPattern->colBottoms[x] = y;
+                        if (pPattern->colTops[x] < 0)
+                        {
+                            pPattern->colTops[x] = y;
+                        }
+                    }
+                }
+
+                pPattern->rowMasks[y] = rowMask;
+            }
+
+            pPattern->minCol = minCol;
+            pPattern->maxCol = maxCol;
+            pPattern->maxRow = maxRow;
+        }
+    }
+}
+
+static pthread_once_t g_PatternMasksOnce = PTHREAD_ONCE_INIT;
+
+// Fills in the derived fields of every pattern. Every thread shares these
+// tables, so only the first call does any work. Call it at startup, before
+// any sims are created.
+void PatternInitializeMasks()
+{
+    pthread_once(&g_PatternMasksOnce, patternComputeMasks);
+}
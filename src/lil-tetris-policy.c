@@ -0,0 +1,127 @@
+#pragma once
+
+// Policies drive a headless sim by producing the inputs for every frame.
+// Each game gets its own zeroed policy state of StateSize bytes. End, when
+// set, releases anything Begin acquired.
+
+#include "lil-tetris-sim.c"
+#include "lil-tetris-bot.c"
+#include "lil-tetris-extbot.c"
+
+typedef struct
+{
+    const char* pName;
+    size_t      StateSize;
+    void        (*Begin)(void* pState, Uint64 seed);
+    Uint16      (*NextInputs)(void* pState, const Sim_t* pSim);
+    void        (*End)(void* pState);
+} Policy_t;
+
+////////////////////////////////////////////////////////////////////////////////
+// Random policy: walks each pattern to a random column and rotation, then
+// hard drops it.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    Random_t Random;
+    Uint64   lastSpawnFrame;
+    Sint8    targetX;
+    Uint8    targetRotation;
+} RandomPolicyState_t;
+
+static void randomPolicyPickTarget(RandomPolicyState_t* pState, const Sim_t* pSim)
+{
+    const int NumRotations = PatternNumRotations[pSim->state.currentPatternType];
+    pState->targetRotation = RandomRange(&(pState->Random), NumRotations);
+    pState->targetX = (Sint8)RandomRange(&(pState->Random), GRID_WIDTH + 2) - 2;
+}
+
+static void randomPolicyBegin(void* pState, Uint64 seed)
+{
+    RandomPolicyState_t* pRandomState = (RandomPolicyState_t*)pState;
+    RandomSeed(&(pRandomState->Random), seed);
+    RandomJump(&(pRandomState->Random));
+    pRandomState->lastSpawnFrame = (Uint64)-1;
+}
+
+static Uint16 randomPolicyNextInputs(void* pState, const Sim_t* pSim)
+{
+    RandomPolicyState_t* pRandomState = (RandomPolicyState_t*)pState;
+    if (pSim->state.isIntro)
+    {
+        return SIM_INPUT_BEGIN;
+    }
+
+    if (pSim->state.isGameOver)
+    {
+        return SIM_INPUT_RETRY;
+    }
+
+    if (pRandomState->lastSpawnFrame != pSim->state.lastSpawnFrame)
+    {
+        pRandomState->lastSpawnFrame = pSim->state.lastSpawnFrame;
+        randomPolicyPickTarget(pRandomState, pSim);
+    }
+
+    if (pSim->state.currentPatternRotation != pRandomState->targetRotation)
+    {
+        return SIM_INPUT_ROTATE_RIGHT;
+    }
+
+    // Targets past the walls just end up flush against them
+    const Pattern* pPattern = SimGetCurrentPattern(pSim);
+    if (pSim->state.patternGridX > pRandomState->targetX &&
+        !SimPatternCollides(pSim, (Pattern*)pPattern, -1, 0))
+    {
+        return SIM_INPUT_LEFT;
+    }
+
+    if (pSim->state.patternGridX < pRandomState->targetX &&
+        !SimPatternCollides(pSim, (Pattern*)pPattern, 1, 0))
+    {
+        return SIM_INPUT_RIGHT;
+    }
+
+    return SIM_INPUT_UP;
+}
+
+static Policy_t g_Policies[] = {
+    {
+        "random",
+        sizeof(RandomPolicyState_t),
+        randomPolicyBegin,
+        randomPolicyNextInputs,
+        NULL,
+    },
+    {
+        "beam",
+        sizeof(BotPolicyState_t),
+        botPolicyBegin,
+        botPolicyNextInputs,
+        botPolicyEnd,
+    },
+#ifndef __EMSCRIPTEN__
+    {
+        "external",
+        sizeof(ExtBotPolicyState_t),
+        extBotPolicyBegin,
+        extBotPolicyNextInputs,
+        extBotPolicyEnd,
+    },
+#endif
+};
+
+#define POLICY_COUNT (sizeof(g_Policies) / sizeof(g_Policies[0]))
+
+Policy_t* PolicyFind(const char* pName)
+{
+    for (size_t i = 0; i < POLICY_COUNT; ++i)
+    {
+        if (strcmp(g_Policies[i].pName, pName) == 0)
+        {
+            return &g_Policies[i];
+        }
+    }
+
+    return NULL;
+}
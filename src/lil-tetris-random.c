@@ -0,0 +1,101 @@
+#pragma once
+
+// Small per-instance PRNG (xoshiro128**). Each game owns its own generators
+// so games are reproducible from a seed and can run on any thread.
+
+#include "lil-tetris-types.c"
+
+typedef struct
+{
+    Uint32 State[4];
+} Random_t;
+
+static Uint32 randomRotl(Uint32 x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+// splitmix64, used to expand a seed into a well mixed state
+static Uint64 randomSplitMix64(Uint64* pSeed)
+{
+    Uint64 z = (*pSeed += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void RandomSeed(Random_t* pRandom, Uint64 seed)
+{
+    const Uint64 A = randomSplitMix64(&seed);
+    const Uint64 B = randomSplitMix64(&seed);
+    pRandom->State[0] = (Uint32)A;
+    pRandom->State[1] = (Uint32)(A >> 32);
+    pRandom->State[2] = (Uint32)B;
+    pRandom->State[3] = (Uint32)(B >> 32);
+}
+
+Uint32 RandomNext(Random_t* pRandom)
+{
+    Uint32* s = pRandom->State;
+    const Uint32 Result = randomRotl(s[1] * 5, 7) * 9;
+    const Uint32 t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = randomRotl(s[3], 11);
+
+    return Result;
+}
+
+// Uniform in [0, bound) without modulo bias (Lemire's method)
+Uint32 RandomRange(Random_t* pRandom, Uint32 bound)
+{
+    Uint64 m = (Uint64)RandomNext(pRandom) * bound;
+    Uint32 low = (Uint32)m;
+    if (low < bound)
+    {
+        const Uint32 Threshold = -bound % bound;
+        while (low < Threshold)
+        {
+            m = (Uint64)RandomNext(pRandom) * bound;
+            low = (Uint32)m;
+        }
+    }
+
+    return (Uint32)(m >> 32);
+}
+
+// Advances the generator by 2^64 steps. Seeding once and jumping N times
+// gives N non-overlapping streams, e.g. one per worker thread.
+void RandomJump(Random_t* pRandom)
+{
+    static const Uint32 Jump[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+
+    Uint32 s0 = 0;
+    Uint32 s1 = 0;
+    Uint32 s2 = 0;
+    Uint32 s3 = 0;
+    for (int i = 0; i < (int)(sizeof(Jump) / sizeof(Jump[0])); ++i)
+    {
+        for (int b = 0; b < 32; ++b)
+        {
+            if (Jump[i] & (1u << b))
+            {
+                s0 ^= pRandom->State[0];
+                s1 ^= pRandom->State[1];
+                s2 ^= pRandom->State[2];
+                s3 ^= pRandom->State[3];
+            }
+
+            RandomNext(pRandom);
+        }
+    }
+
+    pRandom->State[0] = s0;
+    pRandom->State[1] = s1;
+    pRandom->State[2] = s2;
+    pRandom->State[3] = s3;
+}
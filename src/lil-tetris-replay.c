@@ -0,0 +1,822 @@
+#pragma once
+
+// Input replays. A game is fully determined by its seed and the inputs fed to
+// SimStep() on every frame, so that's all a replay stores:
+//
+//   "LTRP" | u16 format version | u16 ruleset | u64 seed    (little endian)
+//   records...
+//
+// Every record starts with a varint whose low bit is the record type. Input
+// records carry the input mask in the remaining bits, followed by a varint
+// count of consecutive frames that used it. Most frames repeat the previous
+// frame's inputs, so a whole game is usually a few KB.
+//
+// Keyframe records carry their payload size in the remaining bits, followed
+// by the payload: the replay frame they precede and a snapshot of the sim
+// state at that point. They're written every KeyframeInterval frames so
+// seeking never has to simulate more than that many frames. There's none at
+// frame 0, the seed in the header already says where the game starts.
+
+#include "lil-tetris-sim.c"
+
+#include <stdlib.h>
+
+#define REPLAY_MAGIC "LTRP"
+#define REPLAY_FORMAT_VERSION 2
+#define REPLAY_HEADER_SIZE 16
+
+#define REPLAY_WRITE_BUFFER_SIZE 4096
+#define REPLAY_MAX_VARINT_SIZE 10
+#define REPLAY_MAX_RUN_LENGTH 0xFFFFFFFFu
+#define REPLAY_MAX_KEYFRAME_SIZE 512
+
+// 30 seconds of play. Re-simulating that many frames takes well under 1ms.
+#define REPLAY_DEFAULT_KEYFRAME_INTERVAL 1800
+
+typedef enum
+{
+    REPLAY_RECORD_INPUTS   = 0,
+    REPLAY_RECORD_KEYFRAME = 1,
+} ReplayRecordType;
+
+typedef struct
+{
+    FILE*  pFile;
+    Uint16 RunInputs;
+    Uint32 RunLength;
+    Uint64 NumFrames;
+    Uint32 KeyframeInterval; // 0 to never write keyframes
+    size_t BufferSize;
+    Uint8  Buffer[REPLAY_WRITE_BUFFER_SIZE];
+} ReplayWriter_t;
+
+typedef struct
+{
+    Uint64 Frame;
+    size_t Offset; // Start of the snapshot, right after the frame number
+    size_t End;
+} ReplayKeyframe_t;
+
+typedef struct
+{
+    Uint8* pData;
+    size_t Size;
+    size_t Offset;
+    Uint64 Seed;
+    Uint64 Frame;     // Replay frame the next call to ReplayReaderNext() yields
+    Uint64 NumFrames;
+    Uint16 RunInputs;
+    Uint32 RunRemaining;
+    ReplayKeyframe_t* pKeyframes;
+    size_t NumKeyframes;
+} ReplayReader_t;
+
+////////////////////////////////////////////////////////////////////////////////
+// Encoding
+////////////////////////////////////////////////////////////////////////////////
+static size_t replayEncodeVarint(Uint64 value, Uint8* pOut)
+{
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        pOut[size++] = (Uint8)(value | 0x80);
+        value >>= 7;
+    }
+
+    pOut[size++] = (Uint8)value;
+    return size;
+}
+
+static bool replayDecodeVarint(const Uint8* pData, size_t end, size_t* pOffset, Uint64* pValueOut)
+{
+    Uint64 value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (*pOffset >= end)
+        {
+            return false;
+        }
+
+        const Uint8 Byte = pData[(*pOffset)++];
+        value |= (Uint64)(Byte & 0x7F) << shift;
+        if (!(Byte & 0x80))
+        {
+            *pValueOut = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void replayWriteLE(Uint8* pOut, Uint64 value, int numBytes)
+{
+    for (int i = 0; i < numBytes; ++i)
+    {
+        pOut[i] = (Uint8)(value >> (8 * i));
+    }
+}
+
+static Uint64 replayReadLE(const Uint8* pIn, int numBytes)
+{
+    Uint64 value = 0;
+    for (int i = 0; i < numBytes; ++i)
+    {
+        value |= (Uint64)pIn[i] << (8 * i);
+    }
+
+    return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Keyframe snapshots. Only what the sim needs to carry on playing: events are
+// per-step and board features are recomputed from the rows on restore.
+////////////////////////////////////////////////////////////////////////////////
+enum
+{
+    REPLAY_SIM_PAUSED    = 1 << 0,
+    REPLAY_SIM_INTRO     = 1 << 1,
+    REPLAY_SIM_GAMEOVER  = 1 << 2,
+    REPLAY_SIM_RENDER    = 1 << 3,
+    REPLAY_SIM_DID_HOLD  = 1 << 4,
+};
+
+static size_t replayEncodeSim(const Sim_t* pSim, Uint8* pOut)
+{
+    size_t size = 0;
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        size += replayEncodeVarint(pSim->state.rowBits[y], pOut + size);
+    }
+
+    // Colors of occupied cells only, two to a byte
+    int numCells = 0;
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        for (int x = 0; x < GRID_WIDTH; ++x)
+        {
+            if (!(pSim->state.rowBits[y] & (1 << x)))
+            {
+                continue;
+            }
+
+            if (numCells++ & 1)
+            {
+                pOut[size - 1] |= pSim->cellTypes[y][x] << 4;
+            }
+            else
+            {
+                pOut[size++] = pSim->cellTypes[y][x];
+            }
+        }
+    }
+
+    replayWriteLE(pOut + size, pSim->seed, 8);
+    size += 8;
+    for (int i = 0; i < 4; ++i)
+    {
+        replayWriteLE(pOut + size, pSim->state.random.State[i], 4);
+        size += 4;
+    }
+
+    for (int i = 0; i < PATTERN_MAX_VALUE - 1; ++i)
+    {
+        pOut[size++] = pSim->state.randomBag[i];
+    }
+
+    for (int i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        pOut[size++] = pSim->state.nextQueue[i];
+    }
+
+    pOut[size++] = pSim->state.currentPatternType;
+    pOut[size++] = pSim->state.holdPatternType;
+    pOut[size++] = (Uint8)pSim->state.patternGridX;
+    pOut[size++] = (Uint8)pSim->state.patternGridY;
+    pOut[size++] = pSim->state.currentPatternRotation;
+    pOut[size++] = pSim->state.randomBagIndex;
+    pOut[size++] = pSim->state.nextQueueIndex;
+    pOut[size++] = pSim->state.dropSpeed;
+    pOut[size++] = pSim->state.currentLevel;
+    pOut[size++] =
+        (pSim->state.isPaused ? REPLAY_SIM_PAUSED : 0) |
+        (pSim->state.isIntro ? REPLAY_SIM_INTRO : 0) |
+        (pSim->state.isGameOver ? REPLAY_SIM_GAMEOVER : 0) |
+        (pSim->state.renderCells ? REPLAY_SIM_RENDER : 0) |
+        (pSim->state.hasDoneHold ? REPLAY_SIM_DID_HOLD : 0);
+
+    // Rows being cleared, top to bottom and padded with -1
+    Uint32 clearRows = pSim->state.clearRows;
+    for (int i = 0; i < GRID_HEIGHT; ++i)
+    {
+        pOut[size++] = clearRows ? (Uint8)__builtin_ctz(clearRows) : (Uint8)-1;
+        clearRows &= clearRows - 1;
+    }
+
+    size += replayEncodeVarint(pSim->state.currentFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.lastDropFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.preSpawnFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.lastSpawnFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.levelUpFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.lockBeginFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.gameOverFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.clearLinesFrame, pOut + size);
+    size += replayEncodeVarint(pSim->state.fullRows, pOut + size);
+    size += replayEncodeVarint(pSim->state.totalClearedLines, pOut + size);
+    size += replayEncodeVarint(pSim->state.inputs, pOut + size);
+
+    return size;
+}
+
+static bool replayIsPatternType(Uint8 type)
+{
+    return type > PATTERN_NONE && type < PATTERN_MAX_VALUE;
+}
+
+// Keyframes come from files we didn't necessarily write, so everything that
+// ends up indexing a table is range checked before the sim gets to use it
+static bool replayDecodeSim(const Uint8* pData, size_t offset, size_t end, Uint64 seed, Sim_t* pSim)
+{
+    Uint64 value;
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        if (!replayDecodeVarint(pData, end, &offset, &value) ||
+            (value & ~(Uint64)SIM_ROW_FULL) != 0)
+        {
+            return false;
+        }
+
+        pSim->state.rowBits[y] = (Uint16)value;
+    }
+
+    int numCells = 0;
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        for (int x = 0; x < GRID_WIDTH; ++x)
+        {
+            if (!(pSim->state.rowBits[y] & (1 << x)))
+            {
+                pSim->cellTypes[y][x] = PATTERN_NONE;
+                continue;
+            }
+
+            if (numCells++ & 1)
+            {
+                pSim->cellTypes[y][x] = pData[offset - 1] >> 4;
+            }
+            else if (offset < end)
+            {
+                pSim->cellTypes[y][x] = pData[offset++] & 0x0F;
+            }
+            else
+            {
+                return false;
+            }
+
+            if (!replayIsPatternType(pSim->cellTypes[y][x]))
+            {
+                return false;
+            }
+        }
+    }
+
+    const size_t FixedSize = 8 + 16 + (PATTERN_MAX_VALUE - 1) + NEXT_QUEUE_SIZE + 10 + GRID_HEIGHT;
+    if (offset + FixedSize > end)
+    {
+        return false;
+    }
+
+    pSim->seed = replayReadLE(pData + offset, 8);
+    offset += 8;
+    if (pSim->seed != seed)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        pSim->state.random.State[i] = (Uint32)replayReadLE(pData + offset, 4);
+        offset += 4;
+    }
+
+    for (int i = 0; i < PATTERN_MAX_VALUE - 1; ++i)
+    {
+        pSim->state.randomBag[i] = pData[offset++];
+        if (!replayIsPatternType(pSim->state.randomBag[i]))
+        {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        pSim->state.nextQueue[i] = pData[offset++];
+        if (!replayIsPatternType(pSim->state.nextQueue[i]))
+        {
+            return false;
+        }
+    }
+
+    pSim->state.currentPatternType = pData[offset++];
+    pSim->state.holdPatternType = pData[offset++];
+    pSim->state.patternGridX = (Sint8)pData[offset++];
+    pSim->state.patternGridY = (Sint8)pData[offset++];
+    pSim->state.currentPatternRotation = pData[offset++];
+    pSim->state.randomBagIndex = pData[offset++];
+    pSim->state.nextQueueIndex = pData[offset++];
+    pSim->state.dropSpeed = pData[offset++];
+    pSim->state.currentLevel = pData[offset++];
+
+    const Uint8 CurrentType = pSim->state.currentPatternType;
+    if (!replayIsPatternType(CurrentType) ||
+        (pSim->state.holdPatternType != PATTERN_NONE &&
+         !replayIsPatternType(pSim->state.holdPatternType)) ||
+        pSim->state.currentPatternRotation >= PatternNumRotations[CurrentType] ||
+        pSim->state.randomBagIndex > PATTERN_MAX_VALUE - 1 ||
+        pSim->state.nextQueueIndex >= NEXT_QUEUE_SIZE ||
+        pSim->state.dropSpeed == 0)
+    {
+        return false;
+    }
+
+    // The current pattern may sit above the grid, but never outside the walls
+    // or below the floor, or committing it would write out of bounds
+    const Uint8 OutOfBounds = COLLIDES_LEFT | COLLIDES_RIGHT | COLLIDES_BOTTOM;
+    const Uint8 Collisions = SimBoardCollides(
+        pSim->state.rowBits,
+        g_PatternLUT[CurrentType][pSim->state.currentPatternRotation],
+        pSim->state.patternGridX,
+        pSim->state.patternGridY);
+    if (Collisions & OutOfBounds)
+    {
+        return false;
+    }
+
+    const Uint8 Flags = pData[offset++];
+    pSim->state.isPaused = (Flags & REPLAY_SIM_PAUSED) != 0;
+    pSim->state.isIntro = (Flags & REPLAY_SIM_INTRO) != 0;
+    pSim->state.isGameOver = (Flags & REPLAY_SIM_GAMEOVER) != 0;
+    pSim->state.renderCells = (Flags & REPLAY_SIM_RENDER) != 0;
+    pSim->state.hasDoneHold = (Flags & REPLAY_SIM_DID_HOLD) != 0;
+
+    pSim->state.clearRows = 0;
+    for (int i = 0; i < GRID_HEIGHT; ++i)
+    {
+        const Sint8 Y = (Sint8)pData[offset++];
+        if (Y >= 0 && Y < GRID_HEIGHT)
+        {
+            pSim->state.clearRows |= 1u << Y;
+        }
+    }
+
+    Uint32* pFrames[] = {
+        &(pSim->state.currentFrame),
+        &(pSim->state.lastDropFrame),
+        &(pSim->state.preSpawnFrame),
+        &(pSim->state.lastSpawnFrame),
+        &(pSim->state.levelUpFrame),
+        &(pSim->state.lockBeginFrame),
+        &(pSim->state.gameOverFrame),
+        &(pSim->state.clearLinesFrame),
+    };
+    for (size_t i = 0; i < sizeof(pFrames) / sizeof(pFrames[0]); ++i)
+    {
+        if (!replayDecodeVarint(pData, end, &offset, &value))
+        {
+            return false;
+        }
+
+        *pFrames[i] = (Uint32)value;
+    }
+
+    if (!replayDecodeVarint(pData, end, &offset, &value))
+    {
+        return false;
+    }
+    pSim->state.fullRows = (Uint32)value;
+
+    // Rows marked full or being cleared have to actually be full, clearing
+    // them assumes as much. Every full row is scheduled as soon as it's
+    // found, and the game over wipe empties rows itself, so no clear can be
+    // in flight during it.
+    const Uint32 MarkedRows = pSim->state.fullRows | pSim->state.clearRows;
+    if ((MarkedRows >> GRID_HEIGHT) ||
+        (pSim->state.clearRows != 0 && pSim->state.clearRows != pSim->state.fullRows) ||
+        (pSim->state.isGameOver && pSim->state.clearRows != 0))
+    {
+        return false;
+    }
+
+    for (Uint32 rows = MarkedRows; rows != 0; rows &= rows - 1)
+    {
+        if (pSim->state.rowBits[__builtin_ctz(rows)] != SIM_ROW_FULL)
+        {
+            return false;
+        }
+    }
+
+    if (!replayDecodeVarint(pData, end, &offset, &value))
+    {
+        return false;
+    }
+    pSim->state.totalClearedLines = (Uint16)value;
+
+    if (!replayDecodeVarint(pData, end, &offset, &value))
+    {
+        return false;
+    }
+    pSim->state.inputs = (Uint16)value;
+
+    SimComputeBoardFeatures(pSim->state.rowBits, &(pSim->features));
+    pSim->hash = SimComputeHash(&(pSim->state));
+    pSim->numEvents = 0;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Writing
+////////////////////////////////////////////////////////////////////////////////
+static void replayWriterFlush(ReplayWriter_t* pWriter)
+{
+    if (pWriter->BufferSize > 0)
+    {
+        fwrite(pWriter->Buffer, 1, pWriter->BufferSize, pWriter->pFile);
+        pWriter->BufferSize = 0;
+    }
+}
+
+// Appends encoded bytes, only touching the file once the buffer fills up
+static void replayWriterAppendBytes(ReplayWriter_t* pWriter, const Uint8* pBytes, size_t size)
+{
+    if (pWriter->BufferSize + size > sizeof(pWriter->Buffer))
+    {
+        replayWriterFlush(pWriter);
+    }
+
+    memcpy(pWriter->Buffer + pWriter->BufferSize, pBytes, size);
+    pWriter->BufferSize += size;
+}
+
+static void replayWriterEndRun(ReplayWriter_t* pWriter)
+{
+    if (pWriter->RunLength == 0)
+    {
+        return;
+    }
+
+    Uint8 record[2 * REPLAY_MAX_VARINT_SIZE];
+    size_t size = replayEncodeVarint(
+        ((Uint64)pWriter->RunInputs << 1) | REPLAY_RECORD_INPUTS,
+        record);
+    size += replayEncodeVarint(pWriter->RunLength, record + size);
+    replayWriterAppendBytes(pWriter, record, size);
+
+    pWriter->RunLength = 0;
+}
+
+bool ReplayWriterOpen(ReplayWriter_t* pWriter, const char* pPath, Uint64 seed)
+{
+    pWriter->pFile = fopen(pPath, "wb");
+    if (!pWriter->pFile)
+    {
+        fprintf(stderr, "Failed to open replay %s for writing\n", pPath);
+        return false;
+    }
+
+    // Our own buffer already batches writes, no point in copying twice
+    setvbuf(pWriter->pFile, NULL, _IONBF, 0);
+
+    pWriter->RunInputs = SIM_INPUT_NONE;
+    pWriter->RunLength = 0;
+    pWriter->NumFrames = 0;
+    pWriter->KeyframeInterval = REPLAY_DEFAULT_KEYFRAME_INTERVAL;
+    pWriter->BufferSize = 0;
+
+    Uint8 header[REPLAY_HEADER_SIZE];
+    memcpy(header, REPLAY_MAGIC, 4);
+    replayWriteLE(header + 4, REPLAY_FORMAT_VERSION, 2);
+    replayWriteLE(header + 6, SIM_RULESET_VERSION, 2);
+    replayWriteLE(header + 8, seed, 8);
+    replayWriterAppendBytes(pWriter, header, sizeof(header));
+
+    return true;
+}
+
+static void replayWriterAppendKeyframe(ReplayWriter_t* pWriter, const Sim_t* pSim)
+{
+    Uint8 payload[REPLAY_MAX_KEYFRAME_SIZE];
+    size_t payloadSize = replayEncodeVarint(pWriter->NumFrames, payload);
+    payloadSize += replayEncodeSim(pSim, payload + payloadSize);
+
+    Uint8 head[REPLAY_MAX_VARINT_SIZE];
+    const size_t HeadSize = replayEncodeVarint(
+        ((Uint64)payloadSize << 1) | REPLAY_RECORD_KEYFRAME,
+        head);
+    replayWriterAppendBytes(pWriter, head, HeadSize);
+    replayWriterAppendBytes(pWriter, payload, payloadSize);
+}
+
+// Records the inputs about to be passed to SimStep() along with pSim, the
+// state they'll be applied to
+void ReplayWriterAppend(ReplayWriter_t* pWriter, const Sim_t* pSim, Uint16 inputs)
+{
+    const bool IsKeyframe =
+        pWriter->KeyframeInterval > 0 &&
+        pWriter->NumFrames > 0 &&
+        (pWriter->NumFrames % pWriter->KeyframeInterval) == 0;
+    if (IsKeyframe)
+    {
+        replayWriterEndRun(pWriter);
+        replayWriterAppendKeyframe(pWriter, pSim);
+    }
+
+    if (inputs != pWriter->RunInputs || pWriter->RunLength == REPLAY_MAX_RUN_LENGTH)
+    {
+        replayWriterEndRun(pWriter);
+        pWriter->RunInputs = inputs;
+    }
+
+    pWriter->RunLength++;
+    pWriter->NumFrames++;
+}
+
+bool ReplayWriterClose(ReplayWriter_t* pWriter)
+{
+    if (!pWriter->pFile)
+    {
+        return false;
+    }
+
+    replayWriterEndRun(pWriter);
+    replayWriterFlush(pWriter);
+
+    const bool Succeeded = !ferror(pWriter->pFile);
+    if (fclose(pWriter->pFile) != 0 || !Succeeded)
+    {
+        fprintf(stderr, "Failed to write replay\n");
+        pWriter->pFile = NULL;
+        return false;
+    }
+
+    pWriter->pFile = NULL;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reading
+////////////////////////////////////////////////////////////////////////////////
+void ReplayReaderClose(ReplayReader_t* pReader)
+{
+    free(pReader->pData);
+    free(pReader->pKeyframes);
+    pReader->pData = NULL;
+    pReader->pKeyframes = NULL;
+    pReader->NumKeyframes = 0;
+    pReader->Size = 0;
+    pReader->Offset = 0;
+}
+
+// Reads the head of the record at pReader->Offset
+static bool replayReadRecordHead(ReplayReader_t* pReader, Uint64* pHeadOut, size_t* pEndOut)
+{
+    if (!replayDecodeVarint(pReader->pData, pReader->Size, &(pReader->Offset), pHeadOut))
+    {
+        return false;
+    }
+
+    if ((*pHeadOut & 1) == REPLAY_RECORD_KEYFRAME)
+    {
+        *pEndOut = pReader->Offset + (*pHeadOut >> 1);
+        return *pEndOut <= pReader->Size;
+    }
+
+    Uint64 runLength;
+    if (!replayDecodeVarint(pReader->pData, pReader->Size, &(pReader->Offset), &runLength) ||
+        runLength > REPLAY_MAX_RUN_LENGTH)
+    {
+        return false;
+    }
+
+    *pEndOut = (size_t)runLength;
+    return true;
+}
+
+// Walks every record once, validating the stream, counting frames and
+// indexing keyframes
+static bool replayIndexRecords(ReplayReader_t* pReader)
+{
+    size_t capacity = 0;
+    pReader->Offset = REPLAY_HEADER_SIZE;
+    pReader->NumFrames = 0;
+    while (pReader->Offset < pReader->Size)
+    {
+        Uint64 head;
+        size_t endOrRun;
+        if (!replayReadRecordHead(pReader, &head, &endOrRun))
+        {
+            return false;
+        }
+
+        if ((head & 1) == REPLAY_RECORD_INPUTS)
+        {
+            pReader->NumFrames += endOrRun;
+            continue;
+        }
+
+        ReplayKeyframe_t keyframe;
+        keyframe.Offset = pReader->Offset;
+        keyframe.End = endOrRun;
+        if (!replayDecodeVarint(pReader->pData, keyframe.End, &(keyframe.Offset), &(keyframe.Frame)) ||
+            keyframe.Frame != pReader->NumFrames)
+        {
+            return false;
+        }
+
+        if (pReader->NumKeyframes == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            ReplayKeyframe_t* pGrown = realloc(pReader->pKeyframes, capacity * sizeof(ReplayKeyframe_t));
+            if (!pGrown)
+            {
+                return false;
+            }
+
+            pReader->pKeyframes = pGrown;
+        }
+
+        pReader->pKeyframes[pReader->NumKeyframes++] = keyframe;
+        pReader->Offset = keyframe.End;
+    }
+
+    pReader->Offset = REPLAY_HEADER_SIZE;
+    return true;
+}
+
+bool ReplayReaderOpen(ReplayReader_t* pReader, const char* pPath)
+{
+    memset(pReader, 0, sizeof(*pReader));
+
+    FILE* pFile = fopen(pPath, "rb");
+    if (!pFile)
+    {
+        fprintf(stderr, "Failed to open replay %s\n", pPath);
+        return false;
+    }
+
+    fseek(pFile, 0, SEEK_END);
+    const long FileSize = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+
+    if (FileSize < REPLAY_HEADER_SIZE)
+    {
+        fprintf(stderr, "Replay %s is too short\n", pPath);
+        fclose(pFile);
+        return false;
+    }
+
+    pReader->pData = malloc(FileSize);
+    if (!pReader->pData ||
+        fread(pReader->pData, 1, FileSize, pFile) != (size_t)FileSize)
+    {
+        fprintf(stderr, "Failed to read replay %s\n", pPath);
+        fclose(pFile);
+        free(pReader->pData);
+        pReader->pData = NULL;
+        return false;
+    }
+
+    fclose(pFile);
+    pReader->Size = FileSize;
+
+    const Uint16 FormatVersion = (Uint16)replayReadLE(pReader->pData + 4, 2);
+    const Uint16 Ruleset = (Uint16)replayReadLE(pReader->pData + 6, 2);
+    // Version 1 is version 2 without keyframes
+    if (memcmp(pReader->pData, REPLAY_MAGIC, 4) != 0 ||
+        FormatVersion < 1 || FormatVersion > REPLAY_FORMAT_VERSION)
+    {
+        fprintf(stderr, "%s is not a supported replay\n", pPath);
+        ReplayReaderClose(pReader);
+        return false;
+    }
+
+    if (Ruleset != SIM_RULESET_VERSION)
+    {
+        fprintf(stderr,
+            "Replay %s was recorded with ruleset %hu, this build plays %d\n",
+            pPath,
+            Ruleset,
+            SIM_RULESET_VERSION);
+        ReplayReaderClose(pReader);
+        return false;
+    }
+
+    pReader->Seed = replayReadLE(pReader->pData + 8, 8);
+    if (!replayIndexRecords(pReader))
+    {
+        fprintf(stderr, "Replay %s is corrupt at byte %zu\n", pPath, pReader->Offset);
+        ReplayReaderClose(pReader);
+        return false;
+    }
+
+    return true;
+}
+
+// Produces the inputs for the next frame. Returns false once the replay is
+// exhausted (or turns out to be truncated).
+bool ReplayReaderNext(ReplayReader_t* pReader, Uint16* pInputsOut)
+{
+    while (pReader->RunRemaining == 0)
+    {
+        if (pReader->Offset >= pReader->Size)
+        {
+            return false;
+        }
+
+        // Already validated on open
+        Uint64 head;
+        size_t endOrRun;
+        replayReadRecordHead(pReader, &head, &endOrRun);
+        if ((head & 1) == REPLAY_RECORD_KEYFRAME)
+        {
+            pReader->Offset = endOrRun;
+            continue;
+        }
+
+        pReader->RunInputs = (Uint16)(head >> 1);
+        pReader->RunRemaining = (Uint32)endOrRun;
+    }
+
+    pReader->RunRemaining--;
+    pReader->Frame++;
+    *pInputsOut = pReader->RunInputs;
+    return true;
+}
+
+// Whether keyframe `index` agrees with pSim, the state re-simulated from the
+// seed up to the keyframe's frame. Compares encodings, so every field the
+// keyframe stores has to match.
+bool ReplayKeyframeMatches(const ReplayReader_t* pReader, size_t index, const Sim_t* pSim)
+{
+    const ReplayKeyframe_t* pKeyframe = &(pReader->pKeyframes[index]);
+    Uint8 encoded[REPLAY_MAX_KEYFRAME_SIZE];
+    const size_t Size = replayEncodeSim(pSim, encoded);
+    return Size == pKeyframe->End - pKeyframe->Offset &&
+        memcmp(encoded, pReader->pData + pKeyframe->Offset, Size) == 0;
+}
+
+// Puts pSim in the state it was in right before replay frame `frame` was
+// stepped, restoring the closest keyframe and simulating forward from there.
+// Subsequent ReplayReaderNext() calls continue from that frame.
+bool ReplaySeek(ReplayReader_t* pReader, Sim_t* pSim, Uint64 frame)
+{
+    if (frame > pReader->NumFrames)
+    {
+        return false;
+    }
+
+    // Last keyframe at or before the target
+    size_t low = 0;
+    size_t high = pReader->NumKeyframes;
+    while (low < high)
+    {
+        const size_t Mid = (low + high) / 2;
+        if (pReader->pKeyframes[Mid].Frame <= frame)
+        {
+            low = Mid + 1;
+        }
+        else
+        {
+            high = Mid;
+        }
+    }
+
+    if (low > 0)
+    {
+        const ReplayKeyframe_t* pKeyframe = &(pReader->pKeyframes[low - 1]);
+        if (!replayDecodeSim(pReader->pData, pKeyframe->Offset, pKeyframe->End, pReader->Seed, pSim))
+        {
+            fprintf(stderr, "Replay keyframe at frame %llu is corrupt\n",
+                (unsigned long long)pKeyframe->Frame);
+            return false;
+        }
+
+        pReader->Offset = pKeyframe->End;
+        pReader->Frame = pKeyframe->Frame;
+    }
+    else
+    {
+        SimInitialize(pSim, pReader->Seed);
+        pReader->Offset = REPLAY_HEADER_SIZE;
+        pReader->Frame = 0;
+    }
+
+    pReader->RunRemaining = 0;
+
+    Uint16 inputs;
+    while (pReader->Frame < frame && ReplayReaderNext(pReader, &inputs))
+    {
+        SimStep(pSim, inputs);
+    }
+
+    return true;
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+// Single producer, single consumer ring of fixed size step records in POSIX
+// shared memory. The producer (a batch worker) writes records in place and
+// publishes them by bumping Head; the consumer (a trainer in another
+// process) maps the same memory, reads records in place and hands slots back
+// by bumping Tail. Neither side makes a syscall or copies a record once the
+// ring is mapped.
+//
+// Layout of the mapping, all little endian:
+//   0    ShmRingHeader_t, 3 cache lines: constants, Head, Tail
+//   192  Capacity records of RecordSize bytes (ShmRingRecord_t)
+//
+// Head and Tail count records since the ring was created, the slot for
+// record n is n & (Capacity - 1). Records [Tail, Head) are readable. The
+// producer sets IsClosed once it has published its last record, or once it
+// gives up on a consumer that stopped draining the ring.
+
+#include "lil-tetris-sim.c"
+
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHMRING_MAGIC 0x5253544Cu // "LTSR"
+#define SHMRING_VERSION 1
+#define SHMRING_CACHE_LINE 64
+#define SHMRING_DEFAULT_CAPACITY (1 << 16)
+#define SHMRING_MAX_CAPACITY (1u << 22) // 512MB of records
+
+// How long a producer waits on a full ring before deciding nobody is
+// reading it
+#define SHMRING_DEFAULT_TIMEOUT_MILLIS 10000
+
+enum
+{
+    // The step ended the game; the record holds the final board
+    SHMRING_RECORD_DONE = 1 << 0,
+};
+
+// One record per placed pattern, plus one when the game ends
+typedef struct
+{
+    Uint64             Seed;
+    Uint64             Hash;
+    Uint32             Frame;
+    float              Reward;      // Lines cleared since the previous record
+    Uint16             RowBits[GRID_HEIGHT];
+    SimBoardFeatures_t Features;
+    Uint8              CurrentPatternType;
+    Uint8              HoldPatternType;
+    Uint8              NextQueue[NEXT_QUEUE_SIZE]; // Next first
+    Uint8              Flags;
+    Uint8              Reserved[21];
+} ShmRingRecord_t;
+
+_Static_assert(sizeof(ShmRingRecord_t) == 2 * SHMRING_CACHE_LINE, "ShmRingRecord_t should fill two cache lines");
+
+typedef struct
+{
+    _Alignas(SHMRING_CACHE_LINE)
+    Uint32        Magic;
+    Uint16        Version;
+    Uint16        RecordSize;
+    Uint32        Capacity; // Records, a power of two
+    atomic_uint   IsClosed;
+
+    // Each index on its own line so the two sides don't false share
+    _Alignas(SHMRING_CACHE_LINE)
+    atomic_ullong Head;
+
+    _Alignas(SHMRING_CACHE_LINE)
+    atomic_ullong Tail;
+} ShmRingHeader_t;
+
+typedef struct
+{
+    ShmRingHeader_t* pHeader;
+    ShmRingRecord_t* pRecords;
+    size_t           MappedSize;
+    Uint64           Mask;
+    Uint64           Head;       // Producer: next record to publish
+    Uint64           Tail;       // Consumer: next record to read
+    Uint64           CachedTail; // Producer: last Tail seen, refreshed when the ring looks full
+    Uint32           TimeoutMillis; // Producer: longest wait for a free slot, 0 to wait forever
+    bool             IsProducer;
+    char             Name[128];
+} ShmRing_t;
+
+static size_t shmRingMappedSize(Uint32 capacity)
+{
+    return sizeof(ShmRingHeader_t) + (size_t)capacity * sizeof(ShmRingRecord_t);
+}
+
+static Uint64 shmRingNowMillis()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64)now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+}
+
+static bool shmRingMap(ShmRing_t* pRing, int fd, size_t size)
+{
+    void* pMapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pMapping == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed to map shared memory ring %s\n", pRing->Name);
+        return false;
+    }
+
+    pRing->pHeader = (ShmRingHeader_t*)pMapping;
+    pRing->pRecords = (ShmRingRecord_t*)((Uint8*)pMapping + sizeof(ShmRingHeader_t));
+    pRing->MappedSize = size;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Producer
+////////////////////////////////////////////////////////////////////////////////
+
+// Creates the ring named pName (a POSIX shared memory name such as
+// "/lil-tetris-0"), replacing any stale ring of the same name. capacity is
+// rounded up to a power of two and can't exceed SHMRING_MAX_CAPACITY.
+bool ShmRingCreate(ShmRing_t* pRing, const char* pName, Uint32 capacity)
+{
+    memset(pRing, 0, sizeof(*pRing));
+    snprintf(pRing->Name, sizeof(pRing->Name), "%s", pName);
+    pRing->IsProducer = true;
+    pRing->TimeoutMillis = SHMRING_DEFAULT_TIMEOUT_MILLIS;
+
+    if (capacity == 0 || capacity > SHMRING_MAX_CAPACITY)
+    {
+        fprintf(stderr,
+            "Shared memory ring %s should hold 1 to %u records\n",
+            pName,
+            SHMRING_MAX_CAPACITY);
+        return false;
+    }
+
+    Uint32 roundedCapacity = 1;
+    while (roundedCapacity < capacity)
+    {
+        roundedCapacity <<= 1;
+    }
+
+    shm_unlink(pName);
+    const int Fd = shm_open(pName, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (Fd < 0)
+    {
+        fprintf(stderr, "Failed to create shared memory ring %s\n", pName);
+        return false;
+    }
+
+    const size_t Size = shmRingMappedSize(roundedCapacity);
+    if (ftruncate(Fd, Size) != 0)
+    {
+        fprintf(stderr, "Failed to size shared memory ring %s\n", pName);
+        close(Fd);
+        shm_unlink(pName);
+        return false;
+    }
+
+    if (!shmRingMap(pRing, Fd, Size))
+    {
+        shm_unlink(pName);
+        return false;
+    }
+
+    ShmRingHeader_t* pHeader = pRing->pHeader;
+    pHeader->Version = SHMRING_VERSION;
+    pHeader->RecordSize = sizeof(ShmRingRecord_t);
+    pHeader->Capacity = roundedCapacity;
+    atomic_init(&(pHeader->IsClosed), 0);
+    atomic_init(&(pHeader->Head), 0);
+    atomic_init(&(pHeader->Tail), 0);
+
+    // Consumers wait for the magic before trusting anything else
+    atomic_thread_fence(memory_order_release);
+    pHeader->Magic = SHMRING_MAGIC;
+
+    pRing->Mask = roundedCapacity - 1;
+    return true;
+}
+
+// The slot for the next record, valid until ShmRingPublish. Waits for the
+// consumer while the ring is full, and returns NULL if it doesn't free a
+// slot within TimeoutMillis; there's most likely no consumer left.
+ShmRingRecord_t* ShmRingReserve(ShmRing_t* pRing)
+{
+    const Uint64 Capacity = pRing->Mask + 1;
+    bool isWaiting = false;
+    Uint64 waitStartMillis = 0;
+    while (pRing->Head - pRing->CachedTail >= Capacity)
+    {
+        pRing->CachedTail = atomic_load_explicit(&(pRing->pHeader->Tail), memory_order_acquire);
+        if (pRing->Head - pRing->CachedTail < Capacity)
+        {
+            break;
+        }
+
+        const Uint64 NowMillis = shmRingNowMillis();
+        if (!isWaiting)
+        {
+            isWaiting = true;
+            waitStartMillis = NowMillis;
+        }
+        else if (pRing->TimeoutMillis > 0 &&
+                 NowMillis - waitStartMillis >= pRing->TimeoutMillis)
+        {
+            return NULL;
+        }
+
+        sched_yield();
+    }
+
+    return &(pRing->pRecords[pRing->Head & pRing->Mask]);
+}
+
+void ShmRingPublish(ShmRing_t* pRing)
+{
+    pRing->Head++;
+    atomic_store_explicit(&(pRing->pHeader->Head), pRing->Head, memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Consumer
+////////////////////////////////////////////////////////////////////////////////
+bool ShmRingOpen(ShmRing_t* pRing, const char* pName)
+{
+    memset(pRing, 0, sizeof(*pRing));
+    snprintf(pRing->Name, sizeof(pRing->Name), "%s", pName);
+
+    const int Fd = shm_open(pName, O_RDWR, 0600);
+    if (Fd < 0)
+    {
+        fprintf(stderr, "Failed to open shared memory ring %s\n", pName);
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(Fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(ShmRingHeader_t))
+    {
+        fprintf(stderr, "Shared memory ring %s isn't ready\n", pName);
+        close(Fd);
+        return false;
+    }
+
+    if (!shmRingMap(pRing, Fd, fileStat.st_size))
+    {
+        return false;
+    }
+
+    const ShmRingHeader_t* pHeader = pRing->pHeader;
+    if (pHeader->Magic != SHMRING_MAGIC ||
+        pHeader->Version != SHMRING_VERSION ||
+        pHeader->RecordSize != sizeof(ShmRingRecord_t) ||
+        shmRingMappedSize(pHeader->Capacity) > pRing->MappedSize)
+    {
+        fprintf(stderr, "Shared memory ring %s isn't a version %d ring\n", pName, SHMRING_VERSION);
+        munmap(pRing->pHeader, pRing->MappedSize);
+        pRing->pHeader = NULL;
+        return false;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    pRing->Mask = pHeader->Capacity - 1;
+    pRing->Tail = atomic_load_explicit(&(pRing->pHeader->Tail), memory_order_relaxed);
+    return true;
+}
+
+// The oldest unread record, or NULL if there's none yet. Check IsClosed
+// after a NULL to tell a slow producer from a finished one.
+const ShmRingRecord_t* ShmRingPeek(ShmRing_t* pRing)
+{
+    const Uint64 Head = atomic_load_explicit(&(pRing->pHeader->Head), memory_order_acquire);
+    if (pRing->Tail == Head)
+    {
+        return NULL;
+    }
+
+    return &(pRing->pRecords[pRing->Tail & pRing->Mask]);
+}
+
+// Hands the record from ShmRingPeek back to the producer
+void ShmRingRelease(ShmRing_t* pRing)
+{
+    pRing->Tail++;
+    atomic_store_explicit(&(pRing->pHeader->Tail), pRing->Tail, memory_order_release);
+}
+
+bool ShmRingIsClosed(const ShmRing_t* pRing)
+{
+    return atomic_load_explicit(&(pRing->pHeader->IsClosed), memory_order_acquire) != 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The producer marks the ring closed so its consumer can finish draining it.
+// The shared memory name stays until the consumer, or the next ShmRingCreate,
+// unlinks it.
+void ShmRingClose(ShmRing_t* pRing)
+{
+    if (!pRing->pHeader)
+    {
+        return;
+    }
+
+    if (pRing->IsProducer)
+    {
+        atomic_store_explicit(&(pRing->pHeader->IsClosed), 1, memory_order_release);
+    }
+
+    munmap(pRing->pHeader, pRing->MappedSize);
+    pRing->pHeader = NULL;
+    pRing->pRecords = NULL;
+}
@@ -0,0 +1,1283 @@
+#pragma once
+
+// Headless game simulation. Everything in here runs without a window, audio
+// device or renderer; presentation side effects are reported as events which
+// the front end (or nobody, for bots) consumes after each SimStep().
+
+#include "lil-tetris-types.c"
+#include "lil-tetris-patterns.c"
+#include "lil-tetris-random.c"
+
+#include <assert.h>
+
+#define FPS 60.0f
+
+#define GRID_HEIGHT 20
+#define GRID_WIDTH 10
+
+// Bit x of a grid row is set when column x is occupied
+#define SIM_ROW_FULL ((Uint16)((1 << GRID_WIDTH) - 1))
+
+#define SPAWN_DELAY_FRAMES 6
+#define CLEAR_LINES_FRAMES 15
+
+#define GAMEOVER_ANIM_DURATION_FRAMES 60
+#define GAMEOVER_SHOW_RETRY_FRAMES 90
+
+#define LOCK_DELAY_FRAMES 60
+
+#define START_DROP_SPEED 1
+
+#define NEXT_QUEUE_SIZE 4
+
+#define LEVELUP_LINE_INTERVAL 10
+
+#define SIM_MAX_EVENTS 32
+
+// Bump whenever the same seed and inputs would play out differently, so old
+// replays are rejected instead of silently desyncing
+#define SIM_RULESET_VERSION 1
+
+// Per-frame inputs, already debounced/repeated by whoever drives the sim
+typedef enum
+{
+    SIM_INPUT_NONE          = 0,
+    SIM_INPUT_LEFT          = 1 << 0,
+    SIM_INPUT_RIGHT         = 1 << 1,
+    SIM_INPUT_DOWN          = 1 << 2,  // Soft drop, with repeat
+    SIM_INPUT_DOWN_PRESSED  = 1 << 3,  // Soft drop, initial press only
+    SIM_INPUT_UP            = 1 << 4,  // Hard drop
+    SIM_INPUT_ROTATE_RIGHT  = 1 << 5,
+    SIM_INPUT_ROTATE_LEFT   = 1 << 6,
+    SIM_INPUT_HOLD          = 1 << 7,
+    SIM_INPUT_PAUSE         = 1 << 8,
+    SIM_INPUT_BEGIN         = 1 << 9,
+    SIM_INPUT_RETRY         = 1 << 10,
+} SimInputFlags;
+
+typedef enum
+{
+    SIM_EVENT_COMMIT,        // Pattern committed to the grid
+    SIM_EVENT_HARD_DROP,     // X/Y is the pre-drop position, Count the distance
+    SIM_EVENT_LINE_CLEAR,    // Y is the row, RowTypes what was in it
+    SIM_EVENT_LINES_CLEARED, // Count is the number of lines in this drop
+    SIM_EVENT_LEVEL_UP,
+    SIM_EVENT_GAME_OVER,     // First frame of the game over animation
+    SIM_EVENT_PAUSE,
+    SIM_EVENT_RESUME,
+    SIM_EVENT_RETRY,
+} SimEventType;
+
+typedef struct
+{
+    SimEventType  Type;
+    PatternType_t PatternType;
+    Uint8         Rotation;
+    Sint8         X;
+    Sint8         Y;
+    Uint8         Count;
+    Uint8         RowTypes[GRID_WIDTH];
+} SimEvent_t;
+
+// Surface features of a board. Kept up to date incrementally by the sim and
+// reusable by evaluators that want the same numbers for candidate boards.
+typedef struct
+{
+    Uint8      columnHeights[GRID_WIDTH]; // 0 for an empty column
+    Uint8      columnHoles[GRID_WIDTH];   // Empty cells below the column top
+    Uint16     aggregateHeight;
+    Uint16     holes;
+    Uint16     bumpiness;                 // Sum of neighbouring height deltas
+    Uint16     wells;                     // Sum of well depths, walls included
+    Uint8      maxHeight;
+} SimBoardFeatures_t;
+
+// Everything that decides how the game plays out from here, packed tightly
+// so searches and rollback can snapshot a position with one small copy
+typedef struct
+{
+    Uint16     rowBits[GRID_HEIGHT];
+    Random_t   random; // Gameplay randomness only, never cosmetics
+    Uint32     currentFrame;
+    Uint32     lastDropFrame;
+    Uint32     preSpawnFrame;
+    Uint32     lastSpawnFrame;
+    Uint32     levelUpFrame;
+    Uint32     lockBeginFrame;
+    Uint32     gameOverFrame;
+    Uint32     clearLinesFrame;
+    Uint32     fullRows;  // Bit y is set while row y is completely filled
+    Uint32     clearRows; // Bit y is set while row y is being cleared
+    Uint16     totalClearedLines;
+    Uint16     inputs;
+    Uint8      randomBag[PATTERN_MAX_VALUE - 1]; // PatternType_t
+    Uint8      nextQueue[NEXT_QUEUE_SIZE];       // PatternType_t
+    Uint8      currentPatternType;
+    Uint8      holdPatternType;
+    Sint8      patternGridX;
+    Sint8      patternGridY;
+    Uint8      currentPatternRotation;
+    Uint8      randomBagIndex;
+    Uint8      nextQueueIndex;
+    Uint8      dropSpeed;
+    Uint8      currentLevel;
+    bool       isPaused : 1;
+    bool       isIntro : 1;
+    bool       isGameOver : 1;
+    bool       renderCells : 1;
+    bool       hasDoneHold : 1;
+} SimState_t;
+
+_Static_assert(sizeof(SimState_t) <= 128, "SimState_t should stay snapshot sized");
+
+// The state plus what's derived from it or only matters for presentation:
+// board features (recomputed from the rows), cell colors and events.
+typedef struct
+{
+    SimState_t state;
+    Uint64     seed;
+    Uint8      cellTypes[GRID_HEIGHT][GRID_WIDTH]; // PatternType_t, for colors
+    SimBoardFeatures_t features;
+    Uint64     hash; // Zobrist hash of the rows, current, hold and queue
+    Uint8      numEvents;
+    SimEvent_t events[SIM_MAX_EVENTS];
+} Sim_t;
+
+static Pattern*** g_PatternLUT = g_AllPatternRotations;
+
+static SimEvent_t* pushEvent(Sim_t* pSim, SimEventType type)
+{
+    if (pSim->numEvents >= SIM_MAX_EVENTS)
+    {
+        // Dropping presentation events never affects the simulation itself
+        return NULL;
+    }
+
+    SimEvent_t* pEvent = &(pSim->events[pSim->numEvents]);
+    memset(pEvent, 0, sizeof(*pEvent));
+    pEvent->Type = type;
+
+    pSim->numEvents++;
+    return pEvent;
+}
+
+void SimGetSpawnPosition(PatternType_t patternType, Sint8* pXOut, Sint8* pYOut)
+{
+    Pattern* pPattern = g_PatternLUT[patternType][0];
+    *pXOut = (GRID_WIDTH / 2) - (pPattern->cols / 2);
+    *pYOut = -pPattern->rows;
+}
+
+static void resetRandomBag(Sim_t* pSim)
+{
+    // Initialize
+    const Uint8 Begin = (Uint8)(PATTERN_NONE + 1);
+    const Uint8 End = (Uint8)PATTERN_MAX_VALUE;
+    for (Uint8 i = Begin; i < End; ++i)
+    {
+        pSim->state.randomBag[i - 1] = i;
+    }
+
+    // Fisher-Yates shuffle
+    const Uint8 NumElements =
+        sizeof(pSim->state.randomBag) /
+        sizeof(pSim->state.randomBag[0]);
+    for (Uint8 i = NumElements - 1; i > 0; --i)
+    {
+        const Uint8 j = RandomRange(&(pSim->state.random), i + 1);
+
+        const PatternType_t temp = pSim->state.randomBag[i];
+        pSim->state.randomBag[i] = pSim->state.randomBag[j];
+        pSim->state.randomBag[j] = temp;
+    }
+
+    pSim->state.randomBagIndex = 0;
+}
+
+static PatternType_t nextPatternTypeFromRandomBag(Sim_t* pSim)
+{
+    const Uint8 NumElements =
+        sizeof(pSim->state.randomBag) /
+        sizeof(pSim->state.randomBag[0]);
+    if (pSim->state.randomBagIndex >= NumElements)
+    {
+        resetRandomBag(pSim);
+    }
+
+    PatternType_t nextType = pSim->state.randomBag[pSim->state.randomBagIndex];
+    pSim->state.randomBagIndex++;
+
+    return nextType;
+}
+
+static void initializeNextQueue(Sim_t* pSim)
+{
+    resetRandomBag(pSim);
+    for (Uint8 i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        pSim->state.nextQueue[i] = nextPatternTypeFromRandomBag(pSim);
+    }
+
+    pSim->state.nextQueueIndex = 0;
+}
+
+static PatternType_t popFromNextQueue(Sim_t* pSim)
+{
+    PatternType_t returnValue = pSim->state.nextQueue[pSim->state.nextQueueIndex];
+    pSim->state.nextQueueIndex = (pSim->state.nextQueueIndex + 1) % NEXT_QUEUE_SIZE;
+
+    // Tail always sits NEXT_QUEUE_SIZE - 1 slots ahead
+    Uint8 nextQueueTail = (pSim->state.nextQueueIndex + (NEXT_QUEUE_SIZE - 1)) % NEXT_QUEUE_SIZE;
+
+    pSim->state.nextQueue[nextQueueTail] = nextPatternTypeFromRandomBag(pSim);
+    return returnValue;
+}
+
+PatternType_t SimTopFromNextQueue(const Sim_t* pSim)
+{
+    return pSim->state.nextQueue[pSim->state.nextQueueIndex];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Board features
+////////////////////////////////////////////////////////////////////////////////
+static void updateAggregateFeatures(SimBoardFeatures_t* pFeatures)
+{
+    pFeatures->aggregateHeight = 0;
+    pFeatures->holes = 0;
+    pFeatures->bumpiness = 0;
+    pFeatures->wells = 0;
+    pFeatures->maxHeight = 0;
+    for (int x = 0; x < GRID_WIDTH; ++x)
+    {
+        const int Height = pFeatures->columnHeights[x];
+        pFeatures->aggregateHeight += Height;
+        pFeatures->holes += pFeatures->columnHoles[x];
+        pFeatures->maxHeight = Height > pFeatures->maxHeight ? Height : pFeatures->maxHeight;
+
+        if (x > 0)
+        {
+            const int Delta = Height - pFeatures->columnHeights[x - 1];
+            pFeatures->bumpiness += Delta < 0 ? -Delta : Delta;
+        }
+
+        const int LeftHeight = x > 0 ? pFeatures->columnHeights[x - 1] : GRID_HEIGHT;
+        const int RightHeight = x < (GRID_WIDTH - 1) ? pFeatures->columnHeights[x + 1] : GRID_HEIGHT;
+        const int WallHeight = LeftHeight < RightHeight ? LeftHeight : RightHeight;
+        if (WallHeight > Height)
+        {
+            pFeatures->wells += WallHeight - Height;
+        }
+    }
+}
+
+static void computeColumnFeatures(
+    const Uint16* pRowBits,
+    int x,
+    SimBoardFeatures_t* pFeatures)
+{
+    const Uint16 ColumnBit = 1 << x;
+    int y = 0;
+    while (y < GRID_HEIGHT && !(pRowBits[y] & ColumnBit))
+    {
+        ++y;
+    }
+
+    pFeatures->columnHeights[x] = GRID_HEIGHT - y;
+    pFeatures->columnHoles[x] = 0;
+    for (; y < GRID_HEIGHT; ++y)
+    {
+        if (!(pRowBits[y] & ColumnBit))
+        {
+            pFeatures->columnHoles[x]++;
+        }
+    }
+}
+
+// From-scratch computation, for boards the sim isn't tracking
+void SimComputeBoardFeatures(const Uint16* pRowBits, SimBoardFeatures_t* pFeatures)
+{
+    for (int x = 0; x < GRID_WIDTH; ++x)
+    {
+        computeColumnFeatures(pRowBits, x, pFeatures);
+    }
+
+    updateAggregateFeatures(pFeatures);
+}
+
+// Pattern cells at (gridX, gridY) were just added to the board. Cells may
+// land above the column top or fill holes below it.
+void
+SimFeaturesAddPattern(
+    SimBoardFeatures_t* pFeatures,
+    const Pattern* pPattern,
+    Sint8 gridX,
+    Sint8 gridY)
+{
+    for (Sint8 x = pPattern->minCol; x <= pPattern->maxCol; ++x)
+    {
+        if (pPattern->colTops[x] < 0)
+        {
+            continue;
+        }
+
+        int cellsAdded = 0;
+        for (Sint8 y = pPattern->colTops[x]; y <= pPattern->colBottoms[x]; ++y)
+        {
+            cellsAdded += pPattern->occupancy[y][x] ? 1 : 0;
+        }
+
+        // Filled cells in a column are always its height minus its holes
+        const int Column = gridX + x;
+        const int OldHeight = pFeatures->columnHeights[Column];
+        const int TopHeight = GRID_HEIGHT - (gridY + pPattern->colTops[x]);
+        const int NewHeight = TopHeight > OldHeight ? TopHeight : OldHeight;
+        pFeatures->columnHoles[Column] += (NewHeight - OldHeight) - cellsAdded;
+        pFeatures->columnHeights[Column] = NewHeight;
+    }
+
+    updateAggregateFeatures(pFeatures);
+}
+
+// clearedRows (bit per row) were full and have been collapsed out of
+// pRowBits. Full rows never contain holes, so a column only needs a rescan
+// when its top cell was one of the cleared rows.
+void
+SimFeaturesRemoveRows(
+    SimBoardFeatures_t* pFeatures,
+    const Uint16* pRowBits,
+    Uint32 clearedRows)
+{
+    const int NumCleared = __builtin_popcount(clearedRows);
+    for (int x = 0; x < GRID_WIDTH; ++x)
+    {
+        const int TopY = GRID_HEIGHT - pFeatures->columnHeights[x];
+        if (clearedRows & (1u << TopY))
+        {
+            computeColumnFeatures(pRowBits, x, pFeatures);
+        }
+        else
+        {
+            pFeatures->columnHeights[x] -= NumCleared;
+        }
+    }
+
+    updateAggregateFeatures(pFeatures);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Zobrist hashing. Every filled cell and every pattern type in the current,
+// hold and (relative) queue slots has a random key, and the hash is the XOR
+// of all of them. The sim keeps pSim->hash up to date as cells and patterns
+// change, so it's a free key for search caches and a cheap desync check.
+// Keys come from a fixed seed and match across runs and machines.
+////////////////////////////////////////////////////////////////////////////////
+#define SIM_ZOBRIST_SEED 0x4C494C54455452ull
+
+typedef struct
+{
+    Uint64 Cells[GRID_HEIGHT][GRID_WIDTH];
+    Uint64 Current[PATTERN_MAX_VALUE];
+    Uint64 Hold[PATTERN_MAX_VALUE];
+    Uint64 Queue[NEXT_QUEUE_SIZE][PATTERN_MAX_VALUE];
+} SimZobrist_t;
+
+static SimZobrist_t g_SimZobrist;
+
+static void initializeZobrist()
+{
+    Uint64 seed = SIM_ZOBRIST_SEED;
+    Uint64* pKeys = (Uint64*)&g_SimZobrist;
+    for (size_t i = 0; i < sizeof(g_SimZobrist) / sizeof(Uint64); ++i)
+    {
+        pKeys[i] = randomSplitMix64(&seed);
+    }
+}
+
+static pthread_once_t g_SimZobristOnce = PTHREAD_ONCE_INIT;
+
+// Builds the tables every sim shares, pattern masks and Zobrist keys. Only
+// the first call does any work. Call it at startup, before any sims are
+// created.
+void SimInitializeTables()
+{
+    PatternInitializeMasks();
+    pthread_once(&g_SimZobristOnce, initializeZobrist);
+}
+
+// Hash of the cells set in rowBits on row y. XOR it in to add them, XOR it
+// again to take them away.
+Uint64 SimHashRow(Sint8 y, Uint16 rowBits)
+{
+    Uint64 hash = 0;
+    while (rowBits)
+    {
+        hash ^= g_SimZobrist.Cells[y][__builtin_ctz(rowBits)];
+        rowBits &= rowBits - 1;
+    }
+
+    return hash;
+}
+
+Uint64 SimHashBoard(const Uint16* pRowBits)
+{
+    Uint64 hash = 0;
+    for (Sint8 y = 0; y < GRID_HEIGHT; ++y)
+    {
+        hash ^= SimHashRow(y, pRowBits[y]);
+    }
+
+    return hash;
+}
+
+// pQueue holds the upcoming patterns in order, any past queueLength count as
+// empty
+Uint64
+SimHashPatterns(
+    PatternType_t current,
+    PatternType_t hold,
+    const Uint8* pQueue,
+    int queueLength)
+{
+    Uint64 hash = g_SimZobrist.Current[current] ^ g_SimZobrist.Hold[hold];
+    for (int i = 0; i < queueLength && i < NEXT_QUEUE_SIZE; ++i)
+    {
+        hash ^= g_SimZobrist.Queue[i][pQueue[i]];
+    }
+
+    return hash;
+}
+
+static Uint64 hashStatePatterns(const SimState_t* pState)
+{
+    Uint8 queue[NEXT_QUEUE_SIZE];
+    for (int i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        queue[i] = pState->nextQueue[(pState->nextQueueIndex + i) % NEXT_QUEUE_SIZE];
+    }
+
+    return SimHashPatterns(
+        pState->currentPatternType,
+        pState->holdPatternType,
+        queue,
+        NEXT_QUEUE_SIZE);
+}
+
+// From-scratch computation, pSim->hash should always equal this
+Uint64 SimComputeHash(const SimState_t* pState)
+{
+    return SimHashBoard(pState->rowBits) ^ hashStatePatterns(pState);
+}
+
+static void initializeGrid(Sim_t* pSim)
+{
+    memset(pSim->state.rowBits, 0, sizeof(pSim->state.rowBits));
+    memset(pSim->cellTypes, PATTERN_NONE, sizeof(pSim->cellTypes));
+    pSim->state.fullRows = 0;
+    SimComputeBoardFeatures(pSim->state.rowBits, &(pSim->features));
+}
+
+// The same seed always produces the same piece sequence
+void SimInitialize(Sim_t* pSim, Uint64 seed)
+{
+    pSim->seed = seed;
+    RandomSeed(&(pSim->state.random), seed);
+
+    initializeNextQueue(pSim);
+
+    pSim->state.currentPatternType = popFromNextQueue(pSim);
+    pSim->state.holdPatternType = PATTERN_NONE;
+    pSim->state.currentPatternRotation = 0;
+    pSim->state.currentFrame = 0;
+    pSim->state.lastDropFrame = 0;
+    pSim->state.preSpawnFrame = 0;
+    pSim->state.lastSpawnFrame = 0;
+    pSim->state.levelUpFrame = 0;
+    pSim->state.lockBeginFrame = 0;
+    pSim->state.gameOverFrame = 0;
+    pSim->state.dropSpeed = START_DROP_SPEED; // Drops per second
+    pSim->state.clearRows = 0;
+    pSim->state.clearLinesFrame = 0;
+    pSim->state.totalClearedLines = 0;
+    pSim->state.currentLevel = 1;
+    pSim->state.inputs = SIM_INPUT_NONE;
+    pSim->state.isPaused = false;
+    pSim->state.isIntro = true;
+    pSim->state.isGameOver = false;
+    pSim->state.renderCells = true;
+    pSim->state.hasDoneHold = false;
+    pSim->numEvents = 0;
+
+    SimGetSpawnPosition(
+        pSim->state.currentPatternType,
+        &(pSim->state.patternGridX),
+        &(pSim->state.patternGridY));
+
+    initializeGrid(pSim);
+    pSim->hash = SimComputeHash(&(pSim->state));
+}
+
+void SimSave(const Sim_t* pSim, SimState_t* pStateOut)
+{
+    *pStateOut = pSim->state;
+}
+
+// Cell colors aren't part of the state; cells restored from a snapshot keep
+// whatever color was last drawn there. Anything that needs exact colors back
+// (replay keyframes) stores them separately.
+void SimRestore(Sim_t* pSim, const SimState_t* pState)
+{
+    pSim->state = *pState;
+    pSim->numEvents = 0;
+    SimComputeBoardFeatures(pSim->state.rowBits, &(pSim->features));
+    pSim->hash = SimComputeHash(&(pSim->state));
+}
+
+Pattern* SimGetCurrentPattern(const Sim_t* pSim)
+{
+    const PatternType_t CurrentType = pSim->state.currentPatternType;
+    const Uint8 CurrentRotation = pSim->state.currentPatternRotation;
+    return g_PatternLUT[CurrentType][CurrentRotation];
+}
+
+ enum PatternCollision {
+     COLLIDES_NONE      = 0,
+     COLLIDES_BOTTOM    = 1 << 0,
+     COLLIDES_LEFT      = 1 << 1,
+     COLLIDES_RIGHT     = 1 << 2,
+     COLLIDES_COMMITTED = 1 << 3,
+};
+
+// Out of bounds positions report which bounds they cross; committed cells
+// are only checked for positions that are fully in bounds.
+Uint8
+SimBoardCollides(
+    const Uint16* pRowBits,
+    const Pattern* pPattern,
+    Sint8 gridX,
+    Sint8 gridY)
+{
+    int collisionFlags = COLLIDES_NONE;
+    if (gridX + pPattern->minCol < 0)
+    {
+        collisionFlags |= COLLIDES_LEFT;
+    }
+
+    if (gridX + pPattern->maxCol >= GRID_WIDTH)
+    {
+        collisionFlags |= COLLIDES_RIGHT;
+    }
+
+    if (gridY + pPattern->maxRow >= GRID_HEIGHT)
+    {
+        collisionFlags |= COLLIDES_BOTTOM;
+    }
+
+    if (collisionFlags != COLLIDES_NONE)
+    {
+        return collisionFlags;
+    }
+
+    for (Sint8 y = 0; y <= pPattern->maxRow; ++y)
+    {
+        const Sint8 RowY = gridY + y;
+        if (RowY < 0)
+        {
+            // Nothing is ever committed above the grid
+            continue;
+        }
+
+        // minCol keeps negative shifts from dropping any occupied bits
+        const Uint16 RowMask = gridX >= 0 ?
+            (Uint16)(pPattern->rowMasks[y] << gridX) :
+            (Uint16)(pPattern->rowMasks[y] >> -gridX);
+        if (pRowBits[RowY] & RowMask)
+        {
+            return COLLIDES_COMMITTED;
+        }
+    }
+
+    return COLLIDES_NONE;
+}
+
+Uint8 SimPatternCollides(const Sim_t* pSim, Pattern* pPattern, Sint8 dX, Sint8 dY)
+{
+    return SimBoardCollides(
+        pSim->state.rowBits,
+        pPattern,
+        pSim->state.patternGridX + dX,
+        pSim->state.patternGridY + dY);
+}
+
+// Finds the first kick that lets pRotatedPattern fit at (gridX, gridY) on the
+// given board. Shared by the sim and anything searching over placements.
+bool
+SimBoardResolveWallKick(
+    const Uint16* pRowBits,
+    PatternType_t patternType,
+    WallKickRotateDirection rotateDirection,
+    const Pattern* pRotatedPattern,
+    int rotationIndex,
+    Sint8 gridX,
+    Sint8 gridY,
+    WallKickVector2* pKickVectorOut)
+{
+    assert(rotateDirection == WALLKICK_DIRECTION_RIGHT ||
+           rotateDirection == WALLKICK_DIRECTION_LEFT);
+
+    const WallKickVector2* pTests = NULL;
+    if (patternType == PATTERN_LINE_SHAPE)
+    {
+        if (rotateDirection == WALLKICK_DIRECTION_RIGHT)
+        {
+            pTests = PatternLineWallKickRightRotationTests[rotationIndex];
+        }
+        else
+        {
+            pTests = PatternLineWallKickLeftRotationTests[rotationIndex];
+        }
+    }
+    else
+    {
+        if (rotateDirection == WALLKICK_DIRECTION_RIGHT)
+        {
+            pTests = PatternNonLineWallKickRightRotationTests[rotationIndex];
+        }
+        else
+        {
+            pTests = PatternNonLineWallKickLeftRotationTests[rotationIndex];
+        }
+    }
+
+    for (Sint8 i = 0; i < PATTERN_MAX_KICK_TESTS; ++i)
+    {
+        WallKickVector2 kickDelta = pTests[i];
+        if (!SimBoardCollides(
+                pRowBits,
+                pRotatedPattern,
+                gridX + kickDelta.X,
+                gridY + kickDelta.Y))
+        {
+            *pKickVectorOut = kickDelta;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+ResolveWallKick(
+    const Sim_t* pSim,
+    WallKickRotateDirection rotateDirection,
+    Pattern* pRotatedPattern,
+    int rotationIndex,
+    WallKickVector2* pKickVectorOut)
+{
+    return SimBoardResolveWallKick(
+        pSim->state.rowBits,
+        pSim->state.currentPatternType,
+        rotateDirection,
+        pRotatedPattern,
+        rotationIndex,
+        pSim->state.patternGridX,
+        pSim->state.patternGridY,
+        pKickVectorOut);
+}
+
+bool SimWaitingToSpawn(const Sim_t* pSim)
+{
+    Uint64 sincePreSpawn = pSim->state.currentFrame - pSim->state.preSpawnFrame;
+    return sincePreSpawn < SPAWN_DELAY_FRAMES && pSim->state.preSpawnFrame > 0;
+}
+
+static bool isSpawnFrame(const Sim_t* pSim)
+{
+    Uint64 sincePreSpawn = pSim->state.currentFrame - pSim->state.preSpawnFrame;
+    return sincePreSpawn == SPAWN_DELAY_FRAMES && pSim->state.preSpawnFrame > 0;
+}
+
+// True when the current pattern is on the board and the next step's inputs
+// will move it. Inputs are applied after that step's spawn, so they can't be
+// decided on while a spawn is still pending. Hard drops wait out line clears.
+bool SimPatternInPlay(const Sim_t* pSim)
+{
+    return
+        !pSim->state.isPaused &&
+        !pSim->state.isIntro &&
+        !pSim->state.isGameOver &&
+        !SimWaitingToSpawn(pSim) &&
+        !isSpawnFrame(pSim);
+}
+
+static bool isClearingLines(const Sim_t* pSim)
+{
+    const bool ClearingLines = pSim->state.clearRows != 0;
+    Uint64 sinceClearedLines = pSim->state.currentFrame - pSim->state.clearLinesFrame;
+    return ClearingLines || sinceClearedLines < CLEAR_LINES_FRAMES;
+}
+
+bool SimIsLineBeingCleared(const Sim_t* pSim, Sint8 gridY)
+{
+    // Don't render any pattern cells that are being cleared
+    return gridY >= 0 && gridY < GRID_HEIGHT && (pSim->state.clearRows & (1u << gridY));
+}
+
+// How far the current pattern can fall. When every pattern column sits above
+// its grid column this comes straight from the heights; patterns tucked under
+// an overhang fall back to stepping the collision test.
+Sint8 SimDropDistance(const Sim_t* pSim)
+{
+    const Pattern* pPattern = SimGetCurrentPattern(pSim);
+    const SimBoardFeatures_t* pFeatures = &(pSim->features);
+
+    int distance = GRID_HEIGHT;
+    for (Sint8 x = pPattern->minCol; x <= pPattern->maxCol; ++x)
+    {
+        if (pPattern->colBottoms[x] < 0)
+        {
+            continue;
+        }
+
+        const int Column = pSim->state.patternGridX + x;
+        const int TopY = GRID_HEIGHT - pFeatures->columnHeights[Column];
+        const int BottomY = pSim->state.patternGridY + pPattern->colBottoms[x];
+        if (BottomY >= TopY)
+        {
+            distance = -1;
+            break;
+        }
+
+        const int ColumnDistance = TopY - BottomY - 1;
+        distance = ColumnDistance < distance ? ColumnDistance : distance;
+    }
+
+    if (distance < 0)
+    {
+        distance = 0;
+        while (!SimBoardCollides(
+                    pSim->state.rowBits,
+                    pPattern,
+                    pSim->state.patternGridX,
+                    pSim->state.patternGridY + distance + 1))
+        {
+            ++distance;
+        }
+    }
+
+    return distance;
+}
+
+static void commitCurrentPattern(Sim_t* pSim)
+{
+    if (pSim->state.isGameOver)
+    {
+        return;
+    }
+
+    Pattern* pPattern = SimGetCurrentPattern(pSim);
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            if (pPattern->occupancy[y][x])
+            {
+                Sint8 gridX = x + pSim->state.patternGridX;
+                Sint8 gridY = y + pSim->state.patternGridY;
+
+                if (gridY < 0)
+                {
+                    // If we commit any cells above the grid, the game is over
+                    pSim->state.isGameOver = true;
+                    pSim->state.gameOverFrame = pSim->state.currentFrame;
+                    return;
+                }
+
+                pSim->cellTypes[gridY][gridX] = pSim->state.currentPatternType;
+                pSim->state.rowBits[gridY] |= (1 << gridX);
+                pSim->hash ^= g_SimZobrist.Cells[gridY][gridX];
+            }
+        }
+    }
+
+    SimFeaturesAddPattern(
+        &(pSim->features),
+        pPattern,
+        pSim->state.patternGridX,
+        pSim->state.patternGridY);
+
+    // Only rows this pattern touched can have become full
+    for (Sint8 y = 0; y <= pPattern->maxRow; ++y)
+    {
+        const Sint8 GridY = y + pSim->state.patternGridY;
+        if (pPattern->rowMasks[y] && pSim->state.rowBits[GridY] == SIM_ROW_FULL)
+        {
+            pSim->state.fullRows |= (1u << GridY);
+        }
+    }
+
+    pSim->state.lockBeginFrame = 0;
+    pSim->state.hasDoneHold = false;
+
+    SimEvent_t* pEvent = pushEvent(pSim, SIM_EVENT_COMMIT);
+    if (pEvent)
+    {
+        pEvent->PatternType = pSim->state.currentPatternType;
+        pEvent->Rotation = pSim->state.currentPatternRotation;
+        pEvent->X = pSim->state.patternGridX;
+        pEvent->Y = pSim->state.patternGridY;
+    }
+}
+
+static void beginSpawnNextPattern(Sim_t* pSim)
+{
+    pSim->state.preSpawnFrame = pSim->state.currentFrame;
+}
+
+static void spawnNextPattern(Sim_t* pSim)
+{
+    const Uint64 OldPatternsHash = hashStatePatterns(&(pSim->state));
+    pSim->state.currentPatternType = popFromNextQueue(pSim);
+    pSim->hash ^= OldPatternsHash ^ hashStatePatterns(&(pSim->state));
+    pSim->state.currentPatternRotation = 0;
+    SimGetSpawnPosition(
+        pSim->state.currentPatternType,
+        &(pSim->state.patternGridX),
+        &(pSim->state.patternGridY));
+    pSim->state.lastSpawnFrame = pSim->state.currentFrame;
+}
+
+static void emitLineClearEvent(Sim_t* pSim, Uint8 y)
+{
+    SimEvent_t* pEvent = pushEvent(pSim, SIM_EVENT_LINE_CLEAR);
+    if (!pEvent)
+    {
+        return;
+    }
+
+    pEvent->Y = y;
+    for (Sint8 x = 0; x < GRID_WIDTH; ++x)
+    {
+        pEvent->RowTypes[x] = pSim->cellTypes[y][x];
+    }
+}
+
+// Removes every row in clearRows in a single pass from the bottom up, sliding
+// each run of surviving rows down over the cleared rows below it.
+static void collapseClearedLines(Sim_t* pSim)
+{
+    const Uint32 ClearedRows = pSim->state.clearRows;
+
+    // Rows below the lowest cleared row don't move, rehash the rest
+    const Sint8 LowestCleared = 31 - __builtin_clz(ClearedRows);
+    for (Sint8 row = 0; row <= LowestCleared; ++row)
+    {
+        pSim->hash ^= SimHashRow(row, pSim->state.rowBits[row]);
+    }
+
+    // Rows [destTop, GRID_HEIGHT) hold their final contents
+    Sint8 destTop = GRID_HEIGHT;
+    Sint8 y = GRID_HEIGHT - 1;
+    while (y >= 0)
+    {
+        if (ClearedRows & (1u << y))
+        {
+            --y;
+            continue;
+        }
+
+        Sint8 runTop = y;
+        while (runTop > 0 && !(ClearedRows & (1u << (runTop - 1))))
+        {
+            --runTop;
+        }
+
+        const Sint8 RunLength = y - runTop + 1;
+        destTop -= RunLength;
+        if (destTop != runTop)
+        {
+            memmove(
+                &(pSim->state.rowBits[destTop]),
+                &(pSim->state.rowBits[runTop]),
+                RunLength * sizeof(pSim->state.rowBits[0]));
+            memmove(
+                pSim->cellTypes[destTop],
+                pSim->cellTypes[runTop],
+                RunLength * sizeof(pSim->cellTypes[0]));
+        }
+
+        y = runTop - 1;
+    }
+
+    // Everything above the surviving rows comes from above the grid
+    memset(pSim->state.rowBits, 0, destTop * sizeof(pSim->state.rowBits[0]));
+    memset(pSim->cellTypes, PATTERN_NONE, destTop * sizeof(pSim->cellTypes[0]));
+
+    for (Sint8 row = 0; row <= LowestCleared; ++row)
+    {
+        pSim->hash ^= SimHashRow(row, pSim->state.rowBits[row]);
+    }
+
+    // Every full row was scheduled for clearing when it was detected
+    pSim->state.fullRows &= ~ClearedRows;
+
+    SimFeaturesRemoveRows(&(pSim->features), pSim->state.rowBits, ClearedRows);
+}
+
+static void checkInputs(Sim_t* pSim)
+{
+    const Uint16 Inputs = pSim->state.inputs;
+    if ((Inputs & SIM_INPUT_BEGIN) && pSim->state.isIntro)
+    {
+        pSim->state.isIntro = false;
+    }
+
+    if (Inputs & SIM_INPUT_PAUSE)
+    {
+        pushEvent(pSim, pSim->state.isPaused ? SIM_EVENT_RESUME : SIM_EVENT_PAUSE);
+        pSim->state.isPaused = !pSim->state.isPaused;
+    }
+
+    // If the game is paused, don't check any other inputs
+    if (pSim->state.isPaused)
+    {
+        return;
+    }
+
+    // Ignore other inputs if we're waiting to spawn
+    if (SimWaitingToSpawn(pSim))
+    {
+        return;
+    }
+
+    // Ignore inputs if the game is over
+    if (pSim->state.isGameOver)
+    {
+        return;
+    }
+
+    // Handle player inputs
+    const bool LeftPressed = Inputs & SIM_INPUT_LEFT;
+    const bool RightPressed = Inputs & SIM_INPUT_RIGHT;
+    if (LeftPressed && !RightPressed)
+    {
+        if (!SimPatternCollides(pSim, SimGetCurrentPattern(pSim), -1, 0))
+        {
+            pSim->state.patternGridX--;
+        }
+    }
+    else if (RightPressed && !LeftPressed)
+    {
+        if (!SimPatternCollides(pSim, SimGetCurrentPattern(pSim), 1, 0))
+        {
+            pSim->state.patternGridX++;
+        }
+    }
+
+    const bool RotateRightPressed = Inputs & SIM_INPUT_ROTATE_RIGHT;
+    const bool RotateLeftPressed = Inputs & SIM_INPUT_ROTATE_LEFT;
+    if (RotateRightPressed && !RotateLeftPressed)
+    {
+        int numRotations = PatternNumRotations[pSim->state.currentPatternType];
+        int rotationIndex = (pSim->state.currentPatternRotation + 1) % numRotations;
+
+        Pattern* pRotatedPattern =
+            g_PatternLUT[pSim->state.currentPatternType][rotationIndex];
+
+        // Resolve any collisions due to rotation, if possible
+        WallKickVector2 kickVector;
+        if (ResolveWallKick(
+                pSim,
+                WALLKICK_DIRECTION_RIGHT,
+                pRotatedPattern,
+                rotationIndex,
+                &kickVector))
+        {
+            pSim->state.currentPatternRotation = rotationIndex;
+            pSim->state.patternGridX += kickVector.X;
+            pSim->state.patternGridY += kickVector.Y;
+        }
+    }
+    else if (RotateLeftPressed && !RotateRightPressed)
+    {
+        int numRotations = PatternNumRotations[pSim->state.currentPatternType];
+        int rotationIndex =
+            pSim->state.currentPatternRotation == 0 ?
+                numRotations - 1 :
+                pSim->state.currentPatternRotation - 1;
+        Pattern* pRotatedPattern =
+            g_PatternLUT[pSim->state.currentPatternType][rotationIndex];
+
+        // Resolve any collisions due to rotation, if possible
+        WallKickVector2 kickVector;
+        if (ResolveWallKick(
+                pSim,
+                WALLKICK_DIRECTION_LEFT,
+                pRotatedPattern,
+                rotationIndex,
+                &kickVector))
+        {
+            pSim->state.currentPatternRotation = rotationIndex;
+            pSim->state.patternGridX += kickVector.X;
+            pSim->state.patternGridY += kickVector.Y;
+        }
+    }
+
+    if ((Inputs & SIM_INPUT_HOLD) && !pSim->state.hasDoneHold)
+    {
+        const Uint64 OldPatternsHash = hashStatePatterns(&(pSim->state));
+        if (pSim->state.holdPatternType == PATTERN_NONE)
+        {
+            pSim->state.holdPatternType = pSim->state.currentPatternType;
+            pSim->state.currentPatternType = popFromNextQueue(pSim);
+        }
+        else
+        {
+            PatternType_t temp = pSim->state.holdPatternType;
+            pSim->state.holdPatternType = pSim->state.currentPatternType;
+            pSim->state.currentPatternType = temp;
+        }
+
+        pSim->hash ^= OldPatternsHash ^ hashStatePatterns(&(pSim->state));
+
+        pSim->state.currentPatternRotation = 0;
+        SimGetSpawnPosition(
+            pSim->state.currentPatternType,
+            &(pSim->state.patternGridX),
+            &(pSim->state.patternGridY));
+        pSim->state.hasDoneHold = true;
+    }
+}
+
+static void updateGameState(Sim_t* pSim)
+{
+    const Uint16 Inputs = pSim->state.inputs;
+    Uint64 sinceLastDrop = pSim->state.currentFrame - pSim->state.lastDropFrame;
+    Uint64 dropFrameTarget = (FPS / pSim->state.dropSpeed);
+
+    if (pSim->state.isPaused || pSim->state.isIntro)
+    {
+        pSim->state.renderCells = false;
+        return;
+    }
+
+    // Check losing condition
+    if (pSim->state.isGameOver)
+    {
+        pSim->state.preSpawnFrame = 0;
+
+        // Start blowing up lines
+        const int GameOverFrames =
+            pSim->state.currentFrame - pSim->state.gameOverFrame;
+        const int LineToClear =
+            ((float)GameOverFrames / GAMEOVER_ANIM_DURATION_FRAMES) *
+            GRID_HEIGHT - 1;
+
+        if (GameOverFrames == 1)
+        {
+            // Game over sfx only on the first game over frame
+            pushEvent(pSim, SIM_EVENT_GAME_OVER);
+        }
+
+        const bool HasClearedThisLine =
+            LineToClear < 0 ||
+            LineToClear >= GRID_HEIGHT ||
+            pSim->state.rowBits[LineToClear] == 0;
+
+        if (!HasClearedThisLine)
+        {
+            emitLineClearEvent(pSim, LineToClear);
+            pSim->hash ^= SimHashRow(LineToClear, pSim->state.rowBits[LineToClear]);
+            pSim->state.rowBits[LineToClear] = 0;
+            pSim->state.fullRows &= ~(1u << LineToClear);
+            memset(pSim->cellTypes[LineToClear], PATTERN_NONE, GRID_WIDTH);
+            SimComputeBoardFeatures(pSim->state.rowBits, &(pSim->features));
+        }
+
+        // Handle reset input
+        if (GameOverFrames >= GAMEOVER_SHOW_RETRY_FRAMES &&
+            (Inputs & SIM_INPUT_RETRY))
+        {
+            pSim->state.renderCells = true;
+            pSim->state.isGameOver = false;
+
+            const Uint64 OldPatternsHash = hashStatePatterns(&(pSim->state));
+            initializeNextQueue(pSim);
+            pSim->state.currentPatternType = popFromNextQueue(pSim);
+
+            // Reset stats and level
+            pSim->state.totalClearedLines = 0;
+            pSim->state.currentLevel = 1;
+            pSim->state.dropSpeed = START_DROP_SPEED;
+            pSim->state.holdPatternType = PATTERN_NONE;
+            pSim->hash ^= OldPatternsHash ^ hashStatePatterns(&(pSim->state));
+
+            spawnNextPattern(pSim);
+
+            pushEvent(pSim, SIM_EVENT_RETRY);
+        }
+
+        pSim->state.currentFrame++;
+        return;
+    }
+
+    if (SimWaitingToSpawn(pSim))
+    {
+        pSim->state.currentFrame++;
+        return;
+    }
+    else if (isSpawnFrame(pSim))
+    {
+        spawnNextPattern(pSim);
+    }
+
+    if (isClearingLines(pSim))
+    {
+        Uint64 sinceClearedLines =
+            pSim->state.currentFrame -
+            pSim->state.clearLinesFrame;
+        if (sinceClearedLines >= CLEAR_LINES_FRAMES)
+        {
+            // Collapse cleared lines
+            collapseClearedLines(pSim);
+            pSim->state.clearRows = 0;
+        }
+
+        pSim->state.currentFrame++;
+        return;
+    }
+
+    pSim->state.renderCells = true;
+
+    // Check for natural drops, player-induced drops or quick drops
+    if (Inputs & SIM_INPUT_UP)
+    {
+        // Figure out how far to drop the current pattern
+        const Sint8 DropDistance = SimDropDistance(pSim);
+
+        SimEvent_t* pEvent = pushEvent(pSim, SIM_EVENT_HARD_DROP);
+        if (pEvent)
+        {
+            pEvent->PatternType = pSim->state.currentPatternType;
+            pEvent->Rotation = pSim->state.currentPatternRotation;
+            pEvent->X = pSim->state.patternGridX;
+            pEvent->Y = pSim->state.patternGridY;
+            pEvent->Count = DropDistance;
+        }
+
+        pSim->state.patternGridY += DropDistance;
+
+        commitCurrentPattern(pSim);
+        beginSpawnNextPattern(pSim);
+
+        pSim->state.lastDropFrame = pSim->state.currentFrame;
+    }
+    else if (dropFrameTarget <= sinceLastDrop || (Inputs & SIM_INPUT_DOWN))
+    {
+        if (!SimPatternCollides(pSim, SimGetCurrentPattern(pSim), 0, 1))
+        {
+            pSim->state.patternGridY++;
+        }
+        else if (Inputs & SIM_INPUT_DOWN)
+        {
+            // Only commit if drop was pressed, not held
+            if (Inputs & SIM_INPUT_DOWN_PRESSED)
+            {
+                commitCurrentPattern(pSim);
+                beginSpawnNextPattern(pSim);
+            }
+        }
+        else if (pSim->state.lockBeginFrame == 0)
+        {
+            // Start counting lock delay, which gets reset whenever we commit
+            // a pattern.
+            pSim->state.lockBeginFrame = pSim->state.currentFrame;
+        }
+
+        pSim->state.lastDropFrame = pSim->state.currentFrame;
+    }
+
+    // Update lock delay if necessary
+    if (pSim->state.lockBeginFrame > 0)
+    {
+        // Reset lock delay if the current pattern isn't ready to lock
+        if (!SimPatternCollides(pSim, SimGetCurrentPattern(pSim), 0, 1))
+        {
+            pSim->state.lockBeginFrame = 0;
+        }
+        else
+        {
+            const bool LockDelayExpired =
+                pSim->state.lockBeginFrame > 0 &&
+                (pSim->state.currentFrame - pSim->state.lockBeginFrame) >= LOCK_DELAY_FRAMES;
+            if (LockDelayExpired)
+            {
+                commitCurrentPattern(pSim);
+                beginSpawnNextPattern(pSim);
+            }
+        }
+    }
+
+    // Checking cleared lines or lose condition if there was a drop
+    if (pSim->state.lastDropFrame == pSim->state.currentFrame)
+    {
+        pSim->state.clearRows = 0;
+
+        // Check for cleared lines, top to bottom
+        Uint8 linesCleared = 0;
+        for (Uint32 fullRows = pSim->state.fullRows; fullRows != 0; fullRows &= fullRows - 1)
+        {
+            const int y = __builtin_ctz(fullRows);
+            emitLineClearEvent(pSim, y);
+            pSim->state.clearRows |= 1u << y;
+            ++linesCleared;
+        }
+
+        if (linesCleared > 0)
+        {
+            int previousLevel = pSim->state.currentLevel;
+
+            pSim->state.totalClearedLines += linesCleared;
+            pSim->state.currentLevel =
+                (pSim->state.totalClearedLines / LEVELUP_LINE_INTERVAL) + 1;
+            pSim->state.dropSpeed = START_DROP_SPEED + pSim->state.currentLevel;
+            pSim->state.clearLinesFrame = pSim->state.currentFrame;
+
+            SimEvent_t* pEvent = pushEvent(pSim, SIM_EVENT_LINES_CLEARED);
+            if (pEvent)
+            {
+                pEvent->Count = linesCleared;
+            }
+
+            if (pSim->state.currentLevel > previousLevel)
+            {
+                // Level up!
+                pSim->state.levelUpFrame = pSim->state.currentFrame;
+                pushEvent(pSim, SIM_EVENT_LEVEL_UP);
+            }
+        }
+    }
+
+    pSim->state.currentFrame++;
+}
+
+// Advances the simulation by exactly one frame. Events raised during the step
+// are available in pSim->events until the next call.
+void SimStep(Sim_t* pSim, Uint16 inputs)
+{
+    pSim->numEvents = 0;
+
+    // Holding is meaningless during the intro, and so is retrying mid-game
+    if (pSim->state.isIntro)
+    {
+        inputs &= ~SIM_INPUT_HOLD;
+    }
+
+    if (!pSim->state.isGameOver)
+    {
+        inputs &= ~SIM_INPUT_RETRY;
+    }
+
+    pSim->state.inputs = inputs;
+
+    updateGameState(pSim);
+    checkInputs(pSim);
+}
@@ -0,0 +1,752 @@
+// Puzzle solver: exhaustively searches a board and a piece queue for perfect
+// clears, or for ways to build a target board, and prints the placements of
+// every solution it finds. Placements come from the move generator, so
+// pieces move, rotate and kick exactly as they do in the game and spins
+// under overhangs are found.
+//
+// The first couple of pieces are expanded up front and the subtrees below
+// them are shared out to a pool of threads. Positions (board, hold and how
+// far into the queue) that were fully searched without a solution go into a
+// table shared by every thread, so other move orders reaching the same
+// position skip it.
+#define LIL_TETRIS_HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lil-tetris-sim.c"
+#include "lil-tetris-movegen.c"
+
+#define SOLVER_MAX_QUEUE 32
+#define SOLVER_DEFAULT_PC_HEIGHT 4
+#define SOLVER_DEFAULT_TABLE_BITS 22
+#define SOLVER_MAX_TABLE_BITS 30
+#define SOLVER_SPLIT_DEPTH 2
+
+// Piece letters in PatternType_t order
+static const char SolverPatternLetters[PATTERN_MAX_VALUE] = { '.', 'L', 'J', 'Z', 'S', 'T', 'I', 'O' };
+
+typedef struct
+{
+    Uint8 PatternType;
+    Sint8 X;
+    Sint8 Y;
+    Uint8 Rotation;
+    Uint8 Flags; // MOVEGEN_PLACEMENT_*
+} SolverMove_t;
+
+typedef struct
+{
+    Uint16       RowBits[GRID_HEIGHT];
+    Uint8        Hold;      // PatternType_t
+    Uint8        NextPiece; // Queue index of the piece to play next
+    Uint8        Height;    // Rows from the bottom pieces may occupy
+    Uint8        NumMoves;
+    SolverMove_t Moves[SOLVER_MAX_QUEUE];
+} SolverState_t;
+
+typedef struct
+{
+    Uint8           Queue[SOLVER_MAX_QUEUE];
+    Uint8           QueueLength;
+    bool            CanHold;
+    bool            IsAllSpin;
+    bool            HasTarget;
+    Uint16          TargetRowBits[GRID_HEIGHT];
+    Uint64          MaxSolutions; // 0 for all of them
+
+    // Positions known to have no solution, keyed by solverStateKey()
+    atomic_ullong*  pDeadTable;
+    Uint64          DeadTableMask;
+
+    SolverState_t*  pTasks;
+    size_t          NumTasks;
+    size_t          TaskCapacity;
+    atomic_size_t   NextTask;
+
+    pthread_mutex_t OutputLock;
+    Uint64          NumSolutions;
+    atomic_bool     IsStopped;
+    atomic_bool     IsTruncated; // Movegen ran out of room, the search is incomplete
+} Solver_t;
+
+typedef struct
+{
+    Solver_t*  pSolver;
+    pthread_t  Thread;
+    MoveGen_t  MoveGen;
+} SolverWorker_t;
+
+static Uint64 solverNowUs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64)now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+static PatternType_t solverPatternFromLetter(char letter)
+{
+    for (int type = PATTERN_NONE + 1; type < PATTERN_MAX_VALUE; ++type)
+    {
+        if (SolverPatternLetters[type] == letter)
+        {
+            return (PatternType_t)type;
+        }
+    }
+
+    return PATTERN_NONE;
+}
+
+// Reads a board drawn with one line per row, '.' or ' ' for empty cells and
+// anything else for filled ones. The last line is the bottom row.
+static bool solverReadBoard(const char* pPath, Uint16* pRowBits)
+{
+    FILE* pFile = fopen(pPath, "r");
+    if (!pFile)
+    {
+        fprintf(stderr, "Failed to open board %s\n", pPath);
+        return false;
+    }
+
+    Uint16 rows[GRID_HEIGHT];
+    int numRows = 0;
+    char line[64];
+    while (fgets(line, sizeof(line), pFile))
+    {
+        const size_t Length = strcspn(line, "\r\n");
+        if (Length == 0)
+        {
+            continue;
+        }
+
+        if (numRows == GRID_HEIGHT || Length > GRID_WIDTH)
+        {
+            fprintf(stderr, "Board %s doesn't fit in %dx%d\n", pPath, GRID_WIDTH, GRID_HEIGHT);
+            fclose(pFile);
+            return false;
+        }
+
+        Uint16 row = 0;
+        for (size_t x = 0; x < Length; ++x)
+        {
+            if (line[x] != '.' && line[x] != ' ')
+            {
+                row |= 1 << x;
+            }
+        }
+
+        rows[numRows++] = row;
+    }
+
+    fclose(pFile);
+
+    memset(pRowBits, 0, GRID_HEIGHT * sizeof(Uint16));
+    memcpy(pRowBits + GRID_HEIGHT - numRows, rows, numRows * sizeof(Uint16));
+    return true;
+}
+
+// Rows from the bottom up to the highest filled cell
+static int solverBoardHeight(const Uint16* pRowBits)
+{
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        if (pRowBits[y])
+        {
+            return GRID_HEIGHT - y;
+        }
+    }
+
+    return 0;
+}
+
+// Locks pPattern in and collapses full rows. Returns the number of rows
+// cleared, or -1 if a cell lands above the top Height rows.
+static int solverPlacePattern(SolverState_t* pState, const Pattern* pPattern, Sint8 gridX, Sint8 gridY)
+{
+    const int TopRow = GRID_HEIGHT - pState->Height;
+    Uint32 fullRows = 0;
+    for (Sint8 y = 0; y <= pPattern->maxRow; ++y)
+    {
+        if (!pPattern->rowMasks[y])
+        {
+            continue;
+        }
+
+        const Sint8 RowY = gridY + y;
+        if (RowY < TopRow)
+        {
+            return -1;
+        }
+
+        pState->RowBits[RowY] |= gridX >= 0 ?
+            (Uint16)(pPattern->rowMasks[y] << gridX) :
+            (Uint16)(pPattern->rowMasks[y] >> -gridX);
+        if (pState->RowBits[RowY] == SIM_ROW_FULL)
+        {
+            fullRows |= 1u << RowY;
+        }
+    }
+
+    if (!fullRows)
+    {
+        return 0;
+    }
+
+    Sint8 destY = GRID_HEIGHT - 1;
+    for (Sint8 y = GRID_HEIGHT - 1; y >= 0; --y)
+    {
+        if (!(fullRows & (1u << y)))
+        {
+            pState->RowBits[destY--] = pState->RowBits[y];
+        }
+    }
+
+    while (destY >= 0)
+    {
+        pState->RowBits[destY--] = 0;
+    }
+
+    return __builtin_popcount(fullRows);
+}
+
+static Uint64 solverStateKey(const SolverState_t* pState)
+{
+    Uint64 seed = pState->NextPiece | (Uint64)pState->Hold << 8 | (Uint64)pState->Height << 16;
+    const Uint64 Key = SimHashBoard(pState->RowBits) ^ randomSplitMix64(&seed);
+
+    // 0 marks an empty slot
+    return Key ? Key : 1;
+}
+
+static bool solverIsDead(Solver_t* pSolver, Uint64 key)
+{
+    return atomic_load_explicit(&(pSolver->pDeadTable[key & pSolver->DeadTableMask]), memory_order_relaxed) == key;
+}
+
+static void solverMarkDead(Solver_t* pSolver, Uint64 key)
+{
+    atomic_store_explicit(&(pSolver->pDeadTable[key & pSolver->DeadTableMask]), key, memory_order_relaxed);
+}
+
+static bool solverIsSolved(const Solver_t* pSolver, const SolverState_t* pState)
+{
+    if (pState->NumMoves == 0)
+    {
+        return false;
+    }
+
+    if (pSolver->HasTarget)
+    {
+        return memcmp(pState->RowBits, pSolver->TargetRowBits, sizeof(pState->RowBits)) == 0;
+    }
+
+    return solverBoardHeight(pState->RowBits) == 0;
+}
+
+// A perfect clear fills every empty cell in the box with the pieces still
+// to come. A column filled all the way up the box stays that way as rows
+// clear and no piece can cross it, so the cells either side of it need
+// whole pieces of their own.
+static bool solverCanPerfectClear(const Solver_t* pSolver, const SolverState_t* pState)
+{
+    const int TopRow = GRID_HEIGHT - pState->Height;
+    if (TopRow > 0 && pState->RowBits[TopRow - 1])
+    {
+        return false;
+    }
+
+    Uint16 walls = SIM_ROW_FULL;
+    int emptyCells = 0;
+    for (int y = TopRow; y < GRID_HEIGHT; ++y)
+    {
+        walls &= pState->RowBits[y];
+        emptyCells += GRID_WIDTH - __builtin_popcount(pState->RowBits[y]);
+    }
+
+    const int PiecesLeft = pSolver->QueueLength - pState->NextPiece + (pState->Hold != PATTERN_NONE);
+    if (emptyCells % 4 != 0 || emptyCells / 4 > PiecesLeft)
+    {
+        return false;
+    }
+
+    int segmentCells = 0;
+    for (int x = 0; x <= GRID_WIDTH; ++x)
+    {
+        if (x == GRID_WIDTH || (walls & (1 << x)))
+        {
+            if (segmentCells % 4 != 0)
+            {
+                return false;
+            }
+
+            segmentCells = 0;
+            continue;
+        }
+
+        for (int y = TopRow; y < GRID_HEIGHT; ++y)
+        {
+            segmentCells += !(pState->RowBits[y] & (1 << x));
+        }
+    }
+
+    return true;
+}
+
+static void solverReport(Solver_t* pSolver, const SolverState_t* pState)
+{
+    pthread_mutex_lock(&(pSolver->OutputLock));
+    if (pSolver->MaxSolutions == 0 || pSolver->NumSolutions < pSolver->MaxSolutions)
+    {
+        for (int i = 0; i < pState->NumMoves; ++i)
+        {
+            const SolverMove_t* pMove = &(pState->Moves[i]);
+            printf("%s%c%d@%d,%d%s",
+                i > 0 ? " " : "",
+                SolverPatternLetters[pMove->PatternType],
+                pMove->Rotation,
+                pMove->X,
+                pMove->Y,
+                (pMove->Flags & MOVEGEN_PLACEMENT_SPIN) ? "*" : "");
+        }
+        printf("\n");
+
+        pSolver->NumSolutions++;
+        if (pSolver->NumSolutions == pSolver->MaxSolutions)
+        {
+            atomic_store(&(pSolver->IsStopped), true);
+        }
+    }
+    pthread_mutex_unlock(&(pSolver->OutputLock));
+}
+
+// Calls visit on every child of pState: the current piece placed anywhere,
+// or, when holding is allowed, the hold piece (or the one after the current
+// piece if hold is empty) placed anywhere with the current piece held.
+// Returns true if any visit did.
+typedef bool (*SolverVisit_t)(SolverWorker_t* pWorker, SolverState_t* pChild);
+
+static bool solverPlacePiece(
+    SolverWorker_t* pWorker,
+    const SolverState_t* pState,
+    PatternType_t patternType,
+    Uint8 hold,
+    Uint8 nextPiece,
+    SolverVisit_t visit)
+{
+    Solver_t* pSolver = pWorker->pSolver;
+    MoveGen_t* pGen = &(pWorker->MoveGen);
+
+    Sint8 spawnX;
+    Sint8 spawnY;
+    SimGetSpawnPosition(patternType, &spawnX, &spawnY);
+    const Uint16 NumPlacements = MoveGenGenerate(
+        pGen,
+        pState->RowBits,
+        patternType,
+        spawnX,
+        MoveGenOpenStartY(pState->RowBits, spawnY),
+        0);
+
+    // A search missing placements can't claim there's no solution
+    if (pGen->IsTruncated)
+    {
+        if (!atomic_exchange(&(pSolver->IsTruncated), true))
+        {
+            fprintf(stderr, "More than %d placements for one piece, giving up\n", MOVEGEN_MAX_PLACEMENTS);
+        }
+
+        atomic_store(&(pSolver->IsStopped), true);
+        return false;
+    }
+
+    // Visiting reuses the move generator
+    MoveGenPlacement_t placements[MOVEGEN_MAX_PLACEMENTS];
+    memcpy(placements, pGen->Placements, NumPlacements * sizeof(MoveGenPlacement_t));
+
+    bool found = false;
+    for (Uint16 i = 0; i < NumPlacements && !atomic_load(&(pSolver->IsStopped)); ++i)
+    {
+        const MoveGenPlacement_t* pPlacement = &(placements[i]);
+        if (pPlacement->Flags & MOVEGEN_PLACEMENT_LOCK_OUT)
+        {
+            continue;
+        }
+
+        SolverState_t child = *pState;
+        const Pattern* pPattern = g_PatternLUT[patternType][pPlacement->Rotation];
+        const int LinesCleared = solverPlacePattern(&child, pPattern, pPlacement->X, pPlacement->Y);
+        if (LinesCleared < 0)
+        {
+            continue;
+        }
+
+        if (LinesCleared > 0 && pSolver->IsAllSpin && !(pPlacement->Flags & MOVEGEN_PLACEMENT_SPIN))
+        {
+            continue;
+        }
+
+        // A perfect clear happens within a box that sinks as it's cleared,
+        // a target stays where it is
+        if (!pSolver->HasTarget)
+        {
+            child.Height -= LinesCleared;
+        }
+
+        child.Hold = hold;
+        child.NextPiece = nextPiece;
+
+        SolverMove_t* pMove = &(child.Moves[child.NumMoves++]);
+        pMove->PatternType = patternType;
+        pMove->X = pPlacement->X;
+        pMove->Y = pPlacement->Y;
+        pMove->Rotation = pPlacement->Rotation;
+        pMove->Flags = pPlacement->Flags;
+
+        found |= visit(pWorker, &child);
+    }
+
+    return found;
+}
+
+static bool solverExpand(SolverWorker_t* pWorker, const SolverState_t* pState, SolverVisit_t visit)
+{
+    const Solver_t* pSolver = pWorker->pSolver;
+    const Uint8 Index = pState->NextPiece;
+    const PatternType_t Current = pSolver->Queue[Index];
+
+    bool found = solverPlacePiece(pWorker, pState, Current, pState->Hold, Index + 1, visit);
+    if (!pSolver->CanHold)
+    {
+        return found;
+    }
+
+    if (pState->Hold != PATTERN_NONE && pState->Hold != Current)
+    {
+        found |= solverPlacePiece(pWorker, pState, pState->Hold, Current, Index + 1, visit);
+    }
+    else if (pState->Hold == PATTERN_NONE && Index + 1 < pSolver->QueueLength)
+    {
+        found |= solverPlacePiece(pWorker, pState, pSolver->Queue[Index + 1], Current, Index + 2, visit);
+    }
+
+    return found;
+}
+
+// Whether pState is worth looking below
+static bool solverIsOpen(Solver_t* pSolver, const SolverState_t* pState)
+{
+    if (pState->NextPiece >= pSolver->QueueLength)
+    {
+        return false;
+    }
+
+    return pSolver->HasTarget || solverCanPerfectClear(pSolver, pState);
+}
+
+static bool solverSearch(SolverWorker_t* pWorker, SolverState_t* pState)
+{
+    Solver_t* pSolver = pWorker->pSolver;
+    if (solverIsSolved(pSolver, pState))
+    {
+        solverReport(pSolver, pState);
+        return true;
+    }
+
+    if (!solverIsOpen(pSolver, pState))
+    {
+        return false;
+    }
+
+    const Uint64 Key = solverStateKey(pState);
+    if (solverIsDead(pSolver, Key))
+    {
+        return false;
+    }
+
+    const bool Found = solverExpand(pWorker, pState, solverSearch);
+
+    // A search cut short by the solution limit proves nothing
+    if (!Found && !atomic_load(&(pSolver->IsStopped)))
+    {
+        solverMarkDead(pSolver, Key);
+    }
+
+    return Found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Splitting the search into tasks
+////////////////////////////////////////////////////////////////////////////////
+static bool solverAddTask(SolverWorker_t* pWorker, SolverState_t* pState)
+{
+    Solver_t* pSolver = pWorker->pSolver;
+    if (solverIsSolved(pSolver, pState))
+    {
+        solverReport(pSolver, pState);
+        return true;
+    }
+
+    if (!solverIsOpen(pSolver, pState))
+    {
+        return false;
+    }
+
+    if (pSolver->NumTasks == pSolver->TaskCapacity)
+    {
+        const size_t Capacity = pSolver->TaskCapacity ? pSolver->TaskCapacity * 2 : 1024;
+        SolverState_t* pTasks = realloc(pSolver->pTasks, Capacity * sizeof(SolverState_t));
+        if (!pTasks)
+        {
+            // Search it here instead
+            return solverSearch(pWorker, pState);
+        }
+
+        pSolver->pTasks = pTasks;
+        pSolver->TaskCapacity = Capacity;
+    }
+
+    pSolver->pTasks[pSolver->NumTasks++] = *pState;
+    return false;
+}
+
+// Replaces the tasks with their children
+static void solverSplitTasks(SolverWorker_t* pWorker)
+{
+    Solver_t* pSolver = pWorker->pSolver;
+    SolverState_t* pParents = pSolver->pTasks;
+    const size_t NumParents = pSolver->NumTasks;
+
+    pSolver->pTasks = NULL;
+    pSolver->NumTasks = 0;
+    pSolver->TaskCapacity = 0;
+    for (size_t i = 0; i < NumParents && !atomic_load(&(pSolver->IsStopped)); ++i)
+    {
+        solverExpand(pWorker, &(pParents[i]), solverAddTask);
+    }
+
+    free(pParents);
+}
+
+static void* solverWorkerMain(void* pArg)
+{
+    SolverWorker_t* pWorker = (SolverWorker_t*)pArg;
+    Solver_t* pSolver = pWorker->pSolver;
+    for (;;)
+    {
+        const size_t Index = atomic_fetch_add(&(pSolver->NextTask), 1);
+        if (Index >= pSolver->NumTasks || atomic_load(&(pSolver->IsStopped)))
+        {
+            return NULL;
+        }
+
+        solverSearch(pWorker, &(pSolver->pTasks[Index]));
+    }
+}
+
+static void solverPrintUsage(const char* pProgram)
+{
+    fprintf(stderr,
+        "Usage: %s [options] --queue PIECES\n"
+        "  --queue PIECES     Pieces to place from IJLOSTZ, current piece first\n"
+        "  --board FILE       Starting board, one line per row, '.' for empty (default empty)\n"
+        "  --hold PIECE       Piece already in hold\n"
+        "  --no-hold          Play the queue in order\n"
+        "  --target FILE      Build this board instead of a perfect clear\n"
+        "  --height N         Rows to clear, or rows pieces may occupy when building a\n"
+        "                     target (default %d, or the target's height)\n"
+        "  --all-spin         Every line clear must come from a spin\n"
+        "  --max-solutions N  Stop after N solutions, 0 finds all of them (default 1)\n"
+        "  --threads N        Worker threads (default: online cores)\n"
+        "  --table-bits N     Log2 of the dead position table size (default %d)\n"
+        "Solutions print one per line as placements <piece><rotation>@<x>,<y>,\n"
+        "marked * when they're spins.\n",
+        pProgram,
+        SOLVER_DEFAULT_PC_HEIGHT,
+        SOLVER_DEFAULT_TABLE_BITS);
+}
+
+int main(int argc, char** argv)
+{
+    const char* pQueue = NULL;
+    const char* pBoardPath = NULL;
+    const char* pTargetPath = NULL;
+    char holdLetter = 0;
+    bool canHold = true;
+    bool isAllSpin = false;
+    int height = 0;
+    Uint64 maxSolutions = 1;
+    long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int tableBits = SOLVER_DEFAULT_TABLE_BITS;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool HasValue = (i + 1) < argc;
+        if (strcmp(argv[i], "--queue") == 0 && HasValue)
+        {
+            pQueue = argv[++i];
+        }
+        else if (strcmp(argv[i], "--board") == 0 && HasValue)
+        {
+            pBoardPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hold") == 0 && HasValue)
+        {
+            holdLetter = argv[++i][0];
+        }
+        else if (strcmp(argv[i], "--no-hold") == 0)
+        {
+            canHold = false;
+        }
+        else if (strcmp(argv[i], "--target") == 0 && HasValue)
+        {
+            pTargetPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--height") == 0 && HasValue)
+        {
+            height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--all-spin") == 0)
+        {
+            isAllSpin = true;
+        }
+        else if (strcmp(argv[i], "--max-solutions") == 0 && HasValue)
+        {
+            maxSolutions = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && HasValue)
+        {
+            numThreads = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--table-bits") == 0 && HasValue)
+        {
+            tableBits = atoi(argv[++i]);
+        }
+        else
+        {
+            solverPrintUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (!pQueue)
+    {
+        solverPrintUsage(argv[0]);
+        return -1;
+    }
+
+    SimInitializeTables();
+
+    static Solver_t solver;
+    solver.CanHold = canHold;
+    solver.IsAllSpin = isAllSpin;
+    solver.MaxSolutions = maxSolutions;
+
+    solver.QueueLength = strlen(pQueue);
+    if (solver.QueueLength == 0 || strlen(pQueue) > SOLVER_MAX_QUEUE)
+    {
+        fprintf(stderr, "Queue should hold 1 to %d pieces\n", SOLVER_MAX_QUEUE);
+        return -1;
+    }
+
+    for (int i = 0; i < solver.QueueLength; ++i)
+    {
+        solver.Queue[i] = solverPatternFromLetter(pQueue[i]);
+        if (solver.Queue[i] == PATTERN_NONE)
+        {
+            fprintf(stderr, "Unknown piece '%c' in queue\n", pQueue[i]);
+            return -1;
+        }
+    }
+
+    SolverState_t root;
+    memset(&root, 0, sizeof(root));
+    root.Hold = holdLetter ? solverPatternFromLetter(holdLetter) : PATTERN_NONE;
+    if (holdLetter && root.Hold == PATTERN_NONE)
+    {
+        fprintf(stderr, "Unknown hold piece '%c'\n", holdLetter);
+        return -1;
+    }
+
+    if (pBoardPath && !solverReadBoard(pBoardPath, root.RowBits))
+    {
+        return -1;
+    }
+
+    solver.HasTarget = pTargetPath != NULL;
+    if (solver.HasTarget && !solverReadBoard(pTargetPath, solver.TargetRowBits))
+    {
+        return -1;
+    }
+
+    if (height <= 0)
+    {
+        height = solver.HasTarget ? solverBoardHeight(solver.TargetRowBits) : SOLVER_DEFAULT_PC_HEIGHT;
+    }
+
+    const int BoardHeight = solverBoardHeight(root.RowBits);
+    root.Height = height < BoardHeight ? BoardHeight : (height > GRID_HEIGHT ? GRID_HEIGHT : height);
+
+    tableBits = tableBits < 10 ? 10 : (tableBits > SOLVER_MAX_TABLE_BITS ? SOLVER_MAX_TABLE_BITS : tableBits);
+    solver.DeadTableMask = ((Uint64)1 << tableBits) - 1;
+    solver.pDeadTable = calloc(solver.DeadTableMask + 1, sizeof(atomic_ullong));
+
+    numThreads = numThreads < 1 ? 1 : numThreads;
+    SolverWorker_t* pWorkers = calloc(numThreads, sizeof(SolverWorker_t));
+    if (!solver.pDeadTable || !pWorkers)
+    {
+        fprintf(stderr, "Failed to allocate the solver\n");
+        return -1;
+    }
+
+    pthread_mutex_init(&(solver.OutputLock), NULL);
+    for (long i = 0; i < numThreads; ++i)
+    {
+        pWorkers[i].pSolver = &solver;
+    }
+
+    const Uint64 BeginUs = solverNowUs();
+
+    // Expand the first pieces here so there are enough subtrees to go round
+    solverAddTask(&(pWorkers[0]), &root);
+    for (int depth = 0; depth < SOLVER_SPLIT_DEPTH && solver.NumTasks > 0; ++depth)
+    {
+        solverSplitTasks(&(pWorkers[0]));
+    }
+
+    long numStarted = 1;
+    for (; numStarted < numThreads; ++numStarted)
+    {
+        if (pthread_create(&(pWorkers[numStarted].Thread), NULL, solverWorkerMain, &(pWorkers[numStarted])) != 0)
+        {
+            fprintf(stderr, "Failed to create solver thread %ld\n", numStarted);
+            break;
+        }
+    }
+
+    solverWorkerMain(&(pWorkers[0]));
+    for (long i = 1; i < numStarted; ++i)
+    {
+        pthread_join(pWorkers[i].Thread, NULL);
+    }
+
+    fprintf(stderr, "%llu solution(s) in %.3f s (%zu subtrees, %ld threads)\n",
+        (unsigned long long)solver.NumSolutions,
+        (solverNowUs() - BeginUs) / 1e6,
+        solver.NumTasks,
+        numStarted);
+
+    pthread_mutex_destroy(&(solver.OutputLock));
+    free(solver.pTasks);
+    free(solver.pDeadTable);
+    free(pWorkers);
+    if (atomic_load(&(solver.IsTruncated)))
+    {
+        return -1;
+    }
+
+    return solver.NumSolutions > 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Headless modules (simulation, batch tools) build without SDL, but share the
+// SDL-style integer typedefs with the rest of the game. Define
+// LIL_TETRIS_HEADLESS before including anything to get plain stdint versions.
+#ifdef LIL_TETRIS_HEADLESS
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef uint8_t  Uint8;
+typedef int8_t   Sint8;
+typedef uint16_t Uint16;
+typedef int16_t  Sint16;
+typedef uint32_t Uint32;
+typedef int32_t  Sint32;
+typedef uint64_t Uint64;
+typedef int64_t  Sint64;
+#else
+#include <SDL2/SDL.h>
+#endif
@@ -0,0 +1,470 @@
+// Vectorized environment for reinforcement learning: steps NumEnvs
+// independent headless games in lockstep, one placement per game per step.
+// Built as a shared library so a training loop can drive it over ctypes
+// without touching any per-game structures:
+//
+//   env = lib.VecEnvCreate(num_envs, seed, num_threads)
+//   lib.VecEnvReset(env, obs)
+//   lib.VecEnvStep(env, actions, obs, rewards, dones)
+//
+// with obs a contiguous uint8 buffer of num_envs * VecEnvObservationSize()
+// bytes, actions uint16, rewards float32 and dones uint8, all caller owned.
+// Games that end during a step are reset straight away; their done flag is
+// set and the observation is the first one of the new game.
+//
+// Games are split into contiguous slices across a pool of worker threads
+// that lives as long as the environment. The calling thread works on the
+// first slice.
+#define LIL_TETRIS_HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "lil-tetris-sim.c"
+#include "lil-tetris-movegen.c"
+
+#define VECENV_MAX_THREADS 64
+
+// A step that takes longer than this many frames to reach the next pattern
+// returns anyway
+#define VECENV_MAX_STEP_FRAMES 600
+
+// Actions pick a rotation and a column for the current pattern, or for the
+// one hold would bring in. The column is the pattern box's grid X, offset so
+// boxes hanging off the left wall get a column too.
+#define VECENV_COLUMNS (GRID_WIDTH + MOVEGEN_X_OFFSET)
+#define VECENV_NUM_ACTIONS (2 * 4 * VECENV_COLUMNS)
+#define VECENV_ACTION(UseHold, Rotation, GridX) \
+    ((((UseHold) * 4) + (Rotation)) * VECENV_COLUMNS + (GridX) + MOVEGEN_X_OFFSET)
+#define VECENV_ILLEGAL_ACTION_Y -128
+
+// Observation layout, in bytes from the start of each game's observation
+enum
+{
+    VECENV_OBS_BOARD       = 0,                                        // 1 per filled cell, row major
+    VECENV_OBS_CURRENT     = VECENV_OBS_BOARD + GRID_HEIGHT * GRID_WIDTH, // PatternType_t
+    VECENV_OBS_HOLD        = VECENV_OBS_CURRENT + 1,                   // PatternType_t
+    VECENV_OBS_QUEUE       = VECENV_OBS_HOLD + 1,                      // NEXT_QUEUE_SIZE PatternType_t, next first
+    VECENV_OBS_CAN_HOLD    = VECENV_OBS_QUEUE + NEXT_QUEUE_SIZE,
+    VECENV_OBS_ACTION_MASK = VECENV_OBS_CAN_HOLD + 1,                  // 1 per legal action, none when topped out
+    VECENV_OBS_SIZE        = VECENV_OBS_ACTION_MASK + VECENV_NUM_ACTIONS,
+};
+
+typedef struct
+{
+    Sim_t          Sim;
+    Uint64         Seed;
+    Uint32         DecisionSpawnFrame; // lastSpawnFrame when the current action was chosen
+    Sint8          ActionY[VECENV_NUM_ACTIONS]; // Where each action lands, if legal
+    MoveGenSteer_t Steer;
+} VecEnvGame_t;
+
+struct VecEnv_s;
+
+typedef struct
+{
+    struct VecEnv_s* pEnv;
+    pthread_t        Thread;
+    int              FirstGame;
+    int              LastGame;
+    MoveGen_t        MoveGen;
+} VecEnvWorker_t;
+
+typedef struct VecEnv_s
+{
+    int             NumGames;
+    int             NumThreads;
+    VecEnvGame_t*   pGames;
+    VecEnvWorker_t* pWorkers;
+
+    pthread_mutex_t Lock;
+    pthread_cond_t  WorkReady;
+    pthread_cond_t  WorkDone;
+    Uint32          Generation;
+    int             WorkersBusy;
+    bool            Quit;
+
+    // Arguments of the call being worked on, pActions is NULL for a reset
+    const Uint16*   pActions;
+    Uint8*          pObsOut;
+    float*          pRewardOut;
+    Uint8*          pDoneOut;
+} VecEnv_t;
+
+////////////////////////////////////////////////////////////////////////////////
+// Games
+////////////////////////////////////////////////////////////////////////////////
+static void vecEnvMarkActions(
+    VecEnvGame_t* pGame,
+    MoveGen_t* pGen,
+    Uint16 numPlacements,
+    bool useHold)
+{
+    for (Uint16 i = 0; i < numPlacements; ++i)
+    {
+        const MoveGenPlacement_t* pPlacement = &(pGen->Placements[i]);
+        if (pPlacement->Flags & MOVEGEN_PLACEMENT_LOCK_OUT)
+        {
+            continue;
+        }
+
+        // Several placements can share a rotation and column (tucks, spins),
+        // the action means the highest one, where a hard drop lands
+        const int Action = VECENV_ACTION(useHold, pPlacement->Rotation, pPlacement->X);
+        if (pGame->ActionY[Action] == VECENV_ILLEGAL_ACTION_Y ||
+            pPlacement->Y < pGame->ActionY[Action])
+        {
+            pGame->ActionY[Action] = pPlacement->Y;
+        }
+    }
+}
+
+static void vecEnvObserve(VecEnvGame_t* pGame, MoveGen_t* pGen, Uint8* pObsOut)
+{
+    const SimState_t* pState = &(pGame->Sim.state);
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+        for (int x = 0; x < GRID_WIDTH; ++x)
+        {
+            pObsOut[VECENV_OBS_BOARD + y * GRID_WIDTH + x] = (pState->rowBits[y] >> x) & 1;
+        }
+    }
+
+    pObsOut[VECENV_OBS_CURRENT] = pState->currentPatternType;
+    pObsOut[VECENV_OBS_HOLD] = pState->holdPatternType;
+    for (int i = 0; i < NEXT_QUEUE_SIZE; ++i)
+    {
+        pObsOut[VECENV_OBS_QUEUE + i] =
+            pState->nextQueue[(pState->nextQueueIndex + i) % NEXT_QUEUE_SIZE];
+    }
+
+    const bool CanHold = !pState->hasDoneHold && !pState->isGameOver;
+    pObsOut[VECENV_OBS_CAN_HOLD] = CanHold;
+
+    memset(pGame->ActionY, VECENV_ILLEGAL_ACTION_Y, sizeof(pGame->ActionY));
+    if (!pState->isGameOver)
+    {
+        vecEnvMarkActions(pGame, pGen, MoveGenGenerateForSim(pGen, &(pGame->Sim)), false);
+    }
+
+    if (CanHold)
+    {
+        // Hold swaps in the held pattern, or the next one, at its spawn
+        const PatternType_t HoldType = pState->holdPatternType != PATTERN_NONE ?
+            pState->holdPatternType :
+            SimTopFromNextQueue(&(pGame->Sim));
+        Sint8 spawnX;
+        Sint8 spawnY;
+        SimGetSpawnPosition(HoldType, &spawnX, &spawnY);
+        const Uint16 NumPlacements = MoveGenGenerate(pGen, pState->rowBits, HoldType, spawnX, spawnY, 0);
+        vecEnvMarkActions(pGame, pGen, NumPlacements, true);
+    }
+
+    for (int i = 0; i < VECENV_NUM_ACTIONS; ++i)
+    {
+        pObsOut[VECENV_OBS_ACTION_MASK + i] = pGame->ActionY[i] != VECENV_ILLEGAL_ACTION_Y;
+    }
+}
+
+// Steps the game until its current pattern can take an action, or it ends.
+// Patterns spawn before cleared rows collapse, so this also waits out the
+// clear; the sim takes no inputs and applies no gravity until then, and the
+// board observed is the one the action will land on.
+static void vecEnvAdvance(VecEnvGame_t* pGame)
+{
+    Sim_t* pSim = &(pGame->Sim);
+    for (int frame = 0; frame < VECENV_MAX_STEP_FRAMES; ++frame)
+    {
+        if (pSim->state.isGameOver ||
+            (SimPatternInPlay(pSim) &&
+             pSim->state.clearRows == 0 &&
+             pSim->state.lastSpawnFrame != pGame->DecisionSpawnFrame))
+        {
+            break;
+        }
+
+        SimStep(pSim, pSim->state.isIntro ? SIM_INPUT_BEGIN : SIM_INPUT_NONE);
+    }
+
+    pGame->DecisionSpawnFrame = pSim->state.lastSpawnFrame;
+}
+
+static void vecEnvResetGame(VecEnv_t* pEnv, VecEnvGame_t* pGame)
+{
+    SimInitialize(&(pGame->Sim), pGame->Seed);
+    pGame->Seed += pEnv->NumGames;
+
+    // The first pattern doesn't spawn, it's simply there
+    pGame->DecisionSpawnFrame = (Uint32)-1;
+    vecEnvAdvance(pGame);
+}
+
+// Plays one action and returns the lines it cleared
+static int vecEnvPlayAction(VecEnvGame_t* pGame, MoveGen_t* pGen, Uint16 action)
+{
+    Sim_t* pSim = &(pGame->Sim);
+    const Uint16 StartLines = pSim->state.totalClearedLines;
+    const bool Legal =
+        action < VECENV_NUM_ACTIONS &&
+        pGame->ActionY[action] != VECENV_ILLEGAL_ACTION_Y;
+    const bool UseHold = Legal && action >= VECENV_NUM_ACTIONS / 2;
+    if (Legal)
+    {
+        const Uint16 Placement = action % (VECENV_NUM_ACTIONS / 2);
+        MoveGenSteerBegin(
+            &(pGame->Steer),
+            (Sint8)(Placement % VECENV_COLUMNS) - MOVEGEN_X_OFFSET,
+            pGame->ActionY[action],
+            Placement / VECENV_COLUMNS);
+    }
+
+    for (int frame = 0; frame < VECENV_MAX_STEP_FRAMES; ++frame)
+    {
+        if (pSim->state.isGameOver || pSim->state.lastSpawnFrame != pGame->DecisionSpawnFrame)
+        {
+            break;
+        }
+
+        Uint16 inputs = SIM_INPUT_NONE;
+        if (!Legal)
+        {
+            // Illegal actions hard drop the pattern where it is
+            inputs = SIM_INPUT_UP;
+        }
+        else if (SimPatternInPlay(pSim))
+        {
+            inputs = UseHold && !pSim->state.hasDoneHold ?
+                SIM_INPUT_HOLD :
+                MoveGenSteerNextInputs(&(pGame->Steer), pGen, pSim);
+        }
+
+        SimStep(pSim, inputs);
+    }
+
+    const int Lines = pSim->state.totalClearedLines - StartLines;
+    vecEnvAdvance(pGame);
+    return Lines;
+}
+
+static void vecEnvWorkerRun(VecEnvWorker_t* pWorker)
+{
+    VecEnv_t* pEnv = pWorker->pEnv;
+    for (int i = pWorker->FirstGame; i < pWorker->LastGame; ++i)
+    {
+        VecEnvGame_t* pGame = &(pEnv->pGames[i]);
+        Uint8* pObs = pEnv->pObsOut + (size_t)i * VECENV_OBS_SIZE;
+        if (!pEnv->pActions)
+        {
+            vecEnvResetGame(pEnv, pGame);
+        }
+        else
+        {
+            const int Lines = vecEnvPlayAction(pGame, &(pWorker->MoveGen), pEnv->pActions[i]);
+            const bool Done = pGame->Sim.state.isGameOver;
+            pEnv->pRewardOut[i] = (float)Lines;
+            pEnv->pDoneOut[i] = Done;
+            if (Done)
+            {
+                vecEnvResetGame(pEnv, pGame);
+            }
+        }
+
+        vecEnvObserve(pGame, &(pWorker->MoveGen), pObs);
+    }
+}
+
+static void* vecEnvWorkerMain(void* pArg)
+{
+    VecEnvWorker_t* pWorker = (VecEnvWorker_t*)pArg;
+    VecEnv_t* pEnv = pWorker->pEnv;
+
+    Uint32 seenGeneration = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&(pEnv->Lock));
+        while (!pEnv->Quit && pEnv->Generation == seenGeneration)
+        {
+            pthread_cond_wait(&(pEnv->WorkReady), &(pEnv->Lock));
+        }
+
+        seenGeneration = pEnv->Generation;
+        const bool Quit = pEnv->Quit;
+        pthread_mutex_unlock(&(pEnv->Lock));
+
+        if (Quit)
+        {
+            return NULL;
+        }
+
+        vecEnvWorkerRun(pWorker);
+
+        pthread_mutex_lock(&(pEnv->Lock));
+        if (--pEnv->WorkersBusy == 0)
+        {
+            pthread_cond_signal(&(pEnv->WorkDone));
+        }
+        pthread_mutex_unlock(&(pEnv->Lock));
+    }
+}
+
+static void vecEnvRunAll(VecEnv_t* pEnv)
+{
+    const int NumHelpers = pEnv->NumThreads - 1;
+    if (NumHelpers > 0)
+    {
+        pthread_mutex_lock(&(pEnv->Lock));
+        pEnv->WorkersBusy = NumHelpers;
+        pEnv->Generation++;
+        pthread_cond_broadcast(&(pEnv->WorkReady));
+        pthread_mutex_unlock(&(pEnv->Lock));
+    }
+
+    vecEnvWorkerRun(&(pEnv->pWorkers[0]));
+
+    if (NumHelpers > 0)
+    {
+        pthread_mutex_lock(&(pEnv->Lock));
+        while (pEnv->WorkersBusy > 0)
+        {
+            pthread_cond_wait(&(pEnv->WorkDone), &(pEnv->Lock));
+        }
+        pthread_mutex_unlock(&(pEnv->Lock));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////////////////////////
+int VecEnvObservationSize()
+{
+    return VECENV_OBS_SIZE;
+}
+
+int VecEnvNumActions()
+{
+    return VECENV_NUM_ACTIONS;
+}
+
+void VecEnvDestroy(VecEnv_t* pEnv)
+{
+    if (!pEnv)
+    {
+        return;
+    }
+
+    if (pEnv->pWorkers)
+    {
+        pthread_mutex_lock(&(pEnv->Lock));
+        pEnv->Quit = true;
+        pthread_cond_broadcast(&(pEnv->WorkReady));
+        pthread_mutex_unlock(&(pEnv->Lock));
+
+        for (int i = 1; i < pEnv->NumThreads; ++i)
+        {
+            pthread_join(pEnv->pWorkers[i].Thread, NULL);
+        }
+    }
+
+    pthread_mutex_destroy(&(pEnv->Lock));
+    pthread_cond_destroy(&(pEnv->WorkReady));
+    pthread_cond_destroy(&(pEnv->WorkDone));
+    free(pEnv->pWorkers);
+    free(pEnv->pGames);
+    free(pEnv);
+}
+
+// Game i plays seeds seed + i, seed + i + numEnvs, ... in turn. numThreads
+// of 0 uses every online core.
+VecEnv_t* VecEnvCreate(int numEnvs, Uint64 seed, int numThreads)
+{
+    if (numEnvs < 1)
+    {
+        fprintf(stderr, "VecEnvCreate needs at least one environment\n");
+        return NULL;
+    }
+
+    SimInitializeTables();
+
+    VecEnv_t* pEnv = calloc(1, sizeof(VecEnv_t));
+    if (!pEnv)
+    {
+        return NULL;
+    }
+
+    if (numThreads <= 0)
+    {
+        numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    numThreads = numThreads > VECENV_MAX_THREADS ? VECENV_MAX_THREADS : numThreads;
+    numThreads = numThreads > numEnvs ? numEnvs : numThreads;
+    pEnv->NumGames = numEnvs;
+    pEnv->NumThreads = numThreads < 1 ? 1 : numThreads;
+
+    pthread_mutex_init(&(pEnv->Lock), NULL);
+    pthread_cond_init(&(pEnv->WorkReady), NULL);
+    pthread_cond_init(&(pEnv->WorkDone), NULL);
+
+    pEnv->pGames = calloc(numEnvs, sizeof(VecEnvGame_t));
+    pEnv->pWorkers = calloc(pEnv->NumThreads, sizeof(VecEnvWorker_t));
+    if (!pEnv->pGames || !pEnv->pWorkers)
+    {
+        fprintf(stderr, "Failed to allocate %d environments\n", numEnvs);
+        VecEnvDestroy(pEnv);
+        return NULL;
+    }
+
+    for (int i = 0; i < numEnvs; ++i)
+    {
+        pEnv->pGames[i].Seed = seed + i;
+    }
+
+    for (int i = 0; i < pEnv->NumThreads; ++i)
+    {
+        VecEnvWorker_t* pWorker = &(pEnv->pWorkers[i]);
+        pWorker->pEnv = pEnv;
+        pWorker->FirstGame = (int)((Sint64)numEnvs * i / pEnv->NumThreads);
+        pWorker->LastGame = (int)((Sint64)numEnvs * (i + 1) / pEnv->NumThreads);
+    }
+
+    for (int i = 1; i < pEnv->NumThreads; ++i)
+    {
+        if (pthread_create(&(pEnv->pWorkers[i].Thread), NULL, vecEnvWorkerMain, &(pEnv->pWorkers[i])) != 0)
+        {
+            fprintf(stderr, "Failed to create environment thread %d\n", i);
+            pEnv->NumThreads = i;
+            VecEnvDestroy(pEnv);
+            return NULL;
+        }
+    }
+
+    return pEnv;
+}
+
+// Starts a new game in every environment
+void VecEnvReset(VecEnv_t* pEnv, Uint8* pObsOut)
+{
+    pEnv->pActions = NULL;
+    pEnv->pObsOut = pObsOut;
+    vecEnvRunAll(pEnv);
+}
+
+// Plays one action per game. Actions missing from the game's last action
+// mask hard drop the current pattern where it is.
+void
+VecEnvStep(
+    VecEnv_t* pEnv,
+    const Uint16* pActions,
+    Uint8* pObsOut,
+    float* pRewardOut,
+    Uint8* pDoneOut)
+{
+    pEnv->pActions = pActions;
+    pEnv->pObsOut = pObsOut;
+    pEnv->pRewardOut = pRewardOut;
+    pEnv->pDoneOut = pDoneOut;
+    vecEnvRunAll(pEnv);
+}
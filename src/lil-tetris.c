@@ -1,3 +1,5 @@
+#define _GNU_SOURCE // pipe2() for external bots
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
@@ -10,20 +12,19 @@
 #include <assert.h>
 
 #include "lil-tetris-audio.c"
-#include "lil-tetris-patterns.c"
+#include "lil-tetris-sim.c"
+#include "lil-tetris-policy.c"
+#include "lil-tetris-replay.c"
 #include "lil-tetris-themes.c"
 #include "lil-tetris-text.c"
 #include "lil-tetris-particles.c"
 #include "lil-tetris-input.c"
+#include "lil-tetris-finesse.c"
 
 // Constants
 #define SCREEN_WIDTH 640
 #define SCREEN_HEIGHT 480
 
-#define FPS 60.0f
-
-#define GRID_HEIGHT 20
-#define GRID_WIDTH 10
 #define GRID_UPPER_X 200
 #define GRID_UPPER_Y 50
 #define GRID_CELL_WIDTH 20
@@ -37,10 +38,11 @@
 #define STATS_LOC_X 30
 #define STATS_LOC_Y 356
 #define STATS_W 140
-#define STATS_H 95
+#define STATS_H 124
 #define STATS_TEXT_BORDERLEFT_X 5
 #define STATS_LEVEL_LOC_Y (STATS_LOC_Y + 30)
 #define STATS_BEST_LOC_Y (STATS_LEVEL_LOC_Y + 30)
+#define STATS_FAULTS_LOC_Y (STATS_BEST_LOC_Y + 30)
 
 #define STATS_BEST_FILEPATH "/tmp/highscore"
 
@@ -72,33 +74,14 @@
 #define HOLD_PATTERN_Y 50
 #define HOLD_PATTERN_BORDER 5
 
-#define SPAWN_DELAY_FRAMES 6
-#define CLEAR_LINES_FRAMES 15
 #define CLEAR_LINES_FLASH_DURATION 10
 
-#define GAMEOVER_ANIM_DURATION_FRAMES 60
 #define GAMEOVER_SHOW_GAMEOVER_FRAMES 50
-#define GAMEOVER_SHOW_RETRY_FRAMES 90
 
 #define LEVELUP_ANIM_DURATION_FRAMES 15
 #define LEVELUP_TEXT_DURATION_FRAMES 70
 
-#define LOCK_DELAY_FRAMES 60
-
-#define START_DROP_SPEED 1
-
-#define NEXT_QUEUE_SIZE 4
-
-#define LEVELUP_LINE_INTERVAL 10
-
 // Types
-typedef struct
-{
-    Uint8      x;
-    Uint8      y;
-    PatternType_t patternType;
-} GridCell;
-
 typedef struct
 {
     SDL_Rect Rects[GRID_HEIGHT * GRID_WIDTH];
@@ -111,174 +94,68 @@ typedef struct
     SDLRectArray RectArrays[(int)PATTERN_MAX_VALUE];
 } SDLRectArrays;
 
+// Cell styles beyond one per pattern type, each gets an atlas tile
+#define CELL_TILE_SHADOW ((int)PATTERN_MAX_VALUE)
+#define CELL_TILE_WHITE ((int)PATTERN_MAX_VALUE + 1)
+#define CELL_TILE_COUNT ((int)PATTERN_MAX_VALUE + 2)
+
+// Enough for the whole grid with every cell blending toward white
+#define CELL_BATCH_MAX_QUADS (2 * GRID_HEIGHT * GRID_WIDTH)
+
+// Cells are drawn as textured quads cut from an atlas holding one tile per
+// cell style, painted once per theme. Quads pile up here and go out in a
+// single SDL_RenderGeometry call instead of two fills per cell style.
+typedef struct
+{
+    SDL_Texture*  pAtlas;
+    PatternTheme* pAtlasTheme;   // Theme the tiles were painted in, NULL to repaint
+    bool          IsUnsupported; // No render targets, cells are filled instead
+    int           NumQuads;
+    SDL_Vertex    Vertices[CELL_BATCH_MAX_QUADS * 4];
+    int           Indices[CELL_BATCH_MAX_QUADS * 6];
+} CellBatch;
+
+// The committed cells live in a render target texture that's copied to the
+// screen every frame. Only rows whose cells differ from what was last drawn
+// get redrawn, which outside of commits and clears is none of them.
+typedef struct
+{
+    SDL_Texture*  pTexture;
+    Uint8         DrawnTypes[GRID_HEIGHT][GRID_WIDTH]; // PatternType_t each cell was drawn as
+    float         DrawnAlpha;
+    PatternTheme* pDrawnTheme;
+    bool          IsValid;       // Every row holds DrawnTypes
+    bool          IsUnsupported; // No render targets, cells are drawn every frame
+} GridCache;
+
 typedef struct
 {
-    PatternType_t randomBag[PATTERN_MAX_VALUE - 1];
-    PatternType_t nextQueue[NEXT_QUEUE_SIZE];
-    PatternType_t currentPatternType;
-    PatternType_t holdPatternType;
+    Sim_t      Sim;
+    Random_t   CosmeticRandom;
 	PatternTheme* pCurrentTheme;
     ParticleSystem_t DropParticles;
     ParticleSystem_t LineClearParticles;
-    Sint8      patternGridX;
-    Sint8      patternGridY;
-    Uint8      currentPatternRotation;
-    Uint8      randomBagIndex;
-    Uint8      nextQueueIndex;
-    Uint64     currentFrame;
-    Uint64     lastDropFrame;
-    Uint64     preSpawnFrame;
-    Uint64     lastSpawnFrame;
-    Uint64     levelUpFrame;
-    Uint64     lockBeginFrame;
-    Uint64     gameOverFrame;
-    Uint8      dropSpeed;
-    Sint8      clearLines[GRID_HEIGHT];
-    Uint64     clearLinesFrame;
-    Uint16     totalClearedLines;
-    Uint8      currentLevel;
     Uint8      currentBest;
     HTEXT      hNextText;
     HTEXT      hHoldText;
     HTEXT      hLinesText;
     HTEXT      hLevelText;
     HTEXT      hBestText;
+    HTEXT      hFaultsText;
     HTEXT      hPausedText;
     HTEXT      hIntroText;
     HTEXT      hGameOverText;
     HTEXT      hRetryText;
     HTEXT      hLevelUpText;
-    bool       inputLeftPressed;
-    bool       inputRightPressed;
-    bool       inputDownPressed;
-    bool       inputUpPressed;
-    bool       inputRotateRightPressed;
-    bool       inputRotateLeftPressed;
-    bool       inputHoldPiece;
-    bool       inputPauseGame;
-    bool       inputBeginGame;
-    bool       inputRetryGame;
-    bool       isPaused;
-    bool       isIntro;
-    bool       isGameOver;
-    bool       renderCells;
-    bool       hasDoneHold;
     InputContext InputContext;
+    FinesseTracker_t Finesse;
 } GameState;
 
 // Globals
 static GameState g_GameState;
-static GridCell g_Grid[GRID_HEIGHT][GRID_WIDTH];
 static SDLRectArrays g_RectArrays;
-static Pattern** g_PatternLUT[(int)PATTERN_MAX_VALUE] = {
-    EmptyPatternRotations,
-    LPatternLeftRotations,
-    LPatternRightRotations,
-    ZPatternLeftRotations,
-    ZPatternRightRotations,
-    TPatternRotations,
-    LinePatternRotations,
-    SquarePatternRotations,
-};
-
-void getSpawnPosition(PatternType_t patternType, Sint8* pXOut, Sint8* pYOut)
-{
-    Pattern* pPattern = g_PatternLUT[patternType][0];
-    *pXOut = (GRID_WIDTH / 2) - (pPattern->cols / 2);
-    *pYOut = -pPattern->rows;
-}
-
-void resetInputStates()
-{
-    g_GameState.inputLeftPressed = false;
-    g_GameState.inputRightPressed = false;
-    g_GameState.inputDownPressed = false;
-    g_GameState.inputUpPressed = false;
-    g_GameState.inputRotateRightPressed = false;
-    g_GameState.inputRotateLeftPressed = false;
-    g_GameState.inputHoldPiece = false;
-    g_GameState.inputPauseGame = false;
-    g_GameState.inputBeginGame = false;
-    g_GameState.inputRetryGame = false;
-}
-
-void resetRandomBag()
-{
-    // Initialize
-    const Uint8 Begin = (Uint8)(PATTERN_NONE + 1);
-    const Uint8 End = (Uint8)PATTERN_MAX_VALUE;
-    for (Uint8 i = Begin; i < End; ++i)
-    {
-        g_GameState.randomBag[i - 1] = i;
-    }
-
-    // Shuffle
-    const Uint8 NumElements =
-        sizeof(g_GameState.randomBag) /
-        sizeof(g_GameState.randomBag[0]);
-    for (Uint8 i = Begin; i < End; ++i)
-    {
-        const Uint8 a = rand() % NumElements;
-        Uint8 b = rand() % NumElements;
-
-        // No noops allowed
-        while (b == a)
-        {
-            b = rand() % NumElements;
-        }
-
-        // Swap a & b
-        const Uint8 temp = g_GameState.randomBag[a];
-        g_GameState.randomBag[a] = g_GameState.randomBag[b];
-        g_GameState.randomBag[b] = temp;
-    }
-
-    g_GameState.randomBagIndex = 0;
-}
-
-PatternType_t nextPatternTypeFromRandomBag()
-{
-    const Uint8 NumElements =
-        sizeof(g_GameState.randomBag) /
-        sizeof(g_GameState.randomBag[0]);
-    if (g_GameState.randomBagIndex >= NumElements)
-    {
-        resetRandomBag();
-    }
-
-    PatternType_t nextType = g_GameState.randomBag[g_GameState.randomBagIndex];
-    g_GameState.randomBagIndex++;
-
-    return nextType;
-}
-
-void initializeNextQueue()
-{
-    resetRandomBag();
-    for (Uint8 i = 0; i < NEXT_QUEUE_SIZE; ++i)
-    {
-        g_GameState.nextQueue[i] = nextPatternTypeFromRandomBag();
-    }
-
-    g_GameState.nextQueueIndex = 0;
-}
-
-PatternType_t popFromNextQueue()
-{
-    PatternType_t returnValue = g_GameState.nextQueue[g_GameState.nextQueueIndex];
-    g_GameState.nextQueueIndex = (g_GameState.nextQueueIndex + 1) % NEXT_QUEUE_SIZE;
-
-    // Tail always sits NEXT_QUEUE_SIZE - 1 slots ahead
-    Uint8 nextQueueTail = (g_GameState.nextQueueIndex + (NEXT_QUEUE_SIZE - 1)) % NEXT_QUEUE_SIZE;
-
-    g_GameState.nextQueue[nextQueueTail] = nextPatternTypeFromRandomBag();
-    return returnValue;
-}
-
-PatternType_t topFromNextQueue()
-{
-    return g_GameState.nextQueue[g_GameState.nextQueueIndex];
-}
+static GridCache g_GridCache;
+static CellBatch g_CellBatch;
 
 Uint8 readBestFromFilesystem() 
 {
@@ -312,49 +189,30 @@ bool writeBestToFilesystem()
     return Success;
 }
 
-void initializeGameState()
+void initializeGameState(Uint64 seed)
 {
-    initializeNextQueue();
+    SimInitialize(&(g_GameState.Sim), seed);
+
+    // Particles and such get their own stream so they never perturb gameplay
+    g_GameState.CosmeticRandom = g_GameState.Sim.state.random;
+    RandomJump(&(g_GameState.CosmeticRandom));
 
-    g_GameState.currentPatternType = popFromNextQueue();
-    g_GameState.holdPatternType = PATTERN_NONE;
 	g_GameState.pCurrentTheme = g_DefaultThemes;
-    g_GameState.currentPatternRotation = 0;
-    g_GameState.currentFrame = 0;
-    g_GameState.lastDropFrame = 0;
-    g_GameState.preSpawnFrame = 0;
-    g_GameState.lastSpawnFrame = 0;
-    g_GameState.levelUpFrame = 0;
-    g_GameState.lockBeginFrame = 0;
-    g_GameState.gameOverFrame = 0;
-    g_GameState.dropSpeed = START_DROP_SPEED; // Drops per second
-    memset(g_GameState.clearLines, -1, sizeof(g_GameState.clearLines));
-    g_GameState.clearLinesFrame = 0;
-    g_GameState.totalClearedLines = 0;
-    g_GameState.currentLevel = 1;
     g_GameState.currentBest = readBestFromFilesystem();
     g_GameState.hNextText = TEXT_INVALID_HANDLE;
     g_GameState.hHoldText = TEXT_INVALID_HANDLE;
     g_GameState.hLinesText = TEXT_INVALID_HANDLE;
     g_GameState.hLevelText = TEXT_INVALID_HANDLE;
     g_GameState.hBestText = TEXT_INVALID_HANDLE;
+    g_GameState.hFaultsText = TEXT_INVALID_HANDLE;
     g_GameState.hPausedText = TEXT_INVALID_HANDLE;
     g_GameState.hIntroText = TEXT_INVALID_HANDLE;
     g_GameState.hGameOverText = TEXT_INVALID_HANDLE;
     g_GameState.hRetryText = TEXT_INVALID_HANDLE;
     g_GameState.hLevelUpText = TEXT_INVALID_HANDLE;
-    g_GameState.isPaused = false;
-    g_GameState.isIntro = true;
-    g_GameState.isGameOver = false;
-    g_GameState.renderCells = true;
-    g_GameState.hasDoneHold = false;
 
-    getSpawnPosition(
-        g_GameState.currentPatternType,
-        &(g_GameState.patternGridX),
-        &(g_GameState.patternGridY));
-
-    resetInputStates();
+    FinesseInitialize();
+    FinesseTrackerReset(&(g_GameState.Finesse));
 
     InputContext* pInput = &(g_GameState.InputContext);
     InputInitializeContext(&(g_GameState.InputContext));
@@ -397,61 +255,6 @@ void initializeGameState()
 
 }
 
-Pattern* getCurrentPattern()
-{
-    const PatternType_t CurrentType = g_GameState.currentPatternType;
-    const Uint8 CurrentRotation = g_GameState.currentPatternRotation;
-    return g_PatternLUT[CurrentType][CurrentRotation];
-}
-
- enum PatternCollision {
-     COLLIDES_NONE      = 0,
-     COLLIDES_BOTTOM    = 1 << 0,
-     COLLIDES_LEFT      = 1 << 1,
-     COLLIDES_RIGHT     = 1 << 2,
-     COLLIDES_COMMITTED = 1 << 3,
-};
-
-Uint8 patternCollides(Pattern* pPattern, Sint8 dX, Sint8 dY)
-{
-    int collisionFlags = COLLIDES_NONE;
-    for (int y = 0; y < 4; ++y) {
-        for (int x = 0; x < 4; ++x) {
-            if (pPattern->occupancy[y][x])
-            {
-                Sint8 gridX = x + g_GameState.patternGridX + dX;
-                Sint8 gridY = y + g_GameState.patternGridY + dY;
-
-                // Collides with bottom?
-                if (gridY >= GRID_HEIGHT)
-                {
-                    collisionFlags |= COLLIDES_BOTTOM;
-                }
-
-                // Collides with left?
-                if (gridX < 0)
-                {
-                    collisionFlags |= COLLIDES_LEFT;
-                }
-
-                // Collides with right?
-                if (gridX >= GRID_WIDTH)
-                {
-                    collisionFlags |= COLLIDES_RIGHT;
-                }
-
-                // Collides with committed cells?
-                if (gridY >= 0 && g_Grid[gridY][gridX].patternType != PATTERN_NONE)
-                {
-                    collisionFlags |= COLLIDES_COMMITTED;
-                }
-            }
-        }
-    }
-
-    return collisionFlags;
-}
-
 int CellBorderFromType(PatternType_t patternType)
 {
     if (patternType == PATTERN_NONE)
@@ -464,781 +267,472 @@ int CellBorderFromType(PatternType_t patternType)
     }
 }
 
-bool 
-ResolveWallKick(
-    WallKickRotateDirection rotateDirection,
-    Pattern* pRotatedPattern,
-    int rotationIndex,
-    WallKickVector2* pKickVectorOut)
-{
-    assert(rotateDirection == WALLKICK_DIRECTION_RIGHT ||
-           rotateDirection == WALLKICK_DIRECTION_LEFT);
-
-    const PatternType_t PatternType = g_GameState.currentPatternType;
-    const WallKickVector2* pTests = NULL;
-    if (PatternType == PATTERN_LINE_SHAPE)
-    {
-        if (rotateDirection == WALLKICK_DIRECTION_RIGHT)
-        {
-            pTests = PatternLineWallKickRightRotationTests[rotationIndex];
-        }
-        else
-        {
-            pTests = PatternLineWallKickLeftRotationTests[rotationIndex];
-        }
-    }
-    else
-    {
-        if (rotateDirection == WALLKICK_DIRECTION_RIGHT)
-        {
-            pTests = PatternNonLineWallKickRightRotationTests[rotationIndex];
-        }
-        else
-        {
-            pTests = PatternNonLineWallKickLeftRotationTests[rotationIndex];
-        }
-    }
-
-    for (Sint8 i = 0; i < PATTERN_MAX_KICK_TESTS; ++i)
-    {
-        WallKickVector2 kickDelta = pTests[i];
-        if (!patternCollides(pRotatedPattern, kickDelta.X, kickDelta.Y))
-        {
-            *pKickVectorOut = kickDelta;
-            return true;
-        }
-    }
-
-    return false;
-}
-
-bool waitingToSpawn()
-{
-    Uint64 sincePreSpawn = g_GameState.currentFrame - g_GameState.preSpawnFrame;
-    return sincePreSpawn < SPAWN_DELAY_FRAMES && g_GameState.preSpawnFrame > 0;
-}
-
-bool isSpawnFrame()
-{
-    Uint64 sincePreSpawn = g_GameState.currentFrame - g_GameState.preSpawnFrame;
-    return sincePreSpawn == SPAWN_DELAY_FRAMES && g_GameState.preSpawnFrame > 0;
-}
-
-bool isClearingLines()
-{
-    const bool ClearingLines = g_GameState.clearLines[0] >= 0;
-    Uint64 sinceClearedLines = g_GameState.currentFrame - g_GameState.clearLinesFrame;
-    return ClearingLines || sinceClearedLines < CLEAR_LINES_FRAMES;
-}
-
-bool isLineBeingCleared(Sint8 gridY)
+void getGridPosition(Uint8* pXOut, Uint8* pYOut)
 {
-    // Don't render any pattern cells that are being cleared
-    Sint8 clearLineIndex = 0;
-    Sint8 y = g_GameState.clearLines[clearLineIndex];
-    while (y >= 0 && clearLineIndex < sizeof(g_GameState.clearLines))
-    {
-        if (y == gridY)
-        {
-            return true;
-        }
-
-        ++clearLineIndex;
-        y = g_GameState.clearLines[clearLineIndex];
-    }
+    const Sim_t* pSim = &(g_GameState.Sim);
+    Uint64 sincePreSpawn = pSim->state.currentFrame - pSim->state.preSpawnFrame;
+    Uint8 yOffset = 
+        (pSim->state.lastDropFrame > 0 && sincePreSpawn < GRID_DISPLACE_DURATION) ? 
+            GRID_DISPLACE_AMOUNT : 0;
 
-    return false;
+    *pXOut = GRID_UPPER_X;
+    *pYOut = GRID_UPPER_Y + yOffset;
 }
 
-void commitCurrentPattern()
+////////////////////////////////////////////////////////////////////////////////
+// Drop particles
+////////////////////////////////////////////////////////////////////////////////
+int dropParticleOffsetX()
 {
-    if (g_GameState.isGameOver)
-    {
-        return;
-    }
-
-    Pattern* pPattern = getCurrentPattern();
-    for (int y = 0; y < 4; ++y) {
-        for (int x = 0; x < 4; ++x) {
-            if (pPattern->occupancy[y][x])
-            {
-                Sint8 gridX = x + g_GameState.patternGridX;
-                Sint8 gridY = y + g_GameState.patternGridY;
-
-                if (gridY < 0)
-                {
-                    // If we commit any cells above the grid, the game is over
-                    g_GameState.isGameOver = true;
-                    g_GameState.gameOverFrame = g_GameState.currentFrame;
-                    return;
-                }
-
-                g_Grid[gridY][gridX].patternType = g_GameState.currentPatternType;
-            }
-        }
-    }
-
-    g_GameState.lockBeginFrame = 0;
-    g_GameState.hasDoneHold = false;
-
-    AudioPlayCommit();
+    // Between -20 and 20
+    return (int)RandomRange(&(g_GameState.CosmeticRandom), 40) - 20;
 }
 
-void beginSpawnNextPattern()
+int dropParticleOffsetY()
 {
-    g_GameState.preSpawnFrame = g_GameState.currentFrame;
+    // Between -5 and 5
+    return (int)RandomRange(&(g_GameState.CosmeticRandom), 10) - 5;
 }
 
-void spawnNextPattern()
+int dropParticleSize()
 {
-    g_GameState.currentPatternType = popFromNextQueue();
-    g_GameState.currentPatternRotation = 0;
-    getSpawnPosition(
-        g_GameState.currentPatternType,
-        &(g_GameState.patternGridX),
-        &(g_GameState.patternGridY));
-    g_GameState.lastSpawnFrame = g_GameState.currentFrame;
+    // Between 2 and 8
+    return (int)RandomRange(&(g_GameState.CosmeticRandom), 7) + 2;
 }
 
-void getGridPosition(Uint8* pXOut, Uint8* pYOut)
+int dropParticleShouldCreate()
 {
-    Uint64 sincePreSpawn = g_GameState.currentFrame - g_GameState.preSpawnFrame;
-    Uint8 yOffset = 
-        (g_GameState.lastDropFrame > 0 && sincePreSpawn < GRID_DISPLACE_DURATION) ? 
-            GRID_DISPLACE_AMOUNT : 0;
-
-    *pXOut = GRID_UPPER_X;
-    *pYOut = GRID_UPPER_Y + yOffset;
+    return RandomRange(&(g_GameState.CosmeticRandom), 3);
 }
 
-void checkInputs()
+void emitDropParticles(const SimEvent_t* pEvent)
 {
-    if (g_GameState.inputBeginGame && g_GameState.isIntro)
-    {
-        g_GameState.isIntro = false;
-    }
+    Pattern* pPattern = g_PatternLUT[pEvent->PatternType][pEvent->Rotation];
 
-    if (g_GameState.inputPauseGame)
+    // Emit particles between the current pattern and the drop location
+    for (int i = 0; i < pEvent->Count; ++i)
     {
-        if (!g_GameState.isPaused)
-        {
-            AudioPauseMusic();
-        }
-        else
+        if (!dropParticleShouldCreate())
         {
-            AudioResumeMusic();
+            continue;
         }
 
-        g_GameState.isPaused = !g_GameState.isPaused;
-    }
-
-    // If the game is paused, don't check any other inputs
-    if (g_GameState.isPaused)
-    {
-        return;
-    }
-
-    // Ignore other inputs if we're waiting to spawn
-    if (waitingToSpawn())
-    {
-        return;
-    }
-
-    // Ignore inputs if the game is over
-    if (g_GameState.isGameOver)
-    {
-        return;
-    }
-
-    // Handle player inputs
-    Pattern* pPattern = getCurrentPattern();
-    if (g_GameState.inputLeftPressed && !g_GameState.inputRightPressed)
-    {
-        if (!patternCollides(getCurrentPattern(), -1, 0))
-        {
-            g_GameState.patternGridX--;
-        }
-    }
-    else if (g_GameState.inputRightPressed && !g_GameState.inputLeftPressed)
-    {
-        if (!patternCollides(getCurrentPattern(), 1, 0))
+        // Just one per grid position atm
+        ParticleSystem_t* pParticles = &(g_GameState.DropParticles);
+        const int Index = ParticleSystemMakeParticle(pParticles);
+        if (Index < 0)
         {
-            g_GameState.patternGridX++;
+            continue;
         }
-    }
-    
-    if (g_GameState.inputRotateRightPressed && !g_GameState.inputRotateLeftPressed)
-    {
-        int numRotations = PatternNumRotations[g_GameState.currentPatternType];
-        int rotationIndex = (g_GameState.currentPatternRotation + 1) % numRotations;
-
-        Pattern* pRotatedPattern = 
-            g_PatternLUT[g_GameState.currentPatternType][rotationIndex];
 
-        // Resolve any collisions due to rotation, if possible
-        WallKickVector2 kickVector;
-        if (ResolveWallKick(
-                WALLKICK_DIRECTION_RIGHT,
-                pRotatedPattern,
-                rotationIndex,
-                &kickVector))
-        {
-            g_GameState.currentPatternRotation = rotationIndex;
-            g_GameState.patternGridX += kickVector.X;
-            g_GameState.patternGridY += kickVector.Y;
-        }
-    }
-    else if (g_GameState.inputRotateLeftPressed && !g_GameState.inputRotateRightPressed)
-    {
-        int numRotations = PatternNumRotations[g_GameState.currentPatternType];
-        int rotationIndex = 
-            g_GameState.currentPatternRotation == 0 ? 
-                numRotations - 1 : 
-                g_GameState.currentPatternRotation - 1;
-        Pattern* pRotatedPattern = 
-            g_PatternLUT[g_GameState.currentPatternType][rotationIndex];
-
-        // Resolve any collisions due to rotation, if possible
-        WallKickVector2 kickVector;
-        if (ResolveWallKick(
-                WALLKICK_DIRECTION_LEFT,
-                pRotatedPattern,
-                rotationIndex,
-                &kickVector))
-        {
-            g_GameState.currentPatternRotation = rotationIndex;
-            g_GameState.patternGridX += kickVector.X;
-            g_GameState.patternGridY += kickVector.Y;
-        }
-    }
+        // TODO: hm, not sure if this looks best or if the particles should
+        // have their own dedicated color(s)
+        Color* pColor = 
+            ThemeGetOuterColor(g_GameState.pCurrentTheme, pEvent->PatternType);
+        const SDL_Color SDLColor = {
+            pColor->r,
+            pColor->g,
+            pColor->b,
+            SDL_ALPHA_OPAQUE
+        };
+        pParticles->Color[Index] = SDLColor;
 
-    if (g_GameState.inputHoldPiece && !g_GameState.hasDoneHold)
-    {
-        if (g_GameState.holdPatternType == PATTERN_NONE)
-        {
-            g_GameState.holdPatternType = g_GameState.currentPatternType;
-            g_GameState.currentPatternType = popFromNextQueue();
-        }
-        else
-        {
-            PatternType_t temp = g_GameState.holdPatternType;
-            g_GameState.holdPatternType = g_GameState.currentPatternType;
-            g_GameState.currentPatternType = temp;
-        }
+        Uint8 GridBaseX;
+        Uint8 GridBaseY;
+        getGridPosition(&GridBaseX, &GridBaseY);
 
-        g_GameState.currentPatternRotation = 0;
-        getSpawnPosition(
-            g_GameState.currentPatternType,
-            &(g_GameState.patternGridX),
-            &(g_GameState.patternGridY));
-        g_GameState.hasDoneHold = true;
+        pParticles->Size[Index] = dropParticleSize();
+        pParticles->Lifetime[Index] = i + 15;
+        pParticles->X[Index] =
+            pEvent->X * GRID_CELL_WIDTH + 
+            GridBaseX + 
+            ((pPattern->cols * GRID_CELL_WIDTH) / 2) +
+            dropParticleOffsetX();
+        pParticles->Y[Index] =
+            (pEvent->Y + i) * GRID_CELL_HEIGHT + 
+            GridBaseY +
+            dropParticleOffsetY(); 
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Drop particles
+// Line clear particles
 ////////////////////////////////////////////////////////////////////////////////
-int dropParticleOffsetX()
+#define LINE_CLEAR_PARTICLES_PER_CELL 4
+
+float lineClearParticleVelocityX()
 {
-    // Between -20 and 20
-    return (rand() % 40) - 20;
+    // Between -2.5 and 2.5
+    return ((int)RandomRange(&(g_GameState.CosmeticRandom), 41) - 20) / 8.f;
 }
 
-int dropParticleOffsetY()
+float lineClearParticleVelocityY()
 {
-    // Between -5 and 5
-    return (rand() % 10) - 5;
+    // Between -6 and -2, up and out of the row
+    return -((int)RandomRange(&(g_GameState.CosmeticRandom), 33) + 16) / 8.f;
 }
 
-int dropParticleSize()
+int lineClearParticleSize()
 {
-    // Between 2 and 8
-    return (rand() % 7) + 2;
+    // Between 3 and 6
+    return (int)RandomRange(&(g_GameState.CosmeticRandom), 4) + 3;
 }
 
-int dropParticleShouldCreate()
+int lineClearParticleLifetime()
 {
-    return rand() % 3;
+    // Between 20 and 35
+    return (int)RandomRange(&(g_GameState.CosmeticRandom), 16) + 20;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// Line clear particles
-////////////////////////////////////////////////////////////////////////////////
-void emitLineClearParticles(Uint8 y)
+void emitLineClearParticles(const SimEvent_t* pEvent)
 {
     Uint8 GridBaseX;
     Uint8 GridBaseY;
     getGridPosition(&GridBaseX, &GridBaseY);
 
+    const Sint8 y = pEvent->Y;
     for (Sint8 x = 0; x < GRID_WIDTH; ++x)
     {
-        if (g_Grid[y][x].patternType == PATTERN_NONE)
+        if (pEvent->RowTypes[x] == PATTERN_NONE)
         {
             // This effect is used in game over as well, and we don't
             // want to emit bg-colored particles it just looks bad.
             continue;
         }
 
-        SquareParticle_t* pNewParticle = 
-            ParticleSystemMakeParticle(&(g_GameState.DropParticles));
-        pNewParticle->X = x;
-
-        pNewParticle->Size = 5;
-        pNewParticle->Lifetime = 15;
-        pNewParticle->X =
-            x * GRID_CELL_WIDTH + 
-            GridBaseX + 
-            (GRID_CELL_WIDTH / 2);
-        pNewParticle->Y =
-            y * GRID_CELL_HEIGHT + 
-            GridBaseY;
-
         Color* pColor = 
-            ThemeGetInnerColor(g_GameState.pCurrentTheme, g_Grid[y][x].patternType);
+            ThemeGetInnerColor(g_GameState.pCurrentTheme, pEvent->RowTypes[x]);
         SDL_Color color = {
             pColor->r,
             pColor->g,
             pColor->b,
             SDL_ALPHA_OPAQUE
         };
-        pNewParticle->Color = color;
-    }
-}
-
-void updateGameState()
-{
-    Uint64 sinceLastDrop = g_GameState.currentFrame - g_GameState.lastDropFrame;
-    Uint64 dropFrameTarget = (FPS / g_GameState.dropSpeed);
-
-    if (g_GameState.isPaused || g_GameState.isIntro)
-    {
-        g_GameState.renderCells = false;
-        return;
-    }
-
-    // Check losing condition
-    if (g_GameState.isGameOver)
-    {
-        AudioStopMusic();
 
-        g_GameState.preSpawnFrame = 0;
-
-        // Start blowing up lines
-        const int GameOverFrames =
-            g_GameState.currentFrame - g_GameState.gameOverFrame;
-        const int LineToClear = 
-            ((float)GameOverFrames / GAMEOVER_ANIM_DURATION_FRAMES) *
-            GRID_HEIGHT - 1;
-
-        if (GameOverFrames == 1)
+        // A small burst from each cell. Once the line clear budget is spent
+        // the rest of the burst is dropped.
+        ParticleSystem_t* pParticles = &(g_GameState.LineClearParticles);
+        for (int i = 0; i < LINE_CLEAR_PARTICLES_PER_CELL; ++i)
         {
-            // Play game over sfx only on the first game over frame
-            AudioPlayGameOver();
-        }
-
-        bool hasClearedThisLine = true;
-        for (int x = 0; x < GRID_WIDTH && LineToClear < GRID_HEIGHT; ++x) {
-            if (g_Grid[LineToClear][x].patternType != PATTERN_NONE)
+            const int Index = ParticleSystemMakeParticle(pParticles);
+            if (Index < 0)
             {
-                hasClearedThisLine = false;
-                break;
+                return;
             }
-        }
-
-        if (!hasClearedThisLine)
-        {
-            emitLineClearParticles(LineToClear);
-            for (int x = 0; x < GRID_WIDTH; ++x) {
-                g_Grid[LineToClear][x].patternType = PATTERN_NONE;
-            }
-        }
 
-        // Handle reset input
-        if (GameOverFrames >= GAMEOVER_SHOW_RETRY_FRAMES &&
-            g_GameState.inputRetryGame)
-        {
-            g_GameState.renderCells = true;
-            g_GameState.isGameOver = false;
-
-            initializeNextQueue();
-            g_GameState.currentPatternType = popFromNextQueue();
-
-            // Reset stats and level
-            g_GameState.totalClearedLines = 0;
-            g_GameState.currentLevel = 1;
-            g_GameState.pCurrentTheme = g_DefaultThemes;
-            g_GameState.dropSpeed = START_DROP_SPEED;
-            g_GameState.holdPatternType = PATTERN_NONE;
-
-            spawnNextPattern();
-
-            // Get the music goin' again
-            const bool Success = AudioPlayMusic();
-            assert(Success);
+            pParticles->Size[Index] = lineClearParticleSize();
+            pParticles->Lifetime[Index] = lineClearParticleLifetime();
+            pParticles->X[Index] =
+                x * GRID_CELL_WIDTH + 
+                GridBaseX + 
+                (GRID_CELL_WIDTH / 2);
+            pParticles->Y[Index] =
+                y * GRID_CELL_HEIGHT + 
+                GridBaseY;
+            pParticles->VelocityX[Index] = lineClearParticleVelocityX();
+            pParticles->VelocityY[Index] = lineClearParticleVelocityY();
+            pParticles->Color[Index] = color;
         }
-
-        g_GameState.currentFrame++;
-        return;
-    }
-
-    if (waitingToSpawn())
-    {
-        g_GameState.currentFrame++;
-        return;
-    }
-    else if (isSpawnFrame())
-    {
-        spawnNextPattern();
     }
+}
 
-    if (isClearingLines())
+// Presentation side effects of whatever the simulation did this frame
+void handleSimEvents()
+{
+    const Sim_t* pSim = &(g_GameState.Sim);
+    for (Uint8 i = 0; i < pSim->numEvents; ++i)
     {
-        Uint64 sinceClearedLines = 
-            g_GameState.currentFrame -
-            g_GameState.clearLinesFrame;
-        if (sinceClearedLines >= CLEAR_LINES_FRAMES)
+        const SimEvent_t* pEvent = &(pSim->events[i]);
+        switch (pEvent->Type)
         {
-            // Collapse cleared lines
-            for (Sint8 i = 0; i < GRID_HEIGHT; ++i)
-            {
-                Sint8 y = g_GameState.clearLines[i];
-                if (y < 0)
-                {
-                    break;
-                }
-
-                for (Sint8 j = (y - 1); j >= 0; --j)
+            case SIM_EVENT_COMMIT:
+                AudioPlayCommit();
+                break;
+            case SIM_EVENT_HARD_DROP:
+                emitDropParticles(pEvent);
+                break;
+            case SIM_EVENT_LINE_CLEAR:
+                emitLineClearParticles(pEvent);
+                break;
+            case SIM_EVENT_LINES_CLEARED:
+                AudioPlayLineClear();
+                if (pSim->state.totalClearedLines > g_GameState.currentBest)
                 {
-                    // Copy each line "down" one
-                    for (int x = 0; x < GRID_WIDTH; ++x)
-                    {
-                        if (j == -1)
-                        {
-                            // Always "copy" null patterns from above the grid
-                            g_Grid[j + 1][x].patternType = PATTERN_NONE;
-                        }
-                        else if (j >= 0)
-                        {
-                            g_Grid[j + 1][x].patternType = g_Grid[j][x].patternType;
-                        }
-                        else
-                        {
-                            // Shouldn't get here
-                            assert(false);
-                        }
-                    }
+                    g_GameState.currentBest = pSim->state.totalClearedLines;
+                    writeBestToFilesystem();
                 }
-            }
-
-            memset(g_GameState.clearLines, -1, sizeof(g_GameState.clearLines));
-        }
-
-        g_GameState.currentFrame++;
-        return;
-    }
-
-    g_GameState.renderCells = true;
-
-    // Check for natural drops, player-induced drops or quick drops
-    if (g_GameState.inputUpPressed)
-    {
-        // Figure out how far to drop the current pattern
-        int patternHeight = 1;
-        Pattern* pPattern = getCurrentPattern();
-        while (!patternCollides(pPattern, 0, patternHeight))
-        {
-            ++patternHeight;
-        }
-
-        const Sint8 OldPatternGridX = g_GameState.patternGridX;
-        const Sint8 OldPatternGridY = g_GameState.patternGridY;
-        g_GameState.patternGridY += patternHeight - 1;
-        const PatternType_t OldPatternType = g_GameState.currentPatternType;
-
-        commitCurrentPattern();
-        beginSpawnNextPattern();
-
-        g_GameState.lastDropFrame = g_GameState.currentFrame;
-
-        // Emit particles between the current pattern and the drop location
-        for (int i = 0; i < (patternHeight - 1); ++i)
-        {
-            if (!dropParticleShouldCreate())
+                break;
+            case SIM_EVENT_LEVEL_UP:
+                // Just stick with the default theme, it's a winner.
+                // g_GameState.pCurrentTheme =
+                //     ThemeGetNextTheme(g_GameState.pCurrentTheme);
+                break;
+            case SIM_EVENT_GAME_OVER:
+                AudioPlayGameOver();
+                break;
+            case SIM_EVENT_PAUSE:
+                AudioPauseMusic();
+                break;
+            case SIM_EVENT_RESUME:
+                AudioResumeMusic();
+                break;
+            case SIM_EVENT_RETRY:
             {
-                continue;
-            }
+                g_GameState.pCurrentTheme = g_DefaultThemes;
 
-            // Just one per grid position atm
-            SquareParticle_t* pNewParticle = 
-                ParticleSystemMakeParticle(&(g_GameState.DropParticles));
-            if (!pNewParticle)
-            {
-                continue;
+                // Get the music goin' again
+                const bool Success = AudioPlayMusic();
+                assert(Success);
+                break;
             }
-
-            // TODO: hm, not sure if this looks best or if the particles should
-            // have their own dedicated color(s)
-            Color* pColor = 
-                ThemeGetOuterColor(g_GameState.pCurrentTheme, OldPatternType);
-            const SDL_Color SDLColor = {
-                pColor->r,
-                pColor->g,
-                pColor->b,
-                SDL_ALPHA_OPAQUE
-            };
-            pNewParticle->Color = SDLColor;
-
-            Uint8 GridBaseX;
-            Uint8 GridBaseY;
-            getGridPosition(&GridBaseX, &GridBaseY);
-
-            pNewParticle->Size = dropParticleSize();
-            pNewParticle->Lifetime = i + 15;
-            pNewParticle->X =
-                OldPatternGridX * GRID_CELL_WIDTH + 
-                GridBaseX + 
-                ((pPattern->cols * GRID_CELL_WIDTH) / 2) +
-                dropParticleOffsetX();
-            pNewParticle->Y =
-                (OldPatternGridY + i) * GRID_CELL_HEIGHT + 
-                GridBaseY +
-                dropParticleOffsetY(); 
         }
     }
-    else if (dropFrameTarget <= sinceLastDrop || g_GameState.inputDownPressed)
-    {
-        if (!patternCollides(getCurrentPattern(), 0, 1))
-        {
-            g_GameState.patternGridY++;
-        }
-        else if (g_GameState.inputDownPressed)
-        {
-            // Only commit if drop was pressed, not held
-            InputContext* pInput = &(g_GameState.InputContext);
-            if (InputHasEventPressed(pInput, INPUTEVENT_DOWN))
-            {
-                commitCurrentPattern();
-                beginSpawnNextPattern();
-            }
-        }
-        else if (g_GameState.lockBeginFrame == 0)
-        {
-            // Start counting lock delay, which gets reset whenever we commit
-            // a pattern.
-            g_GameState.lockBeginFrame = g_GameState.currentFrame;
-        }
 
-        g_GameState.lastDropFrame = g_GameState.currentFrame;
+    if (pSim->state.isGameOver)
+    {
+        AudioStopMusic();
     }
+}
 
-    // Update lock delay if necessary
-    if (g_GameState.lockBeginFrame > 0)
+static void getCellTileColors(int tile, Color* pOuterOut, Color* pInnerOut)
+{
+    if (tile == CELL_TILE_SHADOW)
     {
-        // Reset lock delay if the current pattern isn't ready to lock
-        if (!patternCollides(getCurrentPattern(), 0, 1))
-        {
-            g_GameState.lockBeginFrame = 0;
-        }
-        else
-        {
-            const bool LockDelayExpired = 
-                g_GameState.lockBeginFrame > 0 &&
-                (g_GameState.currentFrame - g_GameState.lockBeginFrame) >= LOCK_DELAY_FRAMES;
-            if (LockDelayExpired)
-            {
-                commitCurrentPattern();
-                beginSpawnNextPattern();
-            }
-        }
+        const Color kShadowColorOuter = { 80, 15, 150 };
+        const Color kShadowColorInner = { 40, 15, 50 };
+        *pOuterOut = kShadowColorOuter;
+        *pInnerOut = kShadowColorInner;
     }
-
-    // Checking cleared lines or lose condition if there was a drop
-    if (g_GameState.lastDropFrame == g_GameState.currentFrame)
+    else if (tile == CELL_TILE_WHITE)
     {
-        memset(g_GameState.clearLines, -1, sizeof(g_GameState.clearLines));
-
-        // Check for cleared lines
-        Uint8 linesCleared = 0;
-        for (int y = 0; y < GRID_HEIGHT; ++y) {
-            bool lineCleared = true;
-            for (int x = 0; x < GRID_WIDTH; ++x) {
-                if (g_Grid[y][x].patternType == PATTERN_NONE)
-                {
-                    lineCleared = false;
-                    break;
-                }
-            }
-
-            if (lineCleared)
-            {
-                emitLineClearParticles(y);
-                g_GameState.clearLines[linesCleared] = y;
-                ++linesCleared;
-            }
-        }
-
-        if (linesCleared > 0)
-        {
-            int previousLevel = g_GameState.currentLevel;
-
-            AudioPlayLineClear();
-            g_GameState.totalClearedLines += linesCleared;
-            g_GameState.currentLevel = 
-                (g_GameState.totalClearedLines / LEVELUP_LINE_INTERVAL) + 1;
-            g_GameState.dropSpeed = START_DROP_SPEED + g_GameState.currentLevel;
-            g_GameState.clearLinesFrame = g_GameState.currentFrame;
-
-            if (g_GameState.totalClearedLines > g_GameState.currentBest)
-            {
-                g_GameState.currentBest = g_GameState.totalClearedLines;
-                writeBestToFilesystem();
-            }
-
-            if (g_GameState.currentLevel > previousLevel)
-            {
-                // Level up!
-                //
-                // Just stick with the default theme, it's a winner.
-                // g_GameState.pCurrentTheme =
-                //     ThemeGetNextTheme(g_GameState.pCurrentTheme);
-                g_GameState.levelUpFrame = g_GameState.currentFrame;
-            }
-        }
+        const Color kWhite = { 255, 255, 255 };
+        *pOuterOut = kWhite;
+        *pInnerOut = kWhite;
     }
-
-    g_GameState.currentFrame++;
-}
-
-void initializeGrid()
-{
-    memset(g_Grid, 0, sizeof(g_Grid));
-    for (Uint8 y = 0; y < GRID_HEIGHT; ++y) {
-        for (Uint8 x = 0; x < GRID_WIDTH; ++x) {
-            GridCell* pCell = &g_Grid[y][x];
-            pCell->x = x;
-            pCell->y = y;
-            pCell->patternType = PATTERN_NONE;
-        }
+    else
+    {
+        *pOuterOut = *ThemeGetOuterColor(g_GameState.pCurrentTheme, tile);
+        *pInnerOut = *ThemeGetInnerColor(g_GameState.pCurrentTheme, tile);
     }
-
 }
 
-void 
-renderCellArray(
+// Draws cells with a fill per color, blending both colors whiteAlpha of the
+// way to white. Used to paint the atlas, and for every cell when there's no
+// atlas.
+static void fillCellArray(
     SDL_Renderer* pRenderer,
-    PatternType_t patternType,
+    int tile,
     SDL_Rect* pRects,
     int numRects,
-    Color* pInnerColorOverride,
-    Color* pOuterColorOverride)
+    float whiteAlpha)
 {
+    Color kWhite = { 255, 255, 255 };
+    Color outer;
+    Color inner;
+    getCellTileColors(tile, &outer, &inner);
+    outer = ThemeBlendColor(&outer, &kWhite, whiteAlpha);
+    inner = ThemeBlendColor(&inner, &kWhite, whiteAlpha);
+
     // Outer
-    Color* pOuterColor = 
-        pOuterColorOverride ? pOuterColorOverride :
-        ThemeGetOuterColor(g_GameState.pCurrentTheme, (int)patternType);
     SDL_SetRenderDrawColor(
         pRenderer,
-        pOuterColor->r,
-        pOuterColor->g,
-        pOuterColor->b,
+        outer.r,
+        outer.g,
+        outer.b,
         SDL_ALPHA_OPAQUE);
     SDL_RenderFillRects(pRenderer, pRects, numRects);
 
     // Inner
     for (int i = 0; i < numRects; ++i)
     {
-        const int Border = CellBorderFromType(patternType);
+        const int Border = CellBorderFromType((PatternType_t)tile);
         SDL_Rect* pRect = &pRects[i];
         pRect->x += Border;
         pRect->y += Border;
         pRect->w -= (Border * 2);
         pRect->h -= (Border * 2);
     }
-    
-    Color* pInnerColor = 
-        pInnerColorOverride ? pInnerColorOverride :
-        ThemeGetInnerColor(g_GameState.pCurrentTheme, (int)patternType);
+
     SDL_SetRenderDrawColor(
         pRenderer,
-        pInnerColor->r,
-        pInnerColor->g,
-        pInnerColor->b,
+        inner.r,
+        inner.g,
+        inner.b,
         SDL_ALPHA_OPAQUE);
     SDL_RenderFillRects(pRenderer, pRects, numRects);
 }
 
-void 
-renderCellArrayBlendColor(
+// Paints one tile per cell style into the atlas the first time it's needed
+// and again whenever the theme changes. Returns false if the renderer can't
+// draw to textures.
+static bool updateCellAtlas(SDL_Renderer* pRenderer)
+{
+    CellBatch* pBatch = &g_CellBatch;
+    if (pBatch->pAtlas && pBatch->pAtlasTheme == g_GameState.pCurrentTheme)
+    {
+        return true;
+    }
+
+    if (pBatch->IsUnsupported)
+    {
+        return false;
+    }
+
+    if (!pBatch->pAtlas)
+    {
+        pBatch->pAtlas = SDL_RenderTargetSupported(pRenderer) ?
+            SDL_CreateTexture(
+                pRenderer,
+                SDL_PIXELFORMAT_RGBA8888,
+                SDL_TEXTUREACCESS_TARGET,
+                CELL_TILE_COUNT * GRID_CELL_WIDTH,
+                GRID_CELL_HEIGHT) :
+            NULL;
+        if (!pBatch->pAtlas)
+        {
+            fprintf(stderr, "No cell atlas, filling cells instead: %s\n", SDL_GetError());
+            pBatch->IsUnsupported = true;
+            return false;
+        }
+
+        // Blending only matters for the white overlays, tiles are opaque
+        SDL_SetTextureBlendMode(pBatch->pAtlas, SDL_BLENDMODE_BLEND);
+        SDL_SetTextureScaleMode(pBatch->pAtlas, SDL_ScaleModeNearest);
+    }
+
+    // The atlas can be repainted while the grid cache is being drawn to
+    SDL_Texture* pPreviousTarget = SDL_GetRenderTarget(pRenderer);
+    SDL_SetRenderTarget(pRenderer, pBatch->pAtlas);
+    for (int tile = 0; tile < CELL_TILE_COUNT; ++tile)
+    {
+        SDL_Rect tileRect;
+        tileRect.x = tile * GRID_CELL_WIDTH;
+        tileRect.y = 0;
+        tileRect.w = GRID_CELL_WIDTH;
+        tileRect.h = GRID_CELL_HEIGHT;
+        fillCellArray(pRenderer, tile, &tileRect, 1, 0.f);
+    }
+
+    SDL_SetRenderTarget(pRenderer, pPreviousTarget);
+    pBatch->pAtlasTheme = g_GameState.pCurrentTheme;
+    return true;
+}
+
+static void invalidateCellAtlas(bool isTextureLost)
+{
+    if (isTextureLost && g_CellBatch.pAtlas)
+    {
+        SDL_DestroyTexture(g_CellBatch.pAtlas);
+        g_CellBatch.pAtlas = NULL;
+    }
+
+    g_CellBatch.pAtlasTheme = NULL;
+}
+
+// Draws every queued cell with a single SDL_RenderGeometry call
+static void flushCellBatch(SDL_Renderer* pRenderer)
+{
+    CellBatch* pBatch = &g_CellBatch;
+    if (pBatch->NumQuads == 0)
+    {
+        return;
+    }
+
+    SDL_RenderGeometry(
+        pRenderer,
+        pBatch->pAtlas,
+        pBatch->Vertices,
+        pBatch->NumQuads * 4,
+        pBatch->Indices,
+        pBatch->NumQuads * 6);
+    pBatch->NumQuads = 0;
+}
+
+static void batchCellQuad(SDL_Renderer* pRenderer, const SDL_Rect* pRect, int tile, Uint8 alpha)
+{
+    CellBatch* pBatch = &g_CellBatch;
+    if (pBatch->NumQuads == CELL_BATCH_MAX_QUADS)
+    {
+        flushCellBatch(pRenderer);
+    }
+
+    const float U0 = (float)tile / CELL_TILE_COUNT;
+    const float U1 = (float)(tile + 1) / CELL_TILE_COUNT;
+    const float X0 = (float)pRect->x;
+    const float Y0 = (float)pRect->y;
+    const float X1 = (float)(pRect->x + pRect->w);
+    const float Y1 = (float)(pRect->y + pRect->h);
+    const SDL_Color Color = { 255, 255, 255, alpha };
+
+    SDL_Vertex* pVertices = &(pBatch->Vertices[pBatch->NumQuads * 4]);
+    pVertices[0] = (SDL_Vertex){ { X0, Y0 }, Color, { U0, 0.f } };
+    pVertices[1] = (SDL_Vertex){ { X1, Y0 }, Color, { U1, 0.f } };
+    pVertices[2] = (SDL_Vertex){ { X1, Y1 }, Color, { U1, 1.f } };
+    pVertices[3] = (SDL_Vertex){ { X0, Y1 }, Color, { U0, 1.f } };
+
+    const int First = pBatch->NumQuads * 4;
+    int* pIndices = &(pBatch->Indices[pBatch->NumQuads * 6]);
+    pIndices[0] = First;
+    pIndices[1] = First + 1;
+    pIndices[2] = First + 2;
+    pIndices[3] = First;
+    pIndices[4] = First + 2;
+    pIndices[5] = First + 3;
+
+    pBatch->NumQuads++;
+}
+
+// Queues cells in the style of tile, blended whiteAlpha of the way to white,
+// to be drawn by the next flushCellBatch. Falls back to filling them right
+// away when there's no atlas.
+void
+renderCellArray(
     SDL_Renderer* pRenderer,
-    PatternType_t patternType,
+    int tile,
     SDL_Rect* pRects,
     int numRects,
-    Color* pColorBlend,
-    float blendAlpha)
+    float whiteAlpha)
 {
-    // Outer
-    Color* pOuterColor = 
-        ThemeGetOuterColor(g_GameState.pCurrentTheme, (int)patternType);
-    Color outer = ThemeBlendColor(pOuterColor, pColorBlend, blendAlpha);
-
-    SDL_SetRenderDrawColor(
-        pRenderer,
-        outer.r,
-        outer.g,
-        outer.b,
-        SDL_ALPHA_OPAQUE);
-    SDL_RenderFillRects(pRenderer, pRects, numRects);
+    if (!updateCellAtlas(pRenderer))
+    {
+        fillCellArray(pRenderer, tile, pRects, numRects, whiteAlpha);
+        return;
+    }
 
-    // Inner
+    // Blending toward white is the same as covering the cell with white at
+    // that opacity
+    const Uint8 WhiteAlpha = (Uint8)(whiteAlpha * SDL_ALPHA_OPAQUE + 0.5f);
     for (int i = 0; i < numRects; ++i)
     {
-        const int Border = CellBorderFromType(patternType);
-        SDL_Rect* pRect = &pRects[i];
-        pRect->x += Border;
-        pRect->y += Border;
-        pRect->w -= (Border * 2);
-        pRect->h -= (Border * 2);
+        batchCellQuad(pRenderer, &pRects[i], tile, SDL_ALPHA_OPAQUE);
+        if (WhiteAlpha > 0)
+        {
+            batchCellQuad(pRenderer, &pRects[i], CELL_TILE_WHITE, WhiteAlpha);
+        }
     }
-    
-    Color* pInnerColor = 
-        ThemeGetInnerColor(g_GameState.pCurrentTheme, (int)patternType);
-    Color inner = ThemeBlendColor(pInnerColor, pColorBlend, blendAlpha);
-    SDL_SetRenderDrawColor(
-        pRenderer,
-        inner.r,
-        inner.g,
-        inner.b,
-        SDL_ALPHA_OPAQUE);
-    SDL_RenderFillRects(pRenderer, pRects, numRects);
 }
 
 void renderShadowPattern(SDL_Renderer* pRenderer)
 {
-    if (!g_GameState.renderCells || g_GameState.isGameOver)
+    if (!g_GameState.Sim.state.renderCells || g_GameState.Sim.state.isGameOver)
     {
         return;
     }
 
     // Don't render the shadow pattern if we're still waiting to spawn
-    if (waitingToSpawn())
+    if (SimWaitingToSpawn(&(g_GameState.Sim)))
     {
         return;
     }
 
-    PatternType_t patternType = g_GameState.currentPatternType;
-    Pattern* pPattern = getCurrentPattern();
+    PatternType_t patternType = g_GameState.Sim.state.currentPatternType;
+    Pattern* pPattern = SimGetCurrentPattern(&(g_GameState.Sim));
 
     // Figure out the shadow pattern location
-    int patternHeight = 1;
-    while (!patternCollides(pPattern, 0, patternHeight))
-    {
-        ++patternHeight;
-    }
+    const int ShadowPatternX = g_GameState.Sim.state.patternGridX;
+    const int ShadowPatternY = g_GameState.Sim.state.patternGridY + SimDropDistance(&(g_GameState.Sim));
 
-    const int ShadowPatternX = g_GameState.patternGridX;
-    const int ShadowPatternY = g_GameState.patternGridY + patternHeight - 1;
-
-    if (ShadowPatternY == g_GameState.patternGridY)
+    if (ShadowPatternY == g_GameState.Sim.state.patternGridY)
     {
         // We're overlapping the current pattern, so don't draw anything
         return;
@@ -1265,27 +759,24 @@ void renderShadowPattern(SDL_Renderer* pRenderer)
         }
     }
 
-    Color kShadowColorOuter = { 80, 15, 150 };
-    Color kShadowColorInner = { 40, 15, 50 };
-
     assert(toDrawIndex == 4);
     renderCellArray(
         pRenderer,
-        g_GameState.currentPatternType,
+        CELL_TILE_SHADOW,
         toDraw,
         toDrawIndex,
-        &kShadowColorInner, &kShadowColorOuter);
+        0.f);
 }
 
 void renderCurrentPattern(SDL_Renderer* pRenderer)
 {
-    if (!g_GameState.renderCells || g_GameState.isGameOver)
+    if (!g_GameState.Sim.state.renderCells || g_GameState.Sim.state.isGameOver)
     {
         return;
     }
 
-    PatternType_t patternType = g_GameState.currentPatternType;
-    Pattern* pPattern = getCurrentPattern();
+    PatternType_t patternType = g_GameState.Sim.state.currentPatternType;
+    Pattern* pPattern = SimGetCurrentPattern(&(g_GameState.Sim));
 
     Uint8 GridBaseX;
     Uint8 GridBaseY;
@@ -1297,8 +788,8 @@ void renderCurrentPattern(SDL_Renderer* pRenderer)
         for (int x = 0; x < 4; ++x) {
             if (pPattern->occupancy[y][x])
             {
-                const int GridX = x + g_GameState.patternGridX;
-                const int GridY = y + g_GameState.patternGridY;
+                const int GridX = x + g_GameState.Sim.state.patternGridX;
+                const int GridY = y + g_GameState.Sim.state.patternGridY;
 
                 if (GridY < 0)
                 {
@@ -1306,7 +797,7 @@ void renderCurrentPattern(SDL_Renderer* pRenderer)
                     continue;
                 }
 
-                if (isLineBeingCleared(GridY))
+                if (SimIsLineBeingCleared(&(g_GameState.Sim), GridY))
                 {
                     // Don't render cells that are being cleared
                     continue;
@@ -1323,42 +814,21 @@ void renderCurrentPattern(SDL_Renderer* pRenderer)
         }
     }
 
-    Color* pInnerColor = NULL;
-    Color* pOuterColor = NULL;
-    if (waitingToSpawn())
+    float whiteAlpha = 0.f;
+    if (SimWaitingToSpawn(&(g_GameState.Sim)))
     {
         // Animate color, blend from white to the target color
-        Color* pThemeOuterColor = 
-            ThemeGetOuterColor(g_GameState.pCurrentTheme, (int)patternType);
-        Color* pThemeInnerColor = 
-            ThemeGetInnerColor(g_GameState.pCurrentTheme, (int)patternType);
-
-        Uint64 sincePreSpawn = g_GameState.currentFrame - g_GameState.preSpawnFrame;
-        float t = (float)sincePreSpawn / SPAWN_DELAY_FRAMES;
-        const Color kWhite = { 255, 255, 255 };
-        Color blendedInner = {
-            kWhite.r * (1.0f - t) + pThemeInnerColor->r * t,
-            kWhite.g * (1.0f - t) + pThemeInnerColor->g * t,
-            kWhite.b * (1.0f - t) + pThemeInnerColor->b * t,
-        };
-
-        Color blendedOuter = {
-            kWhite.r * (1.0f - t) + pThemeOuterColor->r * t,
-            kWhite.g * (1.0f - t) + pThemeOuterColor->g * t,
-            kWhite.b * (1.0f - t) + pThemeOuterColor->b * t,
-        };
-
-        pInnerColor = &blendedInner;
-        pOuterColor = &blendedOuter;
+        Uint64 sincePreSpawn = g_GameState.Sim.state.currentFrame - g_GameState.Sim.state.preSpawnFrame;
+        float t = (float)sincePreSpawn / SPAWN_DELAY_FRAMES;
+        whiteAlpha = 1.0f - t;
     }
 
     renderCellArray(
         pRenderer,
-        g_GameState.currentPatternType,
+        patternType,
         toDraw,
         toDrawIndex,
-        pInnerColor,
-        pOuterColor);
+        whiteAlpha);
 }
 
 void renderNextPattern(SDL_Renderer* pRenderer, PatternType_t patternType, int baseX, int baseY)
@@ -1391,8 +861,8 @@ void renderNextPattern(SDL_Renderer* pRenderer, PatternType_t patternType, int b
         pRenderer,
         patternType,
         toDraw,
-        toDrawIndex, 
-        NULL, NULL);
+        toDrawIndex,
+        0.f);
 }
 
 void renderNextPatterns(SDL_Renderer* pRenderer)
@@ -1431,7 +901,7 @@ void renderNextPatterns(SDL_Renderer* pRenderer)
     }
 
     // Don't render the actual pattern if the game is paused
-    if (!g_GameState.renderCells)
+    if (!g_GameState.Sim.state.renderCells)
     {
         return;
     }
@@ -1439,8 +909,8 @@ void renderNextPatterns(SDL_Renderer* pRenderer)
     // Now draw the patterns
     for (Sint8 i = 0; i < NEXT_QUEUE_SIZE; ++i)
     {
-        const int NextQueueIndex = (g_GameState.nextQueueIndex + i) % NEXT_QUEUE_SIZE;
-        const PatternType_t NextPatternType = g_GameState.nextQueue[NextQueueIndex];
+        const int NextQueueIndex = (g_GameState.Sim.state.nextQueueIndex + i) % NEXT_QUEUE_SIZE;
+        const PatternType_t NextPatternType = g_GameState.Sim.state.nextQueue[NextQueueIndex];
         const int Y = NEXT_PATTERN_Y + PatternBlockHeight * i;
 
         renderNextPattern(pRenderer, NextPatternType, NEXT_PATTERN_X, Y);
@@ -1449,8 +919,8 @@ void renderNextPatterns(SDL_Renderer* pRenderer)
 
 void renderHoldPattern(SDL_Renderer* pRenderer)
 {
-    PatternType_t patternType = g_GameState.holdPatternType;
-    Pattern* pPattern = g_PatternLUT[g_GameState.holdPatternType][0];
+    PatternType_t patternType = g_GameState.Sim.state.holdPatternType;
+    Pattern* pPattern = g_PatternLUT[g_GameState.Sim.state.holdPatternType][0];
 
     // Draw the bg first
     Color black = { 0, 0, 0 };
@@ -1485,7 +955,7 @@ void renderHoldPattern(SDL_Renderer* pRenderer)
     }
 
     // Don't render the actual pattern if no pattern is held.
-    if (!g_GameState.renderCells || patternType == PATTERN_NONE)
+    if (!g_GameState.Sim.state.renderCells || patternType == PATTERN_NONE)
     {
         return;
     }
@@ -1514,10 +984,10 @@ void renderHoldPattern(SDL_Renderer* pRenderer)
     assert(toDrawIndex == 4);
     renderCellArray(
         pRenderer,
-        g_GameState.holdPatternType,
+        g_GameState.Sim.state.holdPatternType,
         toDraw,
         toDrawIndex,
-        NULL, NULL);
+        0.f);
 }
 
 void renderStats(SDL_Renderer* pRenderer)
@@ -1548,7 +1018,7 @@ void renderStats(SDL_Renderer* pRenderer)
     const int linesTextX = STATS_LOC_X + STATS_TEXT_BORDERLEFT_X;
     const int linesTextY = STATS_LOC_Y;
     char linesText[256];
-    sprintf(linesText, "LINES: %hu", g_GameState.totalClearedLines);
+    sprintf(linesText, "LINES: %hu", g_GameState.Sim.state.totalClearedLines);
     TextSetEntryData(g_GameState.hLinesText, pRenderer, linesText);
     if (!TextDrawEntry(g_GameState.hLinesText, pRenderer, linesTextX, linesTextY))
     {
@@ -1565,7 +1035,7 @@ void renderStats(SDL_Renderer* pRenderer)
     const int levelTextX = linesTextX;
     const int levelTextY = STATS_LEVEL_LOC_Y;
     char levelText[256];
-    sprintf(levelText, "LEVEL: %hhu", g_GameState.currentLevel);
+    sprintf(levelText, "LEVEL: %hhu", g_GameState.Sim.state.currentLevel);
     TextSetEntryData(g_GameState.hLevelText, pRenderer, levelText);
     if (!TextDrawEntry(g_GameState.hLevelText, pRenderer, levelTextX, levelTextY))
     {
@@ -1588,11 +1058,28 @@ void renderStats(SDL_Renderer* pRenderer)
     {
         fprintf(stderr, "Failed to draw best text\n");
     }
+
+    // Finesse faults text
+    if (g_GameState.hFaultsText == TEXT_INVALID_HANDLE)
+    {
+        g_GameState.hFaultsText = TextCreateEntry();
+        assert(g_GameState.hFaultsText != TEXT_INVALID_HANDLE);
+    }
+
+    const int faultsTextX = linesTextX;
+    const int faultsTextY = STATS_FAULTS_LOC_Y;
+    char faultsText[256];
+    sprintf(faultsText, "FAULTS: %u", g_GameState.Finesse.NumFaults);
+    TextSetEntryData(g_GameState.hFaultsText, pRenderer, faultsText);
+    if (!TextDrawEntry(g_GameState.hFaultsText, pRenderer, faultsTextX, faultsTextY))
+    {
+        fprintf(stderr, "Failed to draw faults text\n");
+    }
 }
 
 void renderPauseText(SDL_Renderer* pRenderer)
 {
-    if (g_GameState.isPaused)
+    if (g_GameState.Sim.state.isPaused)
     {
         if (g_GameState.hPausedText == TEXT_INVALID_HANDLE)
         {
@@ -1614,7 +1101,7 @@ void renderPauseText(SDL_Renderer* pRenderer)
 
 void renderIntroText(SDL_Renderer* pRenderer)
 {
-    if (g_GameState.isIntro)
+    if (g_GameState.Sim.state.isIntro)
     {
         if (g_GameState.hIntroText == TEXT_INVALID_HANDLE)
         {
@@ -1637,8 +1124,8 @@ void renderIntroText(SDL_Renderer* pRenderer)
 void renderGameOverText(SDL_Renderer* pRenderer)
 {
     const int GameOverFrames =
-        g_GameState.currentFrame - g_GameState.gameOverFrame;
-    if (g_GameState.isGameOver)
+        g_GameState.Sim.state.currentFrame - g_GameState.Sim.state.gameOverFrame;
+    if (g_GameState.Sim.state.isGameOver)
     {
         if (GameOverFrames >= GAMEOVER_SHOW_GAMEOVER_FRAMES)
         {
@@ -1689,8 +1176,8 @@ void renderGameOverText(SDL_Renderer* pRenderer)
 void renderLevelUpText(SDL_Renderer* pRenderer)
 {
     const int LevelUpFrames =
-        g_GameState.currentFrame - g_GameState.levelUpFrame;
-    if (g_GameState.levelUpFrame > 0)
+        g_GameState.Sim.state.currentFrame - g_GameState.Sim.state.levelUpFrame;
+    if (g_GameState.Sim.state.levelUpFrame > 0)
     {
         if (LevelUpFrames <= LEVELUP_TEXT_DURATION_FRAMES)
         {
@@ -1720,7 +1207,47 @@ void renderLevelUpText(SDL_Renderer* pRenderer)
     }
 }
 
-void renderGrid(SDL_Renderer* pRenderer) 
+// What each grid cell shows right now. Cells are drawn empty while nothing
+// is to be rendered, or while their line is being cleared.
+static void getGridCellTypes(Uint8 cellTypesOut[GRID_HEIGHT][GRID_WIDTH])
+{
+    for (Uint8 y = 0; y < GRID_HEIGHT; ++y)
+    {
+        const bool DrawEmptyRow =
+            !g_GameState.Sim.state.renderCells || SimIsLineBeingCleared(&(g_GameState.Sim), y);
+        if (DrawEmptyRow)
+        {
+            memset(cellTypesOut[y], PATTERN_NONE, GRID_WIDTH);
+            continue;
+        }
+
+        memcpy(cellTypesOut[y], g_GameState.Sim.cellTypes[y], GRID_WIDTH);
+    }
+}
+
+static float getGridBlendAlpha()
+{
+    // Blend color dynamically according to level up presentation
+    const int LevelUpDuration =
+        g_GameState.Sim.state.currentFrame - g_GameState.Sim.state.levelUpFrame;
+    if (g_GameState.Sim.state.levelUpFrame > 0 &&
+        LevelUpDuration <= LEVELUP_ANIM_DURATION_FRAMES)
+    {
+        return (float)LevelUpDuration * 0.2f / LEVELUP_ANIM_DURATION_FRAMES;
+    }
+
+    return 0.f;
+}
+
+// Draws the cells of every row set in rowMask, with the grid's upper left
+// corner at baseX, baseY
+static void renderGridRows(
+    SDL_Renderer* pRenderer,
+    Uint8 cellTypes[GRID_HEIGHT][GRID_WIDTH],
+    Uint32 rowMask,
+    int baseX,
+    int baseY,
+    float alpha)
 {
     // Reset the rect array rect counts
     for (int rectType = 0; rectType < (int)PATTERN_MAX_VALUE; ++rectType) {
@@ -1728,31 +1255,24 @@ void renderGrid(SDL_Renderer* pRenderer)
         pArray->NumRects = 0;
     }
 
-    Uint8 GridBaseX;
-    Uint8 GridBaseY;
-    getGridPosition(&GridBaseX, &GridBaseY);
-
     // Populate SDL Rect Arrays data structures for rendering
     for (Uint8 y = 0; y < GRID_HEIGHT; ++y) {
-        for (Uint8 x = 0; x < GRID_WIDTH; ++x) {
-            GridCell* pCell = &g_Grid[y][x];
-            assert((int)pCell->patternType >= 0);
-            assert((int)pCell->patternType < PATTERN_MAX_VALUE);
-
-            const bool DrawEmptyCell =
-                !g_GameState.renderCells || isLineBeingCleared(y);
+        if (!(rowMask & (1u << y)))
+        {
+            continue;
+        }
 
-            // Only show empty cells if no cells are to be rendered, or if
-            // the current line is being cleared
-            SDLRectArray* pRectArray = DrawEmptyCell ? 
-                &g_RectArrays.RectArrays[PATTERN_NONE] :
-                &g_RectArrays.RectArrays[pCell->patternType];
+        for (Uint8 x = 0; x < GRID_WIDTH; ++x) {
+            const PatternType_t CellType = cellTypes[y][x];
+            assert((int)CellType >= 0);
+            assert((int)CellType < PATTERN_MAX_VALUE);
 
+            SDLRectArray* pRectArray = &g_RectArrays.RectArrays[CellType];
             int rectIndex = pRectArray->NumRects;
             SDL_Rect* pRect = &pRectArray->Rects[rectIndex];
 
-            pRect->x = pCell->x * GRID_CELL_WIDTH + GridBaseX;
-            pRect->y = pCell->y * GRID_CELL_HEIGHT + GridBaseY;
+            pRect->x = x * GRID_CELL_WIDTH + baseX;
+            pRect->y = y * GRID_CELL_HEIGHT + baseY;
             pRect->w = GRID_CELL_WIDTH;
             pRect->h = GRID_CELL_HEIGHT;
 
@@ -1761,94 +1281,268 @@ void renderGrid(SDL_Renderer* pRenderer)
     }
 
     for (int rectType = 0; rectType < (int)PATTERN_MAX_VALUE; ++rectType) {
-        // Blend color dynamically according to level up presentation
-        const int LevelUpDuration = 
-            g_GameState.currentFrame - g_GameState.levelUpFrame;
-        float alpha = 0.f;
-        if (g_GameState.levelUpFrame > 0 && 
-            LevelUpDuration <= LEVELUP_ANIM_DURATION_FRAMES)
+        SDLRectArray* pArray = &g_RectArrays.RectArrays[rectType];
+        if (pArray->NumRects == 0)
         {
-            alpha = (float)LevelUpDuration * 0.2f / LEVELUP_ANIM_DURATION_FRAMES;
+            continue;
         }
-        Color blendColor;
-        
 
-        Color kWhite = { 255, 255, 255 };
-        SDLRectArray* pArray = &g_RectArrays.RectArrays[rectType];
-        renderCellArrayBlendColor(
+        renderCellArray(
             pRenderer,
             rectType,
             pArray->Rects,
             pArray->NumRects,
-            &kWhite,
             alpha
         );
     }
-}
 
-static SDL_Window* g_pWindow = NULL;
-static SDL_Renderer* g_pRender = NULL;
-static bool g_shouldQuit = false;
+    flushCellBatch(pRenderer);
+}
 
-static void mainloop()
+// Brings the cached grid texture up to date, redrawing only the rows whose
+// cells changed since they were last drawn. Returns false if the renderer
+// can't draw to textures.
+static bool updateGridCache(SDL_Renderer* pRenderer)
 {
-    const Color ClearColor = { 0, 0, 0 };
-    SDL_SetRenderDrawColor(
-        g_pRender,
-        ClearColor.r,
-        ClearColor.g,
-        ClearColor.b,
-        SDL_ALPHA_OPAQUE);
-    SDL_RenderClear(g_pRender);
+    GridCache* pCache = &g_GridCache;
+    if (!pCache->pTexture)
+    {
+        if (pCache->IsUnsupported)
+        {
+            return false;
+        }
 
-    resetInputStates();
+        pCache->pTexture = SDL_RenderTargetSupported(pRenderer) ?
+            SDL_CreateTexture(
+                pRenderer,
+                SDL_PIXELFORMAT_RGBA8888,
+                SDL_TEXTUREACCESS_TARGET,
+                GRID_WIDTH * GRID_CELL_WIDTH,
+                GRID_HEIGHT * GRID_CELL_HEIGHT) :
+            NULL;
+        if (!pCache->pTexture)
+        {
+            fprintf(stderr, "No grid texture, drawing cells every frame: %s\n", SDL_GetError());
+            pCache->IsUnsupported = true;
+            return false;
+        }
 
-    // Main loop
-    Uint64 startTime = SDL_GetPerformanceCounter();
+        // Every cell is opaque, so the copy can skip blending
+        SDL_SetTextureBlendMode(pCache->pTexture, SDL_BLENDMODE_NONE);
+        pCache->IsValid = false;
+    }
 
-    // Pump events, gotta do this before polling input
-    SDL_Event event;
-    while(SDL_PollEvent(&event) != 0)
+    Uint8 cellTypes[GRID_HEIGHT][GRID_WIDTH];
+    getGridCellTypes(cellTypes);
+
+    const float Alpha = getGridBlendAlpha();
+    Uint32 dirtyRows = 0;
+    if (!pCache->IsValid ||
+        pCache->DrawnAlpha != Alpha ||
+        pCache->pDrawnTheme != g_GameState.pCurrentTheme)
     {
-        if (event.type == SDL_QUIT)
+        dirtyRows = (1u << GRID_HEIGHT) - 1;
+    }
+    else
+    {
+        for (Uint8 y = 0; y < GRID_HEIGHT; ++y)
         {
-            g_shouldQuit = true;
+            if (memcmp(cellTypes[y], pCache->DrawnTypes[y], GRID_WIDTH) != 0)
+            {
+                dirtyRows |= 1u << y;
+            }
         }
     }
 
+    if (dirtyRows == 0)
+    {
+        return true;
+    }
+
+    SDL_SetRenderTarget(pRenderer, pCache->pTexture);
+    renderGridRows(pRenderer, cellTypes, dirtyRows, 0, 0, Alpha);
+    SDL_SetRenderTarget(pRenderer, NULL);
+
+    memcpy(pCache->DrawnTypes, cellTypes, sizeof(pCache->DrawnTypes));
+    pCache->DrawnAlpha = Alpha;
+    pCache->pDrawnTheme = g_GameState.pCurrentTheme;
+    pCache->IsValid = true;
+    return true;
+}
+
+static void invalidateGridCache(bool isTextureLost)
+{
+    if (isTextureLost && g_GridCache.pTexture)
+    {
+        SDL_DestroyTexture(g_GridCache.pTexture);
+        g_GridCache.pTexture = NULL;
+    }
+
+    g_GridCache.IsValid = false;
+}
+
+void renderGrid(SDL_Renderer* pRenderer) 
+{
+    Uint8 GridBaseX;
+    Uint8 GridBaseY;
+    getGridPosition(&GridBaseX, &GridBaseY);
+
+    if (!updateGridCache(pRenderer))
+    {
+        Uint8 cellTypes[GRID_HEIGHT][GRID_WIDTH];
+        getGridCellTypes(cellTypes);
+        renderGridRows(
+            pRenderer,
+            cellTypes,
+            (1u << GRID_HEIGHT) - 1,
+            GridBaseX,
+            GridBaseY,
+            getGridBlendAlpha());
+        return;
+    }
+
+    SDL_Rect gridRect;
+    gridRect.x = GridBaseX;
+    gridRect.y = GridBaseY;
+    gridRect.w = GRID_WIDTH * GRID_CELL_WIDTH;
+    gridRect.h = GRID_HEIGHT * GRID_CELL_HEIGHT;
+    SDL_RenderCopy(pRenderer, g_GridCache.pTexture, NULL, &gridRect);
+}
+
+Uint16 simInputsFromContext(InputContext* pInput)
+{
+    Uint16 inputs = SIM_INPUT_NONE;
+    if (InputHasEventPressed(pInput, INPUTEVENT_UP))
+    {
+        inputs |= SIM_INPUT_UP;
+    }
+
+    if (InputHasEventWithRepeat(pInput, INPUTEVENT_DOWN))
+    {
+        inputs |= SIM_INPUT_DOWN;
+    }
+
+    if (InputHasEventPressed(pInput, INPUTEVENT_DOWN))
+    {
+        inputs |= SIM_INPUT_DOWN_PRESSED;
+    }
+
+    if (InputHasEventWithRepeat(pInput, INPUTEVENT_LEFT))
+    {
+        inputs |= SIM_INPUT_LEFT;
+    }
+
+    if (InputHasEventWithRepeat(pInput, INPUTEVENT_RIGHT))
+    {
+        inputs |= SIM_INPUT_RIGHT;
+    }
+
+    if (InputHasEventPressed(pInput, INPUTEVENT_ROTATERIGHT))
+    {
+        inputs |= SIM_INPUT_ROTATE_RIGHT;
+    }
+
+    if (InputHasEventPressed(pInput, INPUTEVENT_ROTATELEFT))
+    {
+        // Rotate left doubles as the retry button on the game over screen
+        inputs |= SIM_INPUT_ROTATE_LEFT | SIM_INPUT_RETRY;
+    }
+
+    if (InputHasEventPressed(pInput, INPUTEVENT_HOLD))
+    {
+        inputs |= SIM_INPUT_HOLD;
+    }
+
+    if (InputHasEventPressed(pInput, INPUTEVENT_PAUSE))
+    {
+        inputs |= SIM_INPUT_PAUSE;
+    }
+
+    if (InputHasEventPressed(pInput, INPUTEVENT_BEGINGAME))
+    {
+        inputs |= SIM_INPUT_BEGIN;
+    }
+
+    return inputs;
+}
+
+static SDL_Window* g_pWindow = NULL;
+static SDL_Renderer* g_pRender = NULL;
+static bool g_shouldQuit = false;
+
+// Fast forward steps the sim as fast as possible and only renders every
+// g_RenderInterval frames. Frame based timing is unaffected.
+static bool g_FastForward = false;
+static int g_RenderInterval = 1;
+
+// When set, inputs come from this policy instead of the keyboard
+static Policy_t* g_pPolicy = NULL;
+static void* g_pPolicyState = NULL;
+
+// Every frame's inputs are appended to g_ReplayWriter while recording. While
+// playing back, inputs come from g_ReplayReader until it runs out.
+static ReplayWriter_t g_ReplayWriter;
+static ReplayReader_t g_ReplayReader;
+static bool g_IsRecordingReplay = false;
+static bool g_IsPlayingReplay = false;
+
+static void stepFrame()
+{
     InputContext* pInput = &(g_GameState.InputContext);
     InputUpdateContext(pInput);
 
-    g_shouldQuit = InputHasEventPressed(pInput, INPUTEVENT_QUIT);
-    g_GameState.inputUpPressed = InputHasEventPressed(pInput, INPUTEVENT_UP);
-    g_GameState.inputDownPressed = InputHasEventWithRepeat(pInput, INPUTEVENT_DOWN);
-    g_GameState.inputLeftPressed = InputHasEventWithRepeat(pInput, INPUTEVENT_LEFT);
-    g_GameState.inputRightPressed = InputHasEventWithRepeat(pInput, INPUTEVENT_RIGHT);
-    g_GameState.inputRotateRightPressed = InputHasEventPressed(pInput, INPUTEVENT_ROTATERIGHT);
-    g_GameState.inputRotateLeftPressed = InputHasEventPressed(pInput, INPUTEVENT_ROTATELEFT);
-    g_GameState.inputHoldPiece = InputHasEventPressed(pInput, INPUTEVENT_HOLD);
-    g_GameState.inputPauseGame = InputHasEventPressed(pInput, INPUTEVENT_PAUSE);
-    g_GameState.inputBeginGame = InputHasEventPressed(pInput, INPUTEVENT_BEGINGAME);
-    g_GameState.inputRetryGame = InputHasEventPressed(pInput, INPUTEVENT_ROTATELEFT);
+    g_shouldQuit = g_shouldQuit || InputHasEventPressed(pInput, INPUTEVENT_QUIT);
 
-    g_GameState.inputHoldPiece &= !g_GameState.isIntro;
-    g_GameState.inputRetryGame &= g_GameState.isGameOver;
+    if (!g_GameState.Sim.state.isIntro)
+    {
+        AudioPlayMusic();
+    }
 
+    Uint16 inputs = SIM_INPUT_NONE;
+    if (g_IsPlayingReplay && !ReplayReaderNext(&g_ReplayReader, &inputs))
+    {
+        fprintf(stderr, "Replay finished at frame %llu\n",
+            (unsigned long long)g_GameState.Sim.state.currentFrame);
+        ReplayReaderClose(&g_ReplayReader);
+        g_IsPlayingReplay = false;
+    }
 
-    if (!g_GameState.isIntro)
+    if (!g_IsPlayingReplay)
     {
-        AudioPlayMusic();
+        inputs = g_pPolicy ?
+            g_pPolicy->NextInputs(g_pPolicyState, &(g_GameState.Sim)) :
+            simInputsFromContext(pInput);
     }
 
-    updateGameState();
+    if (g_IsRecordingReplay)
+    {
+        ReplayWriterAppend(&g_ReplayWriter, &(g_GameState.Sim), inputs);
+    }
+    FinesseTrackerBeforeStep(&(g_GameState.Finesse), &(g_GameState.Sim), inputs);
+    SimStep(&(g_GameState.Sim), inputs);
+    FinesseTrackerAfterStep(&(g_GameState.Finesse), &(g_GameState.Sim));
+    handleSimEvents();
     ParticleSystemTick(&(g_GameState.DropParticles));
+    ParticleSystemTick(&(g_GameState.LineClearParticles));
+}
+
+static void renderFrame()
+{
+    const Color ClearColor = { 0, 0, 0 };
+    SDL_SetRenderDrawColor(
+        g_pRender,
+        ClearColor.r,
+        ClearColor.g,
+        ClearColor.b,
+        SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(g_pRender);
 
-    checkInputs();
     renderGrid(g_pRender);
     renderShadowPattern(g_pRender);
     renderCurrentPattern(g_pRender);
     renderNextPatterns(g_pRender);
     renderHoldPattern(g_pRender);
+    flushCellBatch(g_pRender);
     renderStats(g_pRender);
     renderPauseText(g_pRender);
     renderIntroText(g_pRender);
@@ -1866,6 +1560,51 @@ static void mainloop()
         g_pRender,
         LeftBound,
         RightBound);
+    ParticleSystemRender(
+        &(g_GameState.LineClearParticles),
+        g_pRender,
+        LeftBound,
+        RightBound);
+
+    SDL_RenderPresent(g_pRender);
+}
+
+static void mainloop()
+{
+    // Main loop
+    Uint64 startTime = SDL_GetPerformanceCounter();
+
+    // Pump events, gotta do this before polling input
+    SDL_Event event;
+    while(SDL_PollEvent(&event) != 0)
+    {
+        if (event.type == SDL_QUIT)
+        {
+            g_shouldQuit = true;
+        }
+        else if (event.type == SDL_RENDER_TARGETS_RESET)
+        {
+            invalidateCellAtlas(false);
+            invalidateGridCache(false);
+        }
+        else if (event.type == SDL_RENDER_DEVICE_RESET)
+        {
+            invalidateCellAtlas(true);
+            invalidateGridCache(true);
+        }
+    }
+
+    for (int i = 0; i < g_RenderInterval && !g_shouldQuit; ++i)
+    {
+        stepFrame();
+    }
+
+    renderFrame();
+
+    if (g_FastForward)
+    {
+        return;
+    }
 
     Uint64 endTime = SDL_GetPerformanceCounter();
 
@@ -1873,13 +1612,36 @@ static void mainloop()
         (float)SDL_GetPerformanceFrequency() * 1000.0f; 
     float expectedMs = (1.0f / FPS) * 1000.0f;
 
-    SDL_RenderPresent(g_pRender);
     SDL_Delay(expectedMs - elapsedMs);
+}
 
+static void printUsage(const char* pProgram)
+{
+    fprintf(stderr,
+        "Usage: %s [options] [asset root]\n"
+        "  --fast-forward N   Run uncapped, rendering every Nth frame\n"
+        "  --policy NAME      Let a built-in policy play instead of the keyboard\n"
+        "  --seed N           Seed the piece sequence\n"
+        "  --replay-record F  Record every frame's inputs to replay file F\n"
+        "  --replay-play F    Play back replay file F, then hand over control\n"
+        "  --replay-start N   Start playback at frame N of the replay\n"
+        "  --beam-threads N   Search threads for the beam policy (default: online cores)\n"
+        "  --beam-width N     Boards kept per depth by the beam policy (default %d)\n"
+        "  --beam-budget US   Beam policy thinking time per pattern (default %d)\n",
+        pProgram,
+        BOT_DEFAULT_BEAM_WIDTH,
+        BOT_REALTIME_BUDGET_MICROS);
+#ifndef __EMSCRIPTEN__
+    fprintf(stderr,
+        "  --bot CMD          Let an external bot play, talking TBP over CMD's stdin\n"
+        "                     and stdout\n");
+#endif
 }
 
 int main(int argc, char** argv)
 {
+    SimInitializeTables();
+
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
     {
         fprintf(stderr, "Failed to initialize SDL2: %s\n", SDL_GetError());
@@ -1910,7 +1672,111 @@ int main(int argc, char** argv)
     char* pDefaultAssetRoot = ".";
 #endif
 
-    char* pAssetRoot = (argc > 1 ? argv[1] : pDefaultAssetRoot);
+    char* pAssetRoot = pDefaultAssetRoot;
+    Uint64 seed = (Uint64)time(NULL);
+    const char* pPolicyName = NULL;
+    const char* pRecordPath = NULL;
+    const char* pPlayPath = NULL;
+    Uint64 replayStartFrame = 0;
+
+    // Playing in real time, so the bot thinks within a frame at a time
+    g_BotConfig.BudgetMicros = BOT_REALTIME_BUDGET_MICROS;
+    g_BotConfig.FrameMicros = BOT_REALTIME_FRAME_MICROS;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool HasValue = (i + 1) < argc;
+        if (strcmp(argv[i], "--fast-forward") == 0 && HasValue)
+        {
+            g_FastForward = true;
+            g_RenderInterval = atoi(argv[++i]);
+            g_RenderInterval = g_RenderInterval < 1 ? 1 : g_RenderInterval;
+        }
+        else if (strcmp(argv[i], "--policy") == 0 && HasValue)
+        {
+            pPolicyName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && HasValue)
+        {
+            seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--replay-record") == 0 && HasValue)
+        {
+            pRecordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay-play") == 0 && HasValue)
+        {
+            pPlayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay-start") == 0 && HasValue)
+        {
+            replayStartFrame = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--beam-threads") == 0 && HasValue)
+        {
+            g_BotConfig.NumThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--beam-width") == 0 && HasValue)
+        {
+            g_BotConfig.BeamWidth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--beam-budget") == 0 && HasValue)
+        {
+            g_BotConfig.BudgetMicros = strtoul(argv[++i], NULL, 10);
+        }
+#ifndef __EMSCRIPTEN__
+        else if (strcmp(argv[i], "--bot") == 0 && HasValue)
+        {
+            g_ExtBotConfig.pCommand = argv[++i];
+            pPolicyName = "external";
+        }
+#endif
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+        else
+        {
+            pAssetRoot = argv[i];
+        }
+    }
+
+    // A replay always plays out under the seed it was recorded with
+    if (pPlayPath)
+    {
+        if (!ReplayReaderOpen(&g_ReplayReader, pPlayPath))
+        {
+            return -1;
+        }
+
+        g_IsPlayingReplay = true;
+        seed = g_ReplayReader.Seed;
+    }
+
+    if (pPolicyName)
+    {
+        g_pPolicy = PolicyFind(pPolicyName);
+        g_pPolicyState = g_pPolicy ? calloc(1, g_pPolicy->StateSize) : NULL;
+        if (!g_pPolicyState)
+        {
+            fprintf(stderr, "Unknown policy: %s\n", pPolicyName);
+            return -1;
+        }
+
+        g_pPolicy->Begin(g_pPolicyState, seed);
+    }
+
+    if (pRecordPath)
+    {
+        if (!ReplayWriterOpen(&g_ReplayWriter, pRecordPath, seed))
+        {
+            return -1;
+        }
+
+        g_IsRecordingReplay = true;
+    }
+
     if (!AudioInitialize(pAssetRoot))
     {
         fprintf(stderr, "Did not initialize audio\n");
@@ -1926,10 +1792,14 @@ int main(int argc, char** argv)
     ParticleSystemInitialize(&(g_GameState.DropParticles), BEHAVIOR_DROP);
     ParticleSystemInitialize(&(g_GameState.LineClearParticles), BEHAVIOR_LINE_CLEAR);
 
-    srand(time(NULL));
+    initializeGameState(seed);
 
-    initializeGameState();
-    initializeGrid();
+    if (g_IsPlayingReplay &&
+        !ReplaySeek(&g_ReplayReader, &(g_GameState.Sim), replayStartFrame))
+    {
+        fprintf(stderr, "Replay has no frame %llu\n", (unsigned long long)replayStartFrame);
+        return -1;
+    }
 
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(mainloop, 0, 1);
@@ -1939,6 +1809,16 @@ int main(int argc, char** argv)
         mainloop();
     }
 
+    if (g_IsRecordingReplay)
+    {
+        ReplayWriterClose(&g_ReplayWriter);
+    }
+
+    if (g_pPolicy && g_pPolicy->End)
+    {
+        g_pPolicy->End(g_pPolicyState);
+    }
+
     AudioUninitialize();
 
     SDL_DestroyRenderer(g_pRender);